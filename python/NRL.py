@@ -79,6 +79,10 @@ class NRL(object):
         
         self.lib.newModel(self.obj, _propPath)
         
+    def newInference(self, _propPath, _exportPath):
+
+        self.lib.newInference(self.obj, _propPath, _exportPath)
+
     def setStateParser(self, _parser):
         
         self.parser = _parser
@@ -87,6 +91,18 @@ class NRL(object):
         
         self.lib.load(self.obj)         
             
+    def exportInference(self, _path, _pIds, _n):
+
+        self.lib.exportInference(self.obj, _path, _pIds, _n)
+
+    def loadInference(self, _path):
+
+        self.lib.loadInference(self.obj, _path)
+
+    def appendData(self, _samples, _n):
+
+        self.lib.appendData(self.obj, _samples, _n)
+
     def t_init(self, _stdoutLog):        
         
         self.lib.t_init(self.obj, _stdoutLog)
@@ -102,10 +118,26 @@ class NRL(object):
     def t_background(self):        
         
         self.lib.t_background(self.obj)
+
+    def t_enroll(self, _pId):
+
+        self.lib.t_enroll(self.obj, _pId)
+
+    def t_prune(self, _sparsity, _global=True):
+
+        self.lib.t_prune(self.obj, _sparsity, _global)
+
+    def t_sweep(self, _path, _nThreads=0):
+
+        self.lib.t_sweep(self.obj, _path, _nThreads)
+
+    def t_distribute(self, _rank, _workers):
+
+        self.lib.t_distribute(self.obj, _rank, _workers)
                                               
-    def e_enable(self, _pId, _winSize, _w, _expTime, _epoch, _alpha, _beta1, _beta2, _storeStates=False, _storeER=False):
+    def e_enable(self, _pId, _winSize, _w, _expTime, _epoch, _alpha, _beta1, _beta2, _storeStates=False, _storeER=False, _precision=b'fp32'):
         
-        self.lib.e_enable(self.obj, _pId, _winSize, _w, _expTime, _epoch, _alpha, _beta1, _beta2, _storeStates, _storeER)
+        self.lib.e_enablePrecision(self.obj, _pId, _winSize, _w, _expTime, _epoch, _alpha, _beta1, _beta2, _storeStates, _storeER, _precision)
         
     def e_postdict(self, _pos_win, _elbo, _showLog):
         
@@ -139,6 +171,10 @@ class NRL(object):
         
         self.lib.a_predict(self.obj, _path, _n, _init_state)	
 
+    def a_precisionReport(self, _path, _n, _init_state):
+        
+        self.lib.a_precisionReport(self.obj, _path, _n, _init_state)
+
     def a_feedForwardOutputFromContext(self, _context, _X):
         
         self.lib.a_feedForwardOutputFromContext(self.obj, _context, _X);	
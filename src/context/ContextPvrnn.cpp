@@ -53,6 +53,8 @@ namespace oist {
 
 ContextPvrnn::ContextPvrnn(){
 
+	tick = true;
+	tick_next = true;
 }
 
 ContextPvrnn::~ContextPvrnn(){
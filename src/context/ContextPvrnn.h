@@ -80,6 +80,11 @@ public:
 
 	ArrayXf dp_gen;			 	//!< Latent state *d* (prior distribution), for time step *t*
 
+	// multi-timescale execution
+
+	bool tick;				  	//!< The layer updates its states at time step *t*, else they are held from time step *t-1*
+	bool tick_next;			  	//!< The layer updates its states at time step *t+1* (backward computation)
+
 	// ------------ training mode
 
 	arrayXf2DContainer t_dp;	//!< Training mode: latent state *d* (prior distribution), for time step *t*
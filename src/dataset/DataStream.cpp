@@ -0,0 +1,412 @@
+/*<!--
+
+ BSD 3-Clause License
+
+  Copyright (c) 2020 Okinawa Institute of Science and Technology (OIST).
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above
+     copyright notice, this list of conditions and the following
+     disclaimer in the documentation and/or other materials provided
+     with the distribution.
+   * Neither the name of Willow Garage, Inc. nor the names of its
+     contributors may be used to endorse or promote products derived
+     from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+ Author: Hendry F. Chame <hendryfchame@gmail.com>
+
+ Publication:
+
+   Chame, H. F., Ahmadi, A., & Tani, J. (2020).
+   A hybrid human-neurorobotics approach to primary intersubjectivity via
+   active inference. Frontiers in psychology, 11.
+
+   Okinawa Institute of Science and Technology Graduate University (OIST)
+   Cognitive Neurorobotics Research Unit (CNRU)
+   1919-1, Tancha, Onna, Kunigami District, Okinawa 904-0495, Japan
+
+-->*/
+
+#include "DataStream.h"
+#include <cstdio>
+
+namespace oist {
+
+/**
+ * Appends raw values to a chunk
+ * */
+template <typename T>
+static void pack(string& chunk, const T* values, int n){
+	chunk.append((const char*)values, n*sizeof(T));
+}
+
+/**
+ * Extracts raw values from a chunk
+ * */
+template <typename T>
+static const char* unpack(const char* pos, const char* end, T* values, int n){
+	size_t size = n*sizeof(T);
+	if (n < 0 || pos + size > end)
+		throw Exception("Corrupted data-set stream chunk");
+	memcpy(values, pos, size);
+	return pos + size;
+}
+
+static void packVector(string& chunk, const VectorXf& v){
+	int n = v.size();
+	pack<int>(chunk, &n, 1);
+	pack<float>(chunk, v.data(), n);
+}
+
+static void packVector(string& chunk, const SparseVectorXf& v){
+	pack<int>(chunk, &v.first, 1);
+	packVector(chunk, v.values);
+}
+
+static const char* unpackVector(const char* pos, const char* end, VectorXf& v){
+	int n;
+	pos = unpack<int>(pos, end, &n, 1);
+	if (n < 0)
+		throw Exception("Corrupted data-set stream chunk");
+	v.resize(n);
+	return unpack<float>(pos, end, v.data(), n);
+}
+
+static const char* unpackVector(const char* pos, const char* end, SparseVectorXf& v){
+	pos = unpack<int>(pos, end, &v.first, 1);
+	return unpackVector(pos, end, v.values);
+}
+
+/**
+ * Serializes a primitive [sample][time][dof] as the counts of each level followed by the vectors
+ * */
+template <typename T>
+static void packPrimitive(string& chunk, T& input){
+	int nS = input.size();
+	pack<int>(chunk, &nS, 1);
+	for (int s = 0; s < nS; s++){
+		int nT = input[s].size();
+		pack<int>(chunk, &nT, 1);
+		for (int t = 0; t < nT; t++){
+			int nJ = input[s][t].size();
+			pack<int>(chunk, &nJ, 1);
+			for (int j = 0; j < nJ; j++)
+				packVector(chunk, input[s][t][j]);
+		}
+	}
+}
+
+template <typename T>
+static void unpackPrimitive(const char* pos, const char* end, T& output){
+	int nS, nT, nJ;
+	pos = unpack<int>(pos, end, &nS, 1);
+	output.resize(nS);
+	for (int s = 0; s < nS; s++){
+		pos = unpack<int>(pos, end, &nT, 1);
+		output[s].resize(nT);
+		for (int t = 0; t < nT; t++){
+			pos = unpack<int>(pos, end, &nJ, 1);
+			output[s][t].resize(nJ);
+			for (int j = 0; j < nJ; j++)
+				pos = unpackVector(pos, end, output[s][t][j]);
+		}
+	}
+}
+
+/**
+ * Gets the memory of a decoded primitive [sample][time][dof]
+ * */
+static size_t decodedBytes(sparseXf3DContainer& input){
+	size_t size = input.size()*sizeof(sparseXf2DContainer);
+	for (unsigned int s = 0; s < input.size(); s++){
+		size += input[s].size()*sizeof(sparseXf1DContainer);
+		for (unsigned int t = 0; t < input[s].size(); t++){
+			size += input[s][t].size()*sizeof(SparseVectorXf);
+			for (unsigned int j = 0; j < input[s][t].size(); j++)
+				size += input[s][t][j].values.size()*sizeof(float);
+		}
+	}
+	return size;
+}
+
+static size_t decodedBytes(TensorXf& input){
+	return input.values().size()*sizeof(float) + 2*input.getUnits().size()*sizeof(int) +
+			input.size()*(sizeof(int) + sizeof(size_t));
+}
+
+/**
+ * Serializes a dense primitive as the encoding units, the number of steps of each sample and the values
+ * */
+static void packPrimitive(string& chunk, TensorXf& input){
+	const int1DContainer& units = input.getUnits();
+	int nJ = units.size(), nS = input.size();
+	pack<int>(chunk, &nJ, 1);
+	pack<int>(chunk, units.data(), nJ);
+	pack<int>(chunk, &nS, 1);
+	for (int s = 0; s < nS; s++){
+		int nT = input[s].size();
+		pack<int>(chunk, &nT, 1);
+	}
+	const float1DContainer& values = input.values();
+	pack<float>(chunk, values.data(), values.size());
+}
+
+static void unpackPrimitive(const char* pos, const char* end, TensorXf& output){
+	int nJ, nS;
+	pos = unpack<int>(pos, end, &nJ, 1);
+	int1DContainer units(nJ > 0 ? nJ : 0);
+	pos = unpack<int>(pos, end, units.data(), nJ);
+	pos = unpack<int>(pos, end, &nS, 1);
+	int1DContainer steps(nS > 0 ? nS : 0);
+	pos = unpack<int>(pos, end, steps.data(), nS);
+	output = TensorXf(units);
+	size_t nSteps = 0;
+	for (int s = 0; s < nS; s++)
+		nSteps += steps[s] > 0 ? steps[s] : 0;
+	output.reserve(nSteps);
+	for (int s = 0; s < nS; s++){
+		if (steps[s] < 0)
+			throw Exception("Corrupted data-set stream chunk");
+		Map<MatrixXf> sample = output.append(steps[s]);
+		pos = unpack<float>(pos, end, sample.data(), sample.size());
+	}
+}
+
+DataStream::DataStream(const string& _file, size_t _budget, bool _sparse) {
+
+	file = _file;
+	budget = _budget;
+	sparse = _sparse;
+	resident = 0;
+	demand = -1;
+	stop = false;
+
+	writer.open(file, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+	if (!writer.is_open()){
+		stringstream stream;
+		stream << "Fail to create the data-set stream file [" << file << "]";
+		throw Exception(stream.str());
+	}
+}
+
+void DataStream::add(TensorXf& _input){
+
+	if (sparse)
+		throw Exception("The data-set stream stores the truncated encoding");
+
+	string chunk;
+	packPrimitive(chunk, _input);
+	offset.push_back(offset.empty() ? 0 : offset.back() + bytes.back());
+	bytes.push_back(chunk.size());
+	memory.push_back(decodedBytes(_input));
+	writer.write(chunk.data(), chunk.size());
+}
+
+void DataStream::add(sparseXf3DContainer& _input){
+
+	if (!sparse)
+		throw Exception("The data-set stream stores the dense encoding");
+
+	string chunk;
+	packPrimitive(chunk, _input);
+	offset.push_back(offset.empty() ? 0 : offset.back() + bytes.back());
+	bytes.push_back(chunk.size());
+	memory.push_back(decodedBytes(_input));
+	writer.write(chunk.data(), chunk.size());
+}
+
+void DataStream::open(){
+
+	writer.close();
+	if (writer.fail()){
+		remove(file.c_str());
+		stringstream stream;
+		stream << "Fail to write the data-set stream file [" << file << "]";
+		throw Exception(stream.str());
+	}
+	reader.open(file, std::ifstream::in | std::ifstream::binary);
+	if (!reader.is_open()){
+		remove(file.c_str());
+		stringstream stream;
+		stream << "Fail to open the data-set stream file [" << file << "]";
+		throw Exception(stream.str());
+	}
+
+	// the open file stays readable, and the system releases it when the process terminates
+	remove(file.c_str());
+	worker = std::thread(&DataStream::run, this);
+}
+
+int DataStream::size(){
+	return offset.size();
+}
+
+bool DataStream::isSparse(){
+	return sparse;
+}
+
+void DataStream::read(ifstream& _input, int _pID, Entry& _entry){
+
+	string chunk(bytes[_pID], '\0');
+	_input.seekg(offset[_pID]);
+	_input.read(&chunk[0], chunk.size());
+	if (!_input){
+		_input.clear();
+		stringstream stream;
+		stream << "Fail to read the primitive " << _pID << " from the data-set stream file [" << file << "]";
+		throw Exception(stream.str());
+	}
+
+	const char* begin = chunk.data();
+	if (sparse)
+		unpackPrimitive(begin, begin + chunk.size(), _entry.sparse);
+	else
+		unpackPrimitive(begin, begin + chunk.size(), _entry.dense);
+	_entry.bytes = memory[_pID];
+}
+
+void DataStream::run(){
+
+	std::unique_lock<std::mutex> lock(mtx);
+	while (true){
+
+		// the next primitive is loaded if it fits in the budget, unless it is waited or nothing is resident
+		cv.wait(lock, [this]{
+			return stop || (!queue.empty() &&
+					(resident == 0 || resident + memory[queue.front()] <= budget || queue.front() == demand));
+		});
+		if (stop)
+			break;
+
+		int pID = queue.front();
+		queue.pop_front();
+		if (entries.find(pID) != entries.end() || errors.find(pID) != errors.end())
+			continue;
+
+		Entry entry;
+		lock.unlock();
+		try{
+			read(reader, pID, entry);
+		}catch(Exception& _e){
+			// the error is kept until the primitive is accessed
+			lock.lock();
+			errors[pID] = _e.what();
+			cv.notify_all();
+			continue;
+		}
+		lock.lock();
+
+		resident += entry.bytes;
+		std::swap(entries[pID].dense, entry.dense);
+		entries[pID].sparse.swap(entry.sparse);
+		entries[pID].bytes = entry.bytes;
+		cv.notify_all();
+	}
+}
+
+void DataStream::prefetch(const int1DContainer& _order){
+
+	std::lock_guard<std::mutex> lock(mtx);
+	queue.clear();
+	for (unsigned int i = 0; i < _order.size(); i++){
+		if (entries.find(_order[i]) == entries.end() && errors.find(_order[i]) == errors.end())
+			queue.push_back(_order[i]);
+	}
+	cv.notify_all();
+}
+
+DataStream::Entry& DataStream::get(int _pID){
+
+	if (_pID < 0 || _pID >= (int)offset.size()){
+		stringstream stream;
+		stream << "The primitive " << _pID << " is not available in the data-set stream";
+		throw Exception(stream.str());
+	}
+
+	std::unique_lock<std::mutex> lock(mtx);
+	std::map<int, Entry>::iterator it = entries.find(_pID);
+	if (it == entries.end() && errors.find(_pID) == errors.end()){
+
+		// the primitive is moved to the front of the queue, if it was not requested in advance
+		std::deque<int>::iterator q = std::find(queue.begin(), queue.end(), _pID);
+		if (q != queue.end())
+			queue.erase(q);
+		queue.push_front(_pID);
+		demand = _pID;
+		cv.notify_all();
+
+		cv.wait(lock, [this, _pID]{ return errors.find(_pID) != errors.end() || entries.find(_pID) != entries.end(); });
+		demand = -1;
+		it = entries.find(_pID);
+	}
+
+	// the error of a failed load is reported once, the next access loads the primitive again
+	std::map<int, string>::iterator e = errors.find(_pID);
+	if (e != errors.end()){
+		string error = e->second;
+		errors.erase(e);
+		throw Exception(error);
+	}
+	return it->second;
+}
+
+TensorXf& DataStream::getDense(int _pID){
+
+	if (sparse)
+		throw Exception("The data-set stream stores the truncated encoding");
+	return get(_pID).dense;
+}
+
+sparseXf3DContainer& DataStream::getSparse(int _pID){
+
+	if (!sparse)
+		throw Exception("The data-set stream stores the dense encoding");
+	return get(_pID).sparse;
+}
+
+void DataStream::release(int _pID){
+
+	std::lock_guard<std::mutex> lock(mtx);
+	std::map<int, Entry>::iterator it = entries.find(_pID);
+	if (it != entries.end()){
+		resident -= it->second.bytes;
+		entries.erase(it);
+		cv.notify_all();
+	}
+}
+
+DataStream::~DataStream() {
+
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		stop = true;
+		cv.notify_all();
+	}
+	if (worker.joinable())
+		worker.join();
+	if (writer.is_open()){
+		writer.close();
+		remove(file.c_str());
+	}
+}
+
+} /* namespace oist */
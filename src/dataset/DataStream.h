@@ -0,0 +1,181 @@
+/*<!--
+
+ BSD 3-Clause License
+
+  Copyright (c) 2020 Okinawa Institute of Science and Technology (OIST).
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above
+     copyright notice, this list of conditions and the following
+     disclaimer in the documentation and/or other materials provided
+     with the distribution.
+   * Neither the name of Willow Garage, Inc. nor the names of its
+     contributors may be used to endorse or promote products derived
+     from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+ Author: Hendry F. Chame <hendryfchame@gmail.com>
+
+ Publication:
+
+   Chame, H. F., Ahmadi, A., & Tani, J. (2020).
+   A hybrid human-neurorobotics approach to primary intersubjectivity via
+   active inference. Frontiers in psychology, 11.
+
+   Okinawa Institute of Science and Technology Graduate University (OIST)
+   Cognitive Neurorobotics Research Unit (CNRU)
+   1919-1, Tancha, Onna, Kunigami District, Okinawa 904-0495, Japan
+
+-->*/
+
+#ifndef SRC_DATASET_DATASTREAM_H_
+#define SRC_DATASET_DATASTREAM_H_
+
+#include "../includes.h"
+#include "../utils/Tensor.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+namespace oist {
+
+/**
+ * This class keeps the encoded primitives of a data-set on disk, for data-sets larger than the memory.
+ * The file is composed of one chunk per primitive, written once while the data-set is encoded.
+ * During training, a background thread loads the primitives in the order given by @ref prefetch,
+ * while the decoded primitives fit in the memory budget. The primitives are accessed with
+ * @ref get and released with @ref release once they are no longer needed.
+ * The chunks store either the dense or the truncated (sparse) softmax encoding.
+ * The file is removed once it is written and opened, so it does not outlive the process.
+ * */
+class DataStream {
+
+	/**
+	 * Resident primitive
+	 * */
+	struct Entry {
+		TensorXf dense;
+		sparseXf3DContainer sparse;
+		size_t bytes;
+	};
+
+	string file;
+	bool sparse;				// flag indicating that the chunks store the truncated encoding
+	size_t budget;				// memory budget for the resident primitives in bytes
+	size_t resident;			// decoded bytes of the resident primitives
+	vector<size_t> offset;		// position of each chunk in the file
+	vector<size_t> bytes;		// size of each chunk in the file
+	vector<size_t> memory;		// decoded size of each primitive in bytes
+	ofstream writer;
+	ifstream reader;			// read by the loading thread only
+
+	std::map<int, Entry> entries;
+	std::deque<int> queue;		// primitives pending to be loaded
+	int demand;					// primitive waited by @ref get, loaded regardless of the budget (-1 if none)
+	bool stop;
+	std::map<int, string> errors;	// loading errors, reported when the primitive is accessed
+	std::thread worker;
+	std::mutex mtx;
+	std::condition_variable cv;
+
+	void run();
+	void read(ifstream& input, int pID, Entry& entry);
+
+public:
+
+	/**
+	 * Constructor, creates the file of the stream
+	 * @param file Full path of the file
+	 * @param budget Memory budget in bytes for the resident primitives, at least one primitive is always loaded
+	 * @param sparse Flag indicating that the truncated encoding is stored
+	 * */
+	DataStream(const string& file, size_t budget, bool sparse);
+
+	/**
+	 * Appends a primitive (in the writing mode)
+	 * @param input Dense encoding [sample][time][dof]
+	 * */
+	void add(TensorXf& input);
+
+	/**
+	 * Appends a primitive (in the writing mode)
+	 * @param input Truncated encoding [sample][time][dof]
+	 * */
+	void add(sparseXf3DContainer& input);
+
+	/**
+	 * Closes the writing mode, removes the file name while it is kept open, and starts the loading thread
+	 * */
+	void open();
+
+	/**
+	 * Gets the number of primitives
+	 * */
+	int size();
+
+	/**
+	 * Gets the flag indicating that the truncated encoding is stored
+	 * */
+	bool isSparse();
+
+	/**
+	 * Sets the order in which the primitives are going to be accessed. The pending primitives of a
+	 * previous order are discarded, while the resident ones are kept until released, and the failed
+	 * ones until their error is reported
+	 * @param order Primitive IDs
+	 * */
+	void prefetch(const int1DContainer& order);
+
+	/**
+	 * Gets a primitive, waiting until it is loaded. The error of a failed load is thrown, and the
+	 * primitive is loaded again on the next access
+	 * @param pID Primitive ID
+	 * @return Dense encoding [sample][time][dof], valid until released
+	 * */
+	TensorXf& getDense(int pID);
+
+	/**
+	 * Gets a primitive, waiting until it is loaded
+	 * @param pID Primitive ID
+	 * @return Truncated encoding [sample][time][dof], valid until released
+	 * */
+	sparseXf3DContainer& getSparse(int pID);
+
+	/**
+	 * Releases the memory of a primitive
+	 * @param pID Primitive ID
+	 * */
+	void release(int pID);
+
+	/**
+	 * Destructor, stops the loading thread and removes the file if it is still being written
+	 * */
+	virtual ~DataStream();
+
+private:
+
+	Entry& get(int pID);
+};
+
+} /* namespace oist */
+
+#endif /* SRC_DATASET_DATASTREAM_H_ */
@@ -48,6 +48,17 @@
 
 #include "Dataset.h"
 
+#include <thread>
+#include <atomic>
+
+#if !defined(_WIN32) || defined(__CYGWIN__)
+#define NRL_MMAP_AVAILABLE
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 namespace oist {
 
 Dataset::Dataset(string _path, string _dataPrefix, int1DContainer& _samples, float _dsoft, float _sigma, Utils* _ut, IRobot* _robot){
@@ -69,6 +80,7 @@ Dataset::Dataset(string _path, string _dataPrefix, int1DContainer& _samples, flo
 	// setting the encoding resolution
 	encDim = 0;
 	seqLen = 0;
+	cache = false;
 
 	for (int j = 0; j< nDof; j ++){
 		int r = (int)ceil(jrange[j]/dsoft);
@@ -86,47 +98,171 @@ Dataset::Dataset(string _path, string _dataPrefix, int1DContainer& _samples, flo
 
 }
 
-void Dataset::loadData(string _path, string _dataPrefix, int _nPrims, int1DContainer _nSamples, float4DContainer& _data){
+void Dataset::loadFile(string _file, float1DContainer& _data, int& _nSteps){
+
+	const char* c = nullptr;
+	const char* cEnd = nullptr;
+	string buffer;
+
+#ifdef NRL_MMAP_AVAILABLE
+	void* mapping = nullptr;
+	size_t mappingSize = 0;
+	int fd = open(_file.c_str(), O_RDONLY);
+	if (fd >= 0){
+		struct stat st;
+		if (fstat(fd, &st) == 0 && st.st_size > 0){
+			mappingSize = st.st_size;
+			mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (mapping == MAP_FAILED)
+				mapping = nullptr;
+			else{
+				madvise(mapping, mappingSize, MADV_SEQUENTIAL);
+				c = (const char*)mapping;
+				cEnd = c + mappingSize;
+			}
+		}
+		close(fd);
+	}
+	if (mapping == nullptr)
+#endif
+	{
+		std::ifstream file(_file, std::ifstream::binary);
+		if (!file.good()){
+			stringstream stream;
+			stream << "The file [" << _file << "] could not be opened. Hint: check if the parameter 'nsamples' in the model property file corresponds to the dataset samples'" << endl;
+			throw  Exception(stream.str());
+		}
+		buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		c = buffer.data();
+		cEnd = c + buffer.size();
+	}
+
+	// single pass over the file: each token is parsed from a reused copy,
+	// since the mapped text is not null-terminated
+	char delimiter = ut->getDelimiter()[0];
+	string token;
+	int nLine = 0;
+	string error;
+	_nSteps = 0;
+
+	while (c < cEnd && error.empty()){
+		const char* eol = (const char*)memchr(c, '\n', cEnd - c);
+		if (eol == nullptr)
+			eol = cEnd;
+		nLine ++;
+
+		int nCols = 0;
+		const char* t = c;
+		while (t < eol && nCols < nDof){
+			const char* tEnd = (const char*)memchr(t, delimiter, eol - t);
+			if (tEnd == nullptr)
+				tEnd = eol;
+			token.assign(t, tEnd - t);
+
+			char* parsed = nullptr;
+			errno = 0;
+			float value = strtof(token.c_str(), &parsed);
+			if (parsed == token.c_str()){
+				// a blank trailing token (e.g. after a final delimiter or '\r') is ignored
+				if (tEnd == eol && token.find_first_not_of(" \t\r") == string::npos)
+					break;
+				stringstream stream;
+				stream << "Invalid value [" << token << "] in the file [" << _file << "] at line #" << nLine << endl;
+				error = stream.str();
+				break;
+			}
+			if (errno == ERANGE){
+				stringstream stream;
+				stream << "Out of range value [" << token << "] in the file [" << _file << "] at line #" << nLine << endl;
+				error = stream.str();
+				break;
+			}
+			_data.push_back(value);
+			nCols ++;
+			t = tEnd + 1;
+		}
+		if (error.empty() && nCols < nDof){
+			stringstream stream;
+			stream << "Error: Please check the data row delimiter '" << ut->getDelimiter() << "'. Its was obtained less data that available Degrees of Freedom at line #" << nLine << endl;
+			error = stream.str();
+		}
+		_nSteps ++;
+		c = eol + 1;
+	}
 
+#ifdef NRL_MMAP_AVAILABLE
+	if (mapping != nullptr)
+		munmap(mapping, mappingSize);
+#endif
+
+	if (!error.empty())
+		throw  Exception(error);
+}
+
+void Dataset::loadData(string _path, string _dataPrefix, int _nPrims, const int1DContainer& _first, int1DContainer _nSamples, vector<PrimitiveData>& _data){
+
+	// the sample files are loaded in parallel, each thread taking the next pending file
+	vector<string> files;
+	int1DContainer filePrim;
 	for (int p = 0; p < _nPrims; p++){
-		float3DContainer d_p;
-		for (int s = 0; s < nSamples[p]; s++){
+		for (int s = _first[p]; s < _nSamples[p]; s++){
 			stringstream stream;
-			stream << _path << "/" << dataPrefix << "_" << p << "_" << s << ".csv";
-			std::ifstream file(stream.str());
-			if (!file.good()){
-				stringstream stream2;
-				stream2 << "The file [" << stream.str() << "] could not be opened. Hint: check if the parameter 'nsamples' in the model property file corresponds to the dataset samples'" << endl;
-				throw  Exception(stream2.str());				
-			}
-			std::string line = "";
-			float2DContainer d_ps;
-
-			// Iterate through each line and split the content using delimiter
-			int nLine = 0;
-			while (getline(file, line)){
-				nLine ++;
-				float1DContainer d_pst;
-
-				std::vector<string> vec;
-				ut->split(vec, line);
-			
-				if (nDof > (int)vec.size()){
-					stringstream stream;
-					stream << "Error: Please check the data row delimiter '" << ut->getDelimiter() << "'. Its was obtained less data that available Degrees of Freedom at line #" << nLine << endl;
-					throw  Exception(stream.str());
-				}
-				for (std::vector<string>::iterator j = vec.begin() ; j != vec.end(); j++)
-					d_pst.push_back(stof(*j));
-				d_ps.push_back(d_pst);
+			stream << _path << "/" << _dataPrefix << "_" << p << "_" << s << ".csv";
+			files.push_back(stream.str());
+			filePrim.push_back(p);
+		}
+	}
+
+	int nFiles = files.size();
+	vector<float1DContainer> fileData(nFiles);
+	int1DContainer fileSteps(nFiles, 0);
+	vector<string> fileErrors(nFiles);
+	std::atomic<int> next(0);
+
+	auto worker = [&](){
+		int i;
+		while ((i = next++) < nFiles){
+			try{
+				loadFile(files[i], fileData[i], fileSteps[i]);
+			}catch(Exception& _e){
+				fileErrors[i] = _e.what();
+			}catch(...){
+				fileErrors[i] = string("Unknown exception when loading the file [") + files[i] + "]";
 			}
-			if ((int)d_ps.size() > seqLen)
-				seqLen = d_ps.size();
+		}
+	};
+
+	int nThreads = min<int>(nFiles, max<int>(1, std::thread::hardware_concurrency()));
+	vector<std::thread> threads;
+	for (int i = 1; i < nThreads; i++)
+		threads.push_back(std::thread(worker));
+	worker();
+	for (unsigned int i = 0; i < threads.size(); i++)
+		threads[i].join();
+
+	for (int i = 0; i < nFiles; i++){
+		if (!fileErrors[i].empty())
+			throw  Exception(fileErrors[i]);
+	}
 
-			d_p.push_back(d_ps);
-			file.close();
+	// gathering the samples of each primitive in a contiguous buffer
+	_data.resize(_nPrims);
+	for (int p = 0, i = 0; p < _nPrims; p++){
+		PrimitiveData& d_p = _data[p];
+		size_t size = 0;
+		for (int k = i; k < nFiles && filePrim[k] == p; k++)
+			size += fileData[k].size();
+		d_p.data.reserve(size);
+
+		for (; i < nFiles && filePrim[i] == p; i++){
+			d_p.nSteps.push_back(fileSteps[i]);
+			d_p.offset.push_back(d_p.data.size());
+			d_p.data.insert(d_p.data.end(), fileData[i].begin(), fileData[i].end());
+			float1DContainer().swap(fileData[i]);
+
+			if (fileSteps[i] > seqLen)
+				seqLen = fileSteps[i];
 		}
-		_data.push_back(d_p);
 	}
 	if (seqLen == 0){
 		stringstream stream;
@@ -134,8 +270,111 @@ void Dataset::loadData(string _path, string _dataPrefix, int _nPrims, int1DConta
 		throw  Exception(stream.str());
 	}
 
-	cout << "Dataset loaded. Primitive number: " << _data.size() << ", length: " << seqLen << " steps" << endl;
+}
 
+void Dataset::setCache(bool _enable){
+	cache = _enable;
+}
+
+bool Dataset::getCacheKey(string& _key, string& _file){
+
+#ifdef NRL_MMAP_AVAILABLE
+	// the key describes everything the encoding depends on, the active joints
+	// are reflected by the number of DoF and the joint limits
+	stringstream key;
+	key.precision(9);
+	key << "dsoft=" << dsoft << ";sigma=" << sigma << ";dof=" << nDof << ";";
+	for (int j = 0; j < nDof; j++)
+		key << jmin[j] << "," << jmax[j] << "," << jrange[j] << ";";
+
+	for (int p = 0; p < nPrims; p++){
+		for (int s = 0; s < nSamples[p]; s++){
+			stringstream stream;
+			stream << path << "/" << dataPrefix << "_" << p << "_" << s << ".csv";
+			struct stat st;
+			if (stat(stream.str().c_str(), &st) != 0)
+				return false;
+			key << p << "_" << s << ":" << (long long)st.st_size << "," << (long long)st.st_mtime;
+#if defined(__linux__)
+			key << "." << (long long)st.st_mtim.tv_nsec;
+#endif
+			key << ";";
+		}
+	}
+	_key = key.str();
+
+	// FNV-1a hash, so that different encodings of the same data-set have their own cache file
+	unsigned long long hash = 14695981039346656037ULL;
+	for (unsigned int i = 0; i < _key.size(); i++){
+		hash ^= (unsigned char)_key[i];
+		hash *= 1099511628211ULL;
+	}
+	stringstream file;
+	file << path << "/" << dataPrefix << "_softmax_" << std::hex << hash << ".cache";
+	_file = file.str();
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool Dataset::loadCache(const string& _key, const string& _file, tensorXf1DContainer& _output){
+
+	if (!Checkpoint::exists(_file))
+		return false;
+
+	try{
+		Checkpoint ckpt;
+		ckpt.read(_file, true);
+
+		// the full key is stored in the cache to discard hash collisions
+		float1DContainer fKey, fSeqLen;
+		if (!ckpt.getMeta("key", fKey) || !ckpt.getMeta("seq_len", fSeqLen) || fKey.size() != _key.size())
+			return false;
+		for (unsigned int i = 0; i < _key.size(); i++)
+			if ((char)fKey[i] != _key[i])
+				return false;
+
+		tensorXf1DContainer output(nPrims, TensorXf(nUnits));
+		for (int p = 0; p < nPrims; p++){
+			for (int s = 0; s < nSamples[p]; s++){
+				stringstream name; name << "p" << p << "_s" << s;
+				Map<const MatrixXf> enc = ckpt.view(name.str());
+				if (enc.rows() != encDim)
+					throw Exception("The number of encoding units does not match");
+				output[p].append(enc.cols()) = enc;
+			}
+		}
+		_output.swap(output);
+		seqLen = int(fSeqLen[0]);
+	}catch(Exception& _e){
+		cout << "Warning: the data-set cache [" << _file << "] could not be used, msg[" << _e.what() << "]" << endl;
+		return false;
+	}
+
+	cout << "Dataset loaded from cache. Primitive number: " << _output.size() << ", length: " << seqLen << " steps" << endl;
+	return true;
+}
+
+void Dataset::saveCache(const string& _key, const string& _file, tensorXf1DContainer& _output){
+
+	try{
+		Checkpoint ckpt;
+		ckpt.setMeta("key", float1DContainer(_key.begin(), _key.end()));
+		ckpt.setMeta("seq_len", (float)seqLen);
+
+		// one block per sample, the columns are the time steps and the rows the encoding units of all DoF
+		for (int p = 0; p < nPrims; p++){
+			for (int s = 0; s < (int)_output[p].size(); s++){
+				Map<MatrixXf> enc = _output[p].sample(s);
+				stringstream name; name << "p" << p << "_s" << s;
+				ckpt.add<Map<MatrixXf> >(name.str(), &enc);
+			}
+		}
+		ckpt.write(_file);
+	}catch(Exception& _e){
+		cout << "Warning: the data-set cache [" << _file << "] could not be written, msg[" << _e.what() << "]" << endl;
+	}
 }
 
 int Dataset::getNPrim(){
@@ -145,11 +384,25 @@ int Dataset::getPrimLength(){
 	return seqLen;
 }
 
+void Dataset::setPrimLength(int _length){
+	seqLen = _length;
+}
+
 void Dataset::getNunitsPerDim(int1DContainer& _vec){
 	for (int j = 0; j < nDof ; j++)
 		_vec.push_back(nUnits[j]);
 }
 
+void Dataset::getDecodingGrid(VectorXf& output){
+
+	output.resize(encDim);
+	int k = 0;
+	for (int j = 0; j < nDof; j++){
+		for (int r = 0; r < nUnits[j]; r++, k++)
+			output(k) = jmin[j] + jrange[j]*ref[j][r];
+	}
+}
+
 void Dataset::encodeSoftmax(float* input, int* size, vectorXf2DContainer& output){
 
 	float sigma2 = sigma*sigma;
@@ -172,17 +425,8 @@ void Dataset::encodeSoftmax(float* input, int* size, vectorXf2DContainer& output
 			float v = ((d_tj - (*jmin_))/(*jrange_)) + NON_ZERO;
 			int encUnits = *encU_;
 
-			float normalization = 0.0;
-			float1DContainer::iterator ref_j = ref_->begin();
 			VectorXf encPSJ = VectorXf::Zero(encUnits);
-			auto dv_ = encPSJ.data();
-			for (int r = 0; r < encUnits; r++, ref_j++, dv_++){
-				float softmax = exp(-(pow((*ref_j)- v, 2.0))/sigma2);
-				*dv_ = softmax;
-				normalization += softmax;
-			}
-
-			encPSJ/= normalization;
+			kernels->gaussian(ref_->data(), v, sigma2, encPSJ.data(), encUnits);
 			encData_t.push_back(encPSJ);
 
 		}
@@ -190,70 +434,239 @@ void Dataset::encodeSoftmax(float* input, int* size, vectorXf2DContainer& output
 	}
 }
 
-void Dataset::softmax(float2DContainer& input, vectorXf2DContainer& output){
+void Dataset::softmax(const float* input, int nT, Map<MatrixXf> output){
 
 	float sigma2 = sigma*sigma;
-	int nT = input.size();
 
 	for (int t = 0; t < nT; t++){
 
-		float1DContainer d_t = input[t];
-		vectorXf1DContainer encUnits_j;
+		const float* d_t = input + t*nDof;
+		float* enc_t = output.col(t).data();
 
 		for (int j = 0; j < nDof; j++){
 
 			int encUnits = nUnits[j];
 
-			VectorXf encPSJ = VectorXf::Zero(encUnits);
+			float* encPSJ = enc_t;
 
 			float d_tj = d_t[j];
 
-			vector<float> ref_j = ref[j];
+			const float1DContainer& ref_j = ref[j];
 
 			float v = (d_tj - jmin[j])/jrange[j];
 
-			float normalization = 0.0;
+			// normalized distribution
+			kernels->gaussian(ref_j.data(), v, sigma2, encPSJ, encUnits);
+			enc_t += encUnits;
+		}
+	}
+}
+
+void Dataset::softmax(PrimitiveData& input, TensorXf& output){
 
-			for (int r = 0; r < encUnits; r++){
+	output = TensorXf(nUnits);
+	size_t nSteps = 0;
+	for (unsigned int s = 0; s < input.nSteps.size(); s++)
+		nSteps += input.nSteps[s];
+	output.reserve(nSteps);
 
-				float softmax = exp(-(pow(ref_j[r]- v, 2.0))/sigma2);
-				encPSJ(r) = softmax;
-				normalization += softmax;
-			}
+	for (unsigned int s = 0; s < input.nSteps.size(); s++)
+		softmax(input.data.data() + input.offset[s], input.nSteps[s], output.append(input.nSteps[s]));
+}
 
-			// normalizing the distributions
-			for (int r = 0; r < encUnits; r++){
-				encPSJ(r) /= normalization;
-			}
-			encUnits_j.push_back(encPSJ);
+void Dataset::encodeSoftmax(tensorXf1DContainer& output){
 
-		}
-		output.push_back(encUnits_j);
+	string cacheKey, cacheFile;
+	bool useCache = cache && getCacheKey(cacheKey, cacheFile);
+	if (useCache && loadCache(cacheKey, cacheFile, output))
+		return;
+
+	vector<PrimitiveData> dec_data;
+
+	loadData(path, dataPrefix, nPrims, int1DContainer(nPrims, 0), nSamples, dec_data);
+	cout << "Dataset loaded. Primitive number: " << nPrims << ", length: " << seqLen << " steps" << endl;
+
+	output.resize(nPrims);
+	for (int p = 0; p < nPrims; p++){
+		softmax(dec_data[p], output[p]);
 	}
+
+	if (useCache)
+		saveCache(cacheKey, cacheFile, output);
 }
 
-void Dataset::encodeSoftmax(vectorXf4DContainer& output){
+float Dataset::encodeSoftmax(DataStream& output, float tol, float1DContainer& entropy){
+
+	size_t nDense = 0;
+	size_t nSparse = 0;
+
+	// the primitives are loaded and encoded one at a time, so that a single one is in memory
+	entropy.clear();
+	for (int p = 0; p < nPrims; p++){
+
+		int1DContainer first(nSamples);
+		first[p] = 0;
+		vector<PrimitiveData> dec_data;
+		loadData(path, dataPrefix, nPrims, first, nSamples, dec_data);
+
+		tensorXf1DContainer enc(1);
+		softmax(dec_data[p], enc[0]);
+
+		float1DContainer ent;
+		if (output.isSparse()){
+			sparseXf4DContainer sp;
+			truncateSoftmax(enc, tol, sp);
+			for (unsigned int s = 0; s < sp[0].size(); s++){
+				for (unsigned int t = 0; t < sp[0][s].size(); t++){
+					for (unsigned int j = 0; j < sp[0][s][t].size(); j++){
+						nDense += enc[0].getUnits()[j];
+						nSparse += sp[0][s][t][j].values.size();
+					}
+				}
+			}
+			targetEntropy(sp, ent);
+			output.add(sp[0]);
+		}
+		else{
+			targetEntropy(enc, ent);
+			output.add(enc[0]);
+		}
+		entropy.push_back(ent[0]);
+	}
+	output.open();
+
+	cout << "Dataset streamed. Primitive number: " << nPrims << ", length: " << seqLen << " steps" << endl;
+	return (nDense > 0) ? ((float)nSparse)/((float)nDense) : 1.0;
+}
 
-	float4DContainer dec_data;
+int Dataset::appendSoftmax(int1DContainer& _samples, tensorXf1DContainer& output){
 
-	loadData(path, dataPrefix, nPrims, nSamples, dec_data);
+	int nNew = _samples.size();
+	if (nNew < nPrims){
+		stringstream stream;
+		stream << "The number of samples of the " << nPrims << " primitives in the data-set should be given";
+		throw  Exception(stream.str());
+	}
 
+	int1DContainer first(nNew, 0);
 	for (int p = 0; p < nPrims; p++){
+		if (_samples[p] < nSamples[p]){
+			stringstream stream;
+			stream << "The primitive " << p << " has " << nSamples[p] << " samples, they cannot be removed";
+			throw  Exception(stream.str());
+		}
+		first[p] = nSamples[p];
+	}
+
+	// the network is unrolled over the current sequence length, hence it cannot grow
+	int len = seqLen;
+	vector<PrimitiveData> dec_data;
+	loadData(path, dataPrefix, nNew, first, _samples, dec_data);
+	cout << "Dataset loaded. Primitive number: " << nNew << ", length: " << seqLen << " steps" << endl;
+	if (seqLen > len){
+		seqLen = len;
+		stringstream stream;
+		stream << "The new samples are longer than the sequence length of the data-set (" << len << " steps)";
+		throw  Exception(stream.str());
+	}
 
-		vectorXf3DContainer enc_p;
-		float3DContainer dec_p = dec_data[p];
+	output.clear();
+	output.resize(nNew);
+	for (int p = 0; p < nNew; p++)
+		softmax(dec_data[p], output[p]);
 
-		for (unsigned int s = 0; s <dec_p.size(); s++){
-			float2DContainer dec_ps = dec_p[s];
-			vectorXf2DContainer enc_ps;
-			softmax(dec_ps, enc_ps);
-			enc_p.push_back(enc_ps);
+	int added = nNew - nPrims;
+	nSamples = _samples;
+	nPrims = nNew;
+	return added;
+}
+
+float Dataset::truncateSoftmax(tensorXf1DContainer& input, float tol, sparseXf4DContainer& output){
+
+	size_t nDense = 0;
+	size_t nSparse = 0;
+
+	output.clear();
+	for (unsigned int p = 0; p < input.size(); p++){
+		sparseXf3DContainer sp_p;
+		for (unsigned int s = 0; s < input[p].size(); s++){
+			sparseXf2DContainer sp_ps;
+			SequenceViewXf in_ps = input[p][s];
+			for (unsigned int t = 0; t < in_ps.size(); t++){
+				sparseXf1DContainer sp_pst;
+				StepViewXf in_pst = in_ps[t];
+				for (unsigned int j = 0; j < in_pst.size(); j++){
+
+					// the Gaussian encoding is unimodal, hence the non-negligible units form a band
+					Map<const VectorXf> enc = in_pst[j];
+					int first = 0;
+					int last = enc.size() - 1;
+					while (first < last && enc(first) < tol)
+						first++;
+					while (last > first && enc(last) < tol)
+						last--;
+
+					SparseVectorXf sp;
+					sp.first = first;
+					sp.values = enc.segment(first, last - first + 1);
+					sp_pst.push_back(sp);
+
+					nDense += enc.size();
+					nSparse += sp.values.size();
+				}
+				sp_ps.push_back(sp_pst);
+			}
+			sp_p.push_back(sp_ps);
 		}
-		output.push_back(enc_p);
+		output.push_back(sp_p);
 	}
+	return (nDense > 0) ? ((float)nSparse)/((float)nDense) : 1.0;
+}
+
+/**
+ * Sum of the Y*log(Y) terms of an encoded vector, the zero units do not contribute
+ * */
+static double entropyTerm(const Ref<const VectorXf>& y){
+	return (y.array()*(y.array() + NON_ZERO).log()).cast<double>().sum();
+}
+
+static double entropyTerm(const SparseVectorXf& y){
+	return entropyTerm(y.values);
+}
+
+template <typename T>
+static double entropySum(const T& seq){
+	double sum = 0.0;
+	for (unsigned int t = 0; t < seq.size(); t++)
+		for (unsigned int j = 0; j < seq[t].size(); j++)
+			sum += entropyTerm(seq[t][j]);
+	return sum;
+}
 
+void Dataset::targetEntropy(tensorXf1DContainer& input, float1DContainer& output){
+
+	// the samples of a primitive are contiguous, hence the terms are summed over a single buffer
+	output.clear();
+	for (unsigned int p = 0; p < input.size(); p++){
+		const float1DContainer& values = input[p].values();
+		output.push_back((float)entropyTerm(Map<const VectorXf>(values.data(), values.size())));
+	}
 }
 
+void Dataset::targetEntropy(sparseXf4DContainer& input, float1DContainer& output){
+
+	output.clear();
+	for (unsigned int p = 0; p < input.size(); p++){
+		double sum = 0.0;
+		for (unsigned int s = 0; s < input[p].size(); s++)
+			sum += entropySum(input[p][s]);
+		output.push_back((float)sum);
+	}
+}
+
+float Dataset::targetEntropy(vectorXf2DContainer& input){
+	return (float)entropySum(input);
+}
 
 Dataset::~Dataset() {
 	cout << "Dataset deallocated" << endl;
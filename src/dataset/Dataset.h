@@ -51,10 +51,23 @@
 
 #include "../includes.h"
 #include "../utils/Utils.h"
+#include "../utils/Checkpoint.h"
+#include "../utils/Tensor.h"
 #include "../robot/IRobot.h"
+#include "DataStream.h"
 
 namespace oist {
 
+/**
+ * Samples of a primitive stored in a contiguous buffer. The time steps of a sample are stored
+ * row-major (one row of *nDof* joint values per time step), and the samples are stored consecutively
+ * */
+struct PrimitiveData {
+	int1DContainer nSteps;		// number of time steps per sample
+	vector<size_t> offset;		// position of the first value of each sample in the buffer
+	float1DContainer data;		// joint values [sample][time][dof]
+};
+
 /**
  * This class provides the functionalities for encoding and decoding robot and network data
  * */
@@ -81,9 +94,15 @@ private:
 	int nPrims; 	  		// Number of primitives
 	int seqLen;  			// Length of sequences
 	vector<int> nSamples;  	// Number of samples per primitive;
+	bool cache;				// flag for caching the encoded data-set on disk
 
-	void loadData(string _path, string _dataPrefix, int _nPrim, int1DContainer _nSamples, float4DContainer& _data);
-	void softmax(float2DContainer& _data, vectorXf2DContainer& _encData);
+	void loadData(string _path, string _dataPrefix, int _nPrim, const int1DContainer& _first, int1DContainer _nSamples, vector<PrimitiveData>& _data);
+	void loadFile(string _file, float1DContainer& _data, int& _nSteps);
+	void softmax(const float* _data, int _nT, Map<MatrixXf> _encData);
+	void softmax(PrimitiveData& _data, TensorXf& _encData);
+	bool getCacheKey(string& _key, string& _file);
+	bool loadCache(const string& _key, const string& _file, tensorXf1DContainer& _output);
+	void saveCache(const string& _key, const string& _file, tensorXf1DContainer& _output);
 
 public:
 
@@ -105,11 +124,71 @@ public:
 	 * */
 	Dataset(string path, string prefix, int1DContainer& samples, float dsoft, float sigma, Utils* ut, IRobot* robot);
 
+	/**
+	 * Enables caching the encoded data-set on disk. The cache file is stored in the data-set directory,
+	 * and it is reused while the data files (size and modification time), the encoding parameters
+	 * and the robot joint limits are unchanged
+	 * @param enable Flag indicating to use the cache
+	 * */
+	void setCache(bool enable);
+
 	/**
 	 * Computes softmax encoding
-	 * @param output Container to store encoded data
+	 * @param output Container to store the encoded data of each primitive
+	 * */
+	void encodeSoftmax(tensorXf1DContainer& output);
+
+	/**
+	 * Computes softmax encoding into a data-set stream, loading one primitive at a time, so that the
+	 * raw and encoded data-set are never entirely in memory. The stream is opened for reading afterwards
+	 * @param output Data-set stream, its flag selects the dense or the truncated encoding
+	 * @param tol Truncation tolerance (ignored for the dense encoding)
+	 * @param entropy Container to store the sum of the Y*log(Y) terms of each primitive
+	 * @return Ratio of units stored in the stream
+	 * */
+	float encodeSoftmax(DataStream& output, float tol, float1DContainer& entropy);
+
+	/**
+	 * Appends samples to the data-set, only the new sample files are loaded and encoded.
+	 * The sample files follow the naming of the data-set, and their length cannot exceed the current sequence length
+	 * @param samples New number of samples of each primitive. The container can be longer than the current number
+	 *     of primitives to append new primitives, and the existing primitives cannot lose samples
+	 * @param output Container to store the encoded new samples of each primitive (empty for the primitives without new samples)
+	 * @return Number of new primitives
+	 * */
+	int appendSoftmax(int1DContainer& samples, tensorXf1DContainer& output);
+
+	/**
+	 * Truncates a softmax encoding, keeping for each vector the band of units whose
+	 * activation is greater or equal than a tolerance
+	 * @param input Container with encoded data
+	 * @param tol Truncation tolerance
+	 * @param output Container to store the truncated data
+	 * @return Ratio of units stored in the truncated data
+	 * */
+	float truncateSoftmax(tensorXf1DContainer& input, float tol, sparseXf4DContainer& output);
+
+	/**
+	 * Computes the sum of the Y*log(Y) terms of the encoded primitives. These terms do not depend on the
+	 * network, hence they are added once to the reconstruction error instead of being evaluated per step
+	 * @param input Container with encoded data
+	 * @param output Container to store the sum of each primitive
+	 * */
+	void targetEntropy(tensorXf1DContainer& input, float1DContainer& output);
+
+	/**
+	 * Computes the sum of the Y*log(Y) terms of the truncated encoded primitives
+	 * @param input Container with truncated encoded data
+	 * @param output Container to store the sum of each primitive
+	 * */
+	void targetEntropy(sparseXf4DContainer& input, float1DContainer& output);
+
+	/**
+	 * Computes the sum of the Y*log(Y) terms of an encoded sequence
+	 * @param input Container with encoded data
+	 * @return Sum of the terms
 	 * */
-	void encodeSoftmax(vectorXf4DContainer& output);
+	float targetEntropy(vectorXf2DContainer& input);
 
 	/**
 	 * Computes softmax encoding
@@ -128,6 +207,14 @@ public:
 	 * */
 	float decodeSoftmax(ArrayXf& input, int dim);
 
+	/**
+	 * Gets the decoding grid of all the joints stacked in a single vector, i.e. the value in the joint space
+	 * represented by each encoding unit. The decoded value of a joint is the dot product between its softmax
+	 * encoding and its segment of the grid
+	 * @param output Output vector of dimension equal to the number of encoding units
+	 * */
+	void getDecodingGrid(VectorXf& output);
+
 	/**
 	 * Gets the number of neurons per dimension
 	 * @param output Output dimension container
@@ -140,6 +227,12 @@ public:
 	 * */
 	int getPrimLength();
 
+	/**
+	 * Sets the length of the sequences without encoding the data-set, e.g. for the models loaded for inference only
+	 * @param length Primitive length
+	 * */
+	void setPrimLength(int length);
+
 	/**
 	 * Gets the number of primitives in the data-set
 	 * @return number of primitives
@@ -156,10 +249,10 @@ public:
 	// #################################################################################################
 	inline float Dataset::decodeSoftmax(ArrayXf& input, int dim){
 
-		float1DContainer ref_ = ref[dim];
+		const float1DContainer& ref_ = ref[dim];
 
 		auto d = input.data();
-		float1DContainer::iterator r =ref_.begin();
+		float1DContainer::const_iterator r =ref_.begin();
 
 		float dec = 0.0;
 
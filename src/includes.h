@@ -59,6 +59,9 @@
 #include <exception>
 #include <chrono>
 #include <math.h>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
 #include <map>
 #include <type_traits>
 #include <Eigen/Dense>
@@ -74,6 +77,20 @@ typedef vector<vectorXf1DContainer> vectorXf2DContainer;
 typedef vector<vectorXf2DContainer> vectorXf3DContainer;
 typedef vector<vectorXf3DContainer> vectorXf4DContainer;
 
+/**
+ * Truncated representation of a softmax encoded vector: the units out of
+ * the band [first, first + values.size()) are zero
+ * */
+struct SparseVectorXf {
+	int first;
+	VectorXf values;
+};
+
+typedef vector<SparseVectorXf> sparseXf1DContainer;
+typedef vector<sparseXf1DContainer> sparseXf2DContainer;
+typedef vector<sparseXf2DContainer> sparseXf3DContainer;
+typedef vector<sparseXf3DContainer> sparseXf4DContainer;
+
 typedef vector<ArrayXf> arrayXf1DContainer;
 typedef vector<arrayXf1DContainer> arrayXf2DContainer;
 typedef vector<arrayXf2DContainer> arrayXf3DContainer;
@@ -51,9 +51,21 @@
 
 #include "../includes.h"
 #include "../context/IContext.h"
+#include "../utils/Checkpoint.h"
 
 namespace oist {
 
+/**
+ * Parameter groups of a layer, combined as a bit mask for freezing them during training
+ * */
+enum LayerGroup {
+	GROUP_H = 1,	// deterministic weights and bias (recurrent, latent, top and bottom connections)
+	GROUP_P = 2,	// prior weights and bias
+	GROUP_Q = 4,	// posterior weights and bias
+	GROUP_A = 8,	// adaptive variables of the primitives
+	GROUP_ALL = 15
+};
+
 /**
  * Abstract class (Interface) for layer implementations
  * */
@@ -80,6 +92,45 @@ public:
 	 * */
 	virtual void save(string path) = 0;
 
+	/**
+	 * Load the layer's parameters from a binary checkpoint
+	 * @param ckpt Checkpoint containing the layer's blocks
+	 * */
+	virtual void load(Checkpoint* ckpt) = 0;
+
+	/**
+	 * Save the layer's parameters to a binary checkpoint
+	 * @param ckpt Destination checkpoint
+	 * */
+	virtual void save(Checkpoint* ckpt) = 0;
+
+	/**
+	 * Export the parameters required for experiments, i.e. without gradients and Adam moments
+	 * @param ckpt Destination checkpoint
+	 * @param pIDs IDs of the primitives whose A variables are exported
+	 * */
+	virtual void exportInference(Checkpoint* ckpt, const int1DContainer& pIDs) = 0;
+
+	/**
+	 * Load the parameters exported by @ref exportInference, the training memory is kept until @ref releaseTraining
+	 * @param ckpt Checkpoint containing the layer's blocks
+	 * @param pIDs IDs of the primitives whose A variables were exported
+	 * */
+	virtual void loadInference(Checkpoint* ckpt, const int1DContainer& pIDs) = 0;
+
+	/**
+	 * Release the training memory, i.e. the gradients, the Adam moments and the A variables of the primitives
+	 * not exported. Afterwards the layer can only be used in experiment and analysis modes
+	 * @param pIDs IDs of the primitives whose A variables are kept
+	 * */
+	virtual void releaseTraining(const int1DContainer& pIDs) = 0;
+
+	/**
+	 * Appends the A variables of new primitives, the parameters and A variables of the existing primitives are kept
+	 * @param n Number of new primitives
+	 * */
+	virtual void addPrimitives(int n) = 0;
+
 	// ------------------------- context methods -------------------------
 
 	/**
@@ -122,13 +173,49 @@ public:
 	virtual void t_backward(int time, int pID) = 0;
 
 	/**
-	 * *[Training mode]* Computes ADAM optimization of parameters
+	 * *[Training mode]* Optimizes the parameters with the optimizer given at construction (see IOptimizer)
 	 * @param pID Primitive ID
-	 * @param alpha Adam optimization hyper parameter \f$\alpha\f$
-	 * @param beta1 Adam optimization hyper parameter \f$\beta_1\f$
-	 * @param beta2 Adam optimization hyper parameter \f$\beta_2\f$
+	 * @param alpha Optimization hyper parameter \f$\alpha\f$
+	 * @param beta1 Optimization hyper parameter \f$\beta_1\f$
+	 * @param beta2 Optimization hyper parameter \f$\beta_2\f$
+	 * */
+	virtual void t_optimize(int pID, float alpha, float beta1, float beta2) = 0;
+
+	/**
+	 * *[Training mode]* Enables the enrollment of a primitive: the weights are frozen, hence their gradients are
+	 * not accumulated nor optimized, and only the A variables of the primitive are optimized
+	 * @param pID ID of the enrolled primitive, a negative value restores the training of all the parameters
+	 * */
+	virtual void t_enroll(int pID) = 0;
+
+	/**
+	 * *[Training mode]* Freezes parameter groups: their gradients are not accumulated nor optimized (the state
+	 * gradients are still backpropagated), and their text files are not rewritten while unchanged
+	 * @param groups Bit mask of the frozen groups (see LayerGroup), zero restores the training of all the groups
+	 * */
+	virtual void t_freeze(int groups) = 0;
+
+	/**
+	 * *[Training mode]* Gets the gradients of the trained weights, e.g. for reducing them across workers
+	 * before @ref t_optimize. The frozen groups are not included
+	 * @param output Output container with a view of each gradient buffer
+	 * */
+	virtual void t_gradients(vector<Map<VectorXf> >& output) = 0;
+
+	/**
+	 * *[Training mode]* Gets the A variables of a primitive and their optimization moments, e.g. for gathering
+	 * them from the worker that trains the primitive before saving the model
+	 * @param pID Primitive ID
+	 * @param output Output container with a view of each buffer
+	 * */
+	virtual void t_variables(int pID, vector<Map<VectorXf> >& output) = 0;
+
+	/**
+	 * *[Training mode]* Restricts the optimization of the A variables to the primitives trained by this worker
+	 * of a distributed training
+	 * @param owned Flag per primitive, empty for all the primitives
 	 * */
-	virtual void t_optAdam(int pID, float alpha, float beta1, float beta2) = 0;
+	virtual void t_own(const bool1DContainer& owned) = 0;
 
 	// ------------------------- Analysis mode methods -------------------------
 
@@ -205,13 +292,13 @@ public:
 	virtual void e_overwriteParam() = 0;
 
 	/**
-	 * *[Experiment mode]* Computes ADAM optimization of parameters
+	 * *[Experiment mode]* Optimizes the parameters with the optimizer given at construction (see IOptimizer)
 	 * @param pID Primitive ID
-	 * @param alpha Adam optimization hyper parameter \f$\alpha\f$
-	 * @param beta1 Adam optimization hyper parameter \f$\beta_1\f$
-	 * @param beta2 Adam optimization hyper parameter \f$\beta_2\f$
+	 * @param alpha Optimization hyper parameter \f$\alpha\f$
+	 * @param beta1 Optimization hyper parameter \f$\beta_1\f$
+	 * @param beta2 Optimization hyper parameter \f$\beta_2\f$
 	 * */
-	virtual void e_optAdam(int pID, float alpha, float beta1, float beta2) = 0;
+	virtual void e_optimize(int pID, float alpha, float beta1, float beta2) = 0;
 
 	/**
 	 * *[Experiment mode]* Writes the current layer state to a float array.
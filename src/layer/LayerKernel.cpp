@@ -0,0 +1,170 @@
+/*<!--
+
+ BSD 3-Clause License
+
+  Copyright (c) 2020 Okinawa Institute of Science and Technology (OIST).
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above
+     copyright notice, this list of conditions and the following
+     disclaimer in the documentation and/or other materials provided
+     with the distribution.
+   * Neither the name of Willow Garage, Inc. nor the names of its
+     contributors may be used to endorse or promote products derived
+     from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+ Author: Hendry F. Chame <hendryfchame@gmail.com>
+
+ Publication:
+
+   Chame, H. F., Ahmadi, A., & Tani, J. (2020).
+   A hybrid human-neurorobotics approach to primary intersubjectivity via
+   active inference. Frontiers in psychology, 11.
+
+   Okinawa Institute of Science and Technology Graduate University (OIST)
+   Cognitive Neurorobotics Research Unit (CNRU)
+   1919-1, Tancha, Onna, Kunigami District, Okinawa 904-0495, Japan
+
+-->*/
+
+#include "LayerKernel.h"
+
+namespace oist {
+
+	/**
+	 * Instantiated layer shape
+	 * */
+	struct KernelShape {
+		int d_num;
+		int z_num;
+		int d_num_bottom;
+		int d_num_top;
+		GenerationKernel kernel;
+	};
+
+	// shapes of the production models (d=40,10 z=4,1), for the PV-RNN (bottom and top connections) and
+	// the PV-RNN Beta (top connections only) networks; other shapes use the dynamic implementation
+	static const KernelShape shapes[] = {
+		{40, 4,  0, 10, &generationStep<40, 4,  0, 10>},
+		{10, 1, 40,  0, &generationStep<10, 1, 40,  0>},
+		{10, 1,  0,  0, &generationStep<10, 1,  0,  0>},
+		{40, 4,  0,  0, &generationStep<40, 4,  0,  0>},
+	};
+
+	void ReducedWeights::clear(){
+		ReducedMatrix* matrices[] = {&Wdup, &Wdlp, &Wduq, &Wdlq, &Wdh, &Wzh, &Wdh_bottom, &Wdh_top};
+		for (ReducedMatrix* m : matrices)
+			m->clear();
+		in.resize(0);
+	}
+
+	size_t ReducedWeights::bytes() const{
+		return Wdup.bytes() + Wdlp.bytes() + Wduq.bytes() + Wdlq.bytes() + Wdh.bytes() + Wzh.bytes() + Wdh_bottom.bytes() + Wdh_top.bytes();
+	}
+
+	void SparseWeights::clear(){
+		PrunedMatrix* matrices[] = {&Wdup, &Wdlp, &Wduq, &Wdlq, &Wdh, &Wzh, &Wdh_bottom, &Wdh_top, &Wdup_t, &Wdlp_t, &Wduq_t, &Wdlq_t, &Wdh_t, &Wzh_t};
+		for (PrunedMatrix* m : matrices)
+			m->clear();
+		in.resize(0);
+	}
+
+	bool SparseWeights::hasSparse() const{
+		return Wdup.sparse() || Wdlp.sparse() || Wduq.sparse() || Wdlq.sparse() || Wdh.sparse() || Wzh.sparse() || Wdh_bottom.sparse() || Wdh_top.sparse();
+	}
+
+	size_t SparseWeights::bytes() const{
+		return Wdup.bytes() + Wdlp.bytes() + Wduq.bytes() + Wdlq.bytes() + Wdh.bytes() + Wzh.bytes() + Wdh_bottom.bytes() + Wdh_top.bytes();
+	}
+
+	/**
+	 * Generation step with inference copies of the weights (ReducedWeights or SparseWeights), whose matrices
+	 * compute the products
+	 * */
+	template <class Weights> static void generationStepCopies(GenerationStep& step, Weights& w){
+
+		int d_num = w.Wdh.rows;
+		int z_num = w.Wzh.cols;
+		const auto& Wdu = step.au != nullptr ? w.Wduq : w.Wdup;
+		const auto& Wdl = step.au != nullptr ? w.Wdlq : w.Wdlp;
+
+		Map<ArrayXf> up(step.u, z_num);
+		Map<ArrayXf> lp(step.l, z_num);
+		Map<ArrayXf> sp(step.s, z_num);
+		Map<ArrayXf> np(step.n, z_num);
+		Map<ArrayXf> zp(step.z, z_num);
+		Map<VectorXf> hp(step.h, d_num);
+		Map<VectorXf> dp(step.d, d_num);
+
+		up = Map<const ArrayXf>(step.Bu, z_num);
+		lp = Map<const ArrayXf>(step.Bl, z_num);
+		if (step.au != nullptr){
+			up += Map<const ArrayXf>(step.au, z_num);
+			lp += Map<const ArrayXf>(step.al, z_num);
+		}
+		Wdu.gemv(step.d, step.u);
+		Wdl.gemv(step.d, step.l);
+
+		step.ut->tanH<Map<ArrayXf> >(&up);
+		sp = lp.exp();
+		step.ut->randN<Map<ArrayXf> >(&np);
+		zp = up + sp*np;
+
+		w.in = Map<const VectorXf>(step.Bh, d_num);
+		w.Wdh.gemv(step.d, w.in.data());
+		w.Wzh.gemv(step.z, w.in.data());
+		if (step.d_bottom != nullptr)
+			w.Wdh_bottom.gemv(step.d_bottom, w.in.data());
+		if (step.d_top != nullptr)
+			w.Wdh_top.gemv(step.d_top, w.in.data());
+
+		hp = step.one_sub_eps*hp + step.eps*w.in;
+		dp = hp;
+		step.ut->tanH<Map<VectorXf> >(&dp);
+	}
+
+	void generationStepReduced(GenerationStep& step){
+		generationStepCopies(step, *step.reduced);
+	}
+
+	void generationStepSparse(GenerationStep& step){
+		generationStepCopies(step, *step.sparse);
+	}
+
+	GenerationKernel getGenerationKernel(int _d_num, int _z_num, int _d_num_bottom, int _d_num_top){
+
+		for (const KernelShape& s : shapes){
+			if (s.d_num == _d_num && s.z_num == _z_num && s.d_num_bottom == _d_num_bottom && s.d_num_top == _d_num_top)
+				return s.kernel;
+		}
+		return nullptr;
+	}
+
+	void holdStates(std::initializer_list<arrayXf1DContainer*> _states){
+
+		for (arrayXf1DContainer* state : _states){
+			ArrayXf last = state->back();
+			state->push_back(last);
+		}
+	}
+
+} /* namespace oist */
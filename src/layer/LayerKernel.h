@@ -0,0 +1,261 @@
+/*<!--
+
+ BSD 3-Clause License
+
+  Copyright (c) 2020 Okinawa Institute of Science and Technology (OIST).
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above
+     copyright notice, this list of conditions and the following
+     disclaimer in the documentation and/or other materials provided
+     with the distribution.
+   * Neither the name of Willow Garage, Inc. nor the names of its
+     contributors may be used to endorse or promote products derived
+     from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+ Author: Hendry F. Chame <hendryfchame@gmail.com>
+
+ Publication:
+
+   Chame, H. F., Ahmadi, A., & Tani, J. (2020).
+   A hybrid human-neurorobotics approach to primary intersubjectivity via
+   active inference. Frontiers in psychology, 11.
+
+   Okinawa Institute of Science and Technology Graduate University (OIST)
+   Cognitive Neurorobotics Research Unit (CNRU)
+   1919-1, Tancha, Onna, Kunigami District, Okinawa 904-0495, Japan
+
+-->*/
+
+#ifndef SRC_LAYER_LAYERKERNEL_H_
+#define SRC_LAYER_LAYERKERNEL_H_
+
+#include "../includes.h"
+#include "../utils/Utils.h"
+#include "../utils/Precision.h"
+#include "../utils/Pruning.h"
+
+// minimum size of the dense weights of a layer for using the sparse copies of its pruned weights, the smaller
+// layers fit in the cache and their dense steps are faster
+#define SPARSE_MIN_BYTES (1 << 20)
+
+namespace oist {
+
+/**
+ * Inference copies of the weights of a layer in reduced precision, used by @ref generationStepReduced
+ * */
+struct ReducedWeights {
+
+	ReducedMatrix Wdup;
+	ReducedMatrix Wdlp;
+	ReducedMatrix Wduq;
+	ReducedMatrix Wdlq;
+	ReducedMatrix Wdh;
+	ReducedMatrix Wzh;
+	ReducedMatrix Wdh_bottom;	// empty without bottom layer
+	ReducedMatrix Wdh_top;		// empty without top layer
+	VectorXf in;				// pre-allocated input of the latent state h
+
+	/**
+	 * Releases the copies
+	 * */
+	void clear();
+
+	/**
+	 * Gets the number of bytes of the copies
+	 * */
+	size_t bytes() const;
+};
+
+/**
+ * Inference copies of the pruned weights of a layer, used by @ref generationStepSparse. The copies of the
+ * transposed weights are used by the gradients of the post-diction
+ * */
+struct SparseWeights {
+
+	PrunedMatrix Wdup;
+	PrunedMatrix Wdlp;
+	PrunedMatrix Wduq;
+	PrunedMatrix Wdlq;
+	PrunedMatrix Wdh;
+	PrunedMatrix Wzh;
+	PrunedMatrix Wdh_bottom;	// empty without bottom layer
+	PrunedMatrix Wdh_top;		// empty without top layer
+	PrunedMatrix Wdup_t;		// transposes
+	PrunedMatrix Wdlp_t;
+	PrunedMatrix Wduq_t;
+	PrunedMatrix Wdlq_t;
+	PrunedMatrix Wdh_t;
+	PrunedMatrix Wzh_t;
+	VectorXf in;				// pre-allocated input of the latent state h
+
+	/**
+	 * Releases the copies
+	 * */
+	void clear();
+
+	/**
+	 * Flag indicating that a copy of the generation step is in the sparse format
+	 * */
+	bool hasSparse() const;
+
+	/**
+	 * Gets the number of bytes of the copies read by a generation step
+	 * */
+	size_t bytes() const;
+};
+
+/**
+ * Buffers of a generation step of a layer, i.e. a step of the latent state sampled from the prior (or from the
+ * posterior given the A variables). All the buffers are column-major and sized by the layer dimensions, the
+ * connections from the bottom and top layers are not used when their weights are null
+ * */
+struct GenerationStep {
+
+	const float* Wdu;			// mean weights and bias
+	const float* Bu;
+	const float* au;			// posterior A variable of the mean, null for the prior
+	const float* Wdl;			// log sigma weights and bias
+	const float* Bl;
+	const float* al;			// posterior A variable of the log sigma, null for the prior
+	const float* Wdh;
+	const float* Wzh;
+	const float* Bh;
+	const float* Wdh_bottom;
+	const float* d_bottom;
+	const float* Wdh_top;
+	const float* d_top;
+	float eps;
+	float one_sub_eps;
+	Utils* ut;
+	ReducedWeights* reduced;	// reduced precision weights, only read by @ref generationStepReduced
+	SparseWeights* sparse;		// pruned weights, only read by @ref generationStepSparse
+
+	float* h;					// input/output latent states
+	float* d;
+	float* u;					// output latent states
+	float* l;
+	float* s;
+	float* n;
+	float* z;
+};
+
+/**
+ * Function computing a generation step
+ * */
+typedef void (*GenerationKernel)(GenerationStep& step);
+
+/**
+ * Adds the contribution of a connection from another layer, nothing for a missing layer (N = 0)
+ * */
+template <int D, int N> struct LateralInput {
+	static void add(Matrix<float, D, 1>& h, float eps, const float* W, const float* d){
+		if (W != nullptr)
+			h += eps*(Map<const Matrix<float, D, N> >(W)*Map<const Matrix<float, N, 1> >(d));
+	}
+};
+
+template <int D> struct LateralInput<D, 0> {
+	static void add(Matrix<float, D, 1>&, float, const float*, const float*){}
+};
+
+/**
+ * Generation step specialized for the layer dimensions: the temporaries have a fixed size and are kept
+ * in the stack, and the products are unrolled by Eigen for small layers. The operations are the ones of
+ * the dynamic implementation in the same order, including the draws of the random generator
+ * @param step Step buffers
+ * */
+template <int D, int Z, int DB, int DT> void generationStep(GenerationStep& step){
+
+	typedef Matrix<float, D, 1> VectorD;
+	typedef Array<float, Z, 1> ArrayZ;
+
+	VectorD hp = Map<VectorD>(step.h);
+	VectorD dp = Map<VectorD>(step.d);
+
+	Map<ArrayZ> up(step.u);
+	Map<ArrayZ> lp(step.l);
+	Map<ArrayZ> sp(step.s);
+	Map<ArrayZ> np(step.n);
+	Map<ArrayZ> zp(step.z);
+
+	if (step.au != nullptr){
+		up = (Map<const Matrix<float, Z, D> >(step.Wdu)*dp + Map<const Matrix<float, Z, 1> >(step.Bu) + Map<const Matrix<float, Z, 1> >(step.au)).array();
+		lp = (Map<const Matrix<float, Z, D> >(step.Wdl)*dp + Map<const Matrix<float, Z, 1> >(step.Bl) + Map<const Matrix<float, Z, 1> >(step.al)).array();
+	}
+	else{
+		up = (Map<const Matrix<float, Z, D> >(step.Wdu)*dp + Map<const Matrix<float, Z, 1> >(step.Bu)).array();
+		lp = (Map<const Matrix<float, Z, D> >(step.Wdl)*dp + Map<const Matrix<float, Z, 1> >(step.Bl)).array();
+	}
+
+	step.ut->tanH<Map<ArrayZ> >(&up);
+	sp = lp.exp();
+	step.ut->randN<Map<ArrayZ> >(&np);
+	zp = up + sp*np;
+
+	hp = step.one_sub_eps*hp + step.eps*(Map<const Matrix<float, D, D> >(step.Wdh)*dp +
+			Map<const Matrix<float, D, Z> >(step.Wzh)*zp.matrix() + Map<const VectorD>(step.Bh));
+
+	LateralInput<D, DB>::add(hp, step.eps, step.Wdh_bottom, step.d_bottom);
+	LateralInput<D, DT>::add(hp, step.eps, step.Wdh_top, step.d_top);
+
+	dp = hp;
+	step.ut->tanH<VectorD>(&dp);
+
+	Map<VectorD>(step.h) = hp;
+	Map<VectorD>(step.d) = dp;
+}
+
+/**
+ * Generation step with the weights in reduced precision: the products are computed by the kernels of the
+ * selected instruction set and accumulated in single precision, the biases and states are kept in single precision
+ * @param step Step buffers, with the weights in step.reduced
+ * */
+void generationStepReduced(GenerationStep& step);
+
+/**
+ * Generation step with the pruned weights: the products of the sparse matrices skip their zero entries, the
+ * operations are otherwise the ones of the dynamic implementation
+ * @param step Step buffers, with the weights in step.sparse
+ * */
+void generationStepSparse(GenerationStep& step);
+
+/**
+ * Gets the generation step specialized for the layer dimensions, among the instantiated shapes
+ * @param d_num Number of d units
+ * @param z_num Number of z units
+ * @param d_num_bottom Number of d units of the bottom layer, zero if none
+ * @param d_num_top Number of d units of the top layer, zero if none
+ * @return Generation step, or null if the shape is not instantiated (the dynamic implementation is used)
+ * */
+GenerationKernel getGenerationKernel(int d_num, int z_num, int d_num_bottom, int d_num_top);
+
+/**
+ * Appends a copy of the last state of each container, for the time steps in which a layer holds its states
+ * (multi-timescale execution)
+ * @param states Containers of the states, in the order of the time steps
+ * */
+void holdStates(std::initializer_list<arrayXf1DContainer*> states);
+
+} /* namespace oist */
+
+#endif /* SRC_LAYER_LAYERKERNEL_H_ */
@@ -53,19 +53,132 @@
 #include "../context/ContextPvrnn.h"
 #include "../includes.h"
 #include "../utils/Utils.h"
+#include "../optimizer/IOptimizer.h"
 #include "../layer/ILayer.h"
+#include "../layer/LayerKernel.h"
 
 namespace oist {
 
+// recurrent (Wdh) and cross-layer (Wdh_bottom, Wdh_top) weights of the PV-RNN layers
+enum RecurrentWeight {RECURRENT, BOTTOM, TOP};
+
+/**
+ * Dense storage of the recurrent and cross-layer weights of LayerPvrnnOf, which defines their products,
+ * gradients and auxiliary copies. The products are written to output buffers held by the layer
+ * */
+class RecurrentDense {
+
+	MatrixXf W[3];				// parameters, indexed by RecurrentWeight
+	MatrixXf W_transpose[3];	// transposes of the cross-layer weights, used in the backward passes
+	MatrixXf g_W[3];
+	MatrixXf m_W[3];
+	MatrixXf v_W[3];
+
+public:
+
+	// the specialized generation steps are available for the dense weights only
+	static const bool factorized = false;
+
+	/**
+	 * Initializes a weight, its gradient and its optimizer state
+	 * @param ut Utils instance
+	 * @param weight Weight
+	 * @param rows Number of d units of the layer
+	 * @param cols Number of d units of the input (layer, bottom or top level)
+	 * @param optimizer Optimizer of the weights, null for the models loaded for inference only
+	 * */
+	void initialize(Utils* ut, RecurrentWeight weight, int rows, int cols, IOptimizer* optimizer){
+		W[weight] = ut->kaiming_uniform_initialization(rows, cols, Utils::nonlinearity::Linear);
+		IOptimizer::allocate<MatrixXf>(optimizer, &W[weight], &g_W[weight], &m_W[weight], &v_W[weight]);
+		if (weight != RECURRENT)
+			W_transpose[weight] = W[weight].transpose();
+	}
+
+	/**
+	 * Gets the buffers stored for a weight (parameters, gradients and Adam moments), with their names in the checkpoints
+	 * */
+	void getBuffers(RecurrentWeight weight, vector<string>& names, vector<MatrixXf*>& p, vector<MatrixXf*>& g, vector<MatrixXf*>& m, vector<MatrixXf*>& v){
+		static const string wNames[] = {"Wdh", "Wdh_bottom", "Wdh_top"};
+		names.push_back(wNames[weight]);	p.push_back(&W[weight]);	g.push_back(&g_W[weight]);	m.push_back(&m_W[weight]);	v.push_back(&v_W[weight]);
+	}
+
+	/**
+	 * Gets the weights pruned by magnitude
+	 * */
+	void getPrunable(RecurrentWeight weight, vector<MatrixXf*>& w){
+		w.push_back(&W[weight]);
+	}
+
+	/**
+	 * Computes the product W*x
+	 * @param out Output, pre-allocated by the layer
+	 * */
+	void product(RecurrentWeight weight, const VectorXf& x, VectorXf& out){
+		out.noalias() = W[weight]*x;
+	}
+
+	/**
+	 * Computes the product of the backward passes, i.e. W^T*g for the recurrent weights, and W*g for the
+	 * cross-layer ones, given the gradient of the adjacent layer
+	 * @param out Output, pre-allocated by the layer
+	 * */
+	void backward(RecurrentWeight weight, const VectorXf& g, VectorXf& out){
+		if (weight == RECURRENT)
+			out.noalias() = (g.transpose()*W[weight]).transpose();
+		else
+			out.noalias() = (g.transpose()*W_transpose[weight]).transpose();
+	}
+
+	/**
+	 * Accumulates the gradient g*x^T
+	 * */
+	void addGradient(RecurrentWeight weight, const VectorXf& g, const VectorXf& x){
+		g_W[weight].noalias() += g*x.transpose();
+	}
+
+	/**
+	 * Accumulates the product W*x of the generation steps in out, with the kernels of the selected instruction set
+	 * */
+	void gemv(RecurrentWeight weight, const float* x, float* out){
+		kernels->gemv(W[weight].data(), x, out, W[weight].rows(), W[weight].cols());
+	}
+
+	/**
+	 * Refreshes the transposes of the cross-layer weights after they change
+	 * */
+	void update(){
+		for (int r = BOTTOM; r <= TOP; r++){
+			if (W[r].size() > 0)
+				W_transpose[r] = W[r].transpose();
+		}
+	}
+
+	/**
+	 * Gets the weights read by the specialized, reduced precision and sparse generation steps
+	 * */
+	const MatrixXf& weights(RecurrentWeight weight) const{
+		return W[weight];
+	}
+};
+
 /**
- * This class implements a layer type PV-RNN
+ * This class implements a layer type PV-RNN, whose recurrent and cross-layer weights are stored by the
+ * given class (RecurrentDense, or RecurrentLowRank for the factorized weights, see LayerPvrnnLowRank.h)
  * */
-class LayerPvrnn : public ILayer{
+template <class Recurrent>
+class LayerPvrnnOf final : public ILayer{
 
 private:
 
 	ContextPvrnn* c;
 	Utils* ut;
+	IOptimizer* optimizer;		// weights and bias
+	IOptimizer* aOptimizer;		// A variables
+	GenerationKernel genKernel;	// specialized generation step, null for the dynamic implementation
+	ReducedWeights reduced;		// inference copies of the weights in reduced precision, set by setPrecision
+	SparseWeights sparse;		// inference copies of the pruned weights, set by setPrecision
+	float sparse_density;		// maximum density of the sparse copies, zero to disable them
+	Pruning pruning;			// masks of the pruned weights
 
 	int id;
 	int d_num;
@@ -83,16 +196,19 @@ private:
 	float one_sub_eps;
 	float w_div_z_sum;
 	int prim_num;
+	int enroll_id; // primitive being enrolled, the weights are frozen (-1 if disabled)
+	int frozen; // bit mask of the frozen parameter groups
+	string w_synced; // path of the text files holding the current weights (empty if outdated)
+	string a_synced; // path of the text files holding the current A variables (empty if outdated)
+	bool1DContainer owned; // primitives whose A variables are optimized by this worker (all if empty)
 	int prim_len;
 	float w;
 	int gen_time_thres;
 
 	// --- Parameters
 
-	MatrixXf Wdh;
+	Recurrent rec;	// recurrent and cross-layer weights, with their gradients and optimizer state
 	MatrixXf Wzh;
-	MatrixXf Wdh_bottom;
-	MatrixXf Wdh_top;
 	MatrixXf Wdup;
 	MatrixXf Wdlp;
 	MatrixXf Wduq;
@@ -106,8 +222,7 @@ private:
 	vectorXf2DContainer t_al;
 
 	// auxiliary variables
-	MatrixXf Wdh_bottom_transpose;
-	MatrixXf Wdh_top_transpose;
+	VectorXf h_in;	// pre-allocated products of the recurrent and cross-layer weights
 
 
 	//ArrayXf dp_gen; // declared in the context class
@@ -119,10 +234,7 @@ private:
 	ArrayXf zp_gen;
 
 	// --- Gradients
-	MatrixXf g_Wdh;
 	MatrixXf g_Wzh;
-	MatrixXf g_Wdh_bottom;
-	MatrixXf g_Wdh_top;
 	MatrixXf g_Wdup;
 	MatrixXf g_Wdlp;
 	MatrixXf g_Wduq;
@@ -141,12 +253,9 @@ private:
 	RowVectorXf g_up_next_transpose;
 	RowVectorXf g_lp_next_transpose;
 
-	// --- ADAM optimization
+	// --- optimizer state (see IOptimizer)
 
-	MatrixXf m_Wdh;
 	MatrixXf m_Wzh;
-	MatrixXf m_Wdh_bottom;
-	MatrixXf m_Wdh_top;
 	MatrixXf m_Wdup;
 	MatrixXf m_Wdlp;
 	MatrixXf m_Wduq;
@@ -160,10 +269,7 @@ private:
 	vectorXf1DContainer m_au;
 	vectorXf1DContainer m_al;
 
-	MatrixXf v_Wdh;
 	MatrixXf v_Wzh;
-	MatrixXf v_Wdh_bottom;
-	MatrixXf v_Wdh_top;
 	MatrixXf v_Wdup;
 	MatrixXf v_Wdlp;
 	MatrixXf v_Wduq;
@@ -307,9 +413,41 @@ private:
 
 
 
+	/**
+	 * Gets the recurrent and cross-layer weights of the layer
+	 * */
+	vector<RecurrentWeight> getRecurrentWeights();
+
 	float get_kld(ArrayXf& _mp, ArrayXf& _sp, ArrayXf& _mq, ArrayXf& _sq);
 
+	void getParamBuffers(vector<string>& w_names, vector<MatrixXf*>& w_p, vector<MatrixXf*>& w_m, vector<MatrixXf*>& w_v,
+			vector<string>& b_names, vector<VectorXf*>& b_p, vector<VectorXf*>& b_m, vector<VectorXf*>& b_v);
+
 	void free_memory();
+	void free_training();
+	void allocPrimitives(int n);
+	bool isFrozen(int group);
+
+	/**
+	 * Computes a step of the latent states with the specialized kernel, in place in the given buffers
+	 * @param au A variable of the mean, the step is sampled from the prior if null, else from the posterior
+	 * @param al A variable of the log sigma
+	 * @param d_bottom State d of the bottom layer, null if none
+	 * @param d_top State d of the top layer, null if none
+	 * */
+	void generationStep(const float* au, const float* al, const float* d_bottom, const float* d_top,
+			float* h, float* d, float* u, float* l, float* s, float* n, float* z);
+
+	/**
+	 * Updates the latent state h of the dynamic generation step, the gate products are accumulated
+	 * in a single buffer by the kernels of the selected instruction set
+	 * @param d Previous state d
+	 * @param z Sampled state z
+	 * @param d_bottom State d of the bottom layer, null if none
+	 * @param d_top State d of the top layer, null if none
+	 * @param h Latent state h, updated in place
+	 * */
+	void generationInput(const float* d, const float* z, const float* d_bottom, const float* d_top, VectorXf& h);
 
 public:
 
@@ -327,16 +465,20 @@ public:
 	 * @param prim_num Number of primitives
 	 * @param prim_len Length of primitives
 	 * @param w Meta-parameter w
+	 * @param optimizer Optimizer of the weights and bias
+	 * @param aOptimizer Optimizer of the A variables
+	 * @param rec Storage of the recurrent and cross-layer weights, e.g. with the rank of the factorized weights
 	 * */
-	LayerPvrnn(int id, int d_num, int d_num_bottom, int d_num_top, int z_num, int z_sum, int tau, int tau_bottom, int tau_top, int prim_num, int prim_len, float w);
+	LayerPvrnnOf(int id, int d_num, int d_num_bottom, int d_num_top, int z_num, int z_sum, int tau, int tau_bottom, int tau_top, int prim_num, int prim_len, float w, IOptimizer* optimizer, IOptimizer* aOptimizer, const Recurrent& rec = Recurrent());
 
 	/**
 	 * Destructor
 	 * */
-	~LayerPvrnn();
+	virtual ~LayerPvrnnOf();
 
 
 	int getStateDim();
+	void addPrimitives(int);
 
     // ------------------------- context methods
 
@@ -349,9 +491,32 @@ public:
 	void t_forward(int, int);
 	void t_initBackward();
 	void t_backward(int, int);
-	void t_optAdam(int, float, float, float);
+	void t_optimize(int, float, float, float);
+	void t_enroll(int);
+	void t_freeze(int);
+
+	/**
+	 * Gets the weight matrices pruned by magnitude, i.e. the ones of the products (the biases are kept)
+	 * @param w Output container
+	 * */
+	void getPrunable(vector<MatrixXf*>& w);
+
+	/**
+	 * Prunes the weights by magnitude, the pruned entries are kept at zero by the following optimization steps
+	 * @param sparsity Fraction of pruned entries of each matrix, used when the threshold is negative
+	 * @param threshold Magnitude threshold shared with the other layers, or negative
+	 * */
+	void t_prune(float sparsity, float threshold);
+	void t_gradients(vector<Map<VectorXf> >&);
+	void t_variables(int, vector<Map<VectorXf> >&);
+	void t_own(const bool1DContainer&);
 	void load(string);
 	void save(string);
+	void load(Checkpoint*);
+	void save(Checkpoint*);
+	void exportInference(Checkpoint*, const int1DContainer&);
+	void loadInference(Checkpoint*, const int1DContainer&);
+	void releaseTraining(const int1DContainer&);
 
 	// ------------------------- Analysis methods
 
@@ -362,6 +527,26 @@ public:
 	// ------------------------ Experiment methods
 
 	void e_enable(int, int, float, int, bool, bool);
+
+	/**
+	 * Sets the storage precision of the weights of the generation steps, the copies are made from the current weights
+	 * @param precision Precision, the single precision weights are used directly with PRECISION_FP32, or copied
+	 * in the sparse format when pruned (see @ref setSparseDensity)
+	 * */
+	void setPrecision(Precision precision);
+
+	/**
+	 * Sets the maximum density of the pruned weights copied in the sparse format by @ref setPrecision, the
+	 * sparse copies are also used by the post-diction gradients. The layers smaller than SPARSE_MIN_BYTES keep
+	 * the dense weights
+	 * @param density Maximum fraction of non-zero entries (0.4 by default), zero to disable the sparse copies
+	 * */
+	void setSparseDensity(float density);
+
+	/**
+	 * Gets the number of bytes of the weights read by the generation steps, in the current precision
+	 * */
+	size_t getGenerationBytes();
 	void e_generate();
 	void e_initForward();
 	void e_forward();
@@ -369,7 +554,7 @@ public:
 	void e_backward(int);
 	void e_copyParam();
 	void e_overwriteParam();
-	void e_optAdam(int, float, float, float);
+	void e_optimize(int, float, float, float);
 	float* e_getState(float*);
 	void e_save(string);
 
@@ -380,6 +565,8 @@ public:
 
 };
 
+typedef LayerPvrnnOf<RecurrentDense> LayerPvrnn;
+
 } /* namespace oist */
 
 #endif /* SRC_LAYER_PVRNN_H_ */
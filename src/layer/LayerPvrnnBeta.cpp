@@ -51,9 +51,11 @@
 
 namespace oist {
 
-LayerPvrnnBeta::LayerPvrnnBeta(int _id, int _d_num, int _d_num_top, int _z_num, int _z_sum, int _tau, int _tau_top, int _prim_num, int _prim_len, float _w1, float _w){
+LayerPvrnnBeta::LayerPvrnnBeta(int _id, int _d_num, int _d_num_top, int _z_num, int _z_sum, int _tau, int _tau_top, int _prim_num, int _prim_len, float _w1, float _w, IOptimizer* _optimizer, IOptimizer* _aOptimizer){
 
 		ut = Utils::getInstance();
+		optimizer = _optimizer;
+		aOptimizer = _aOptimizer;
     	id = _id;
 		d_num = _d_num;
 		z_num = _z_num;
@@ -83,90 +85,48 @@ LayerPvrnnBeta::LayerPvrnnBeta(int _id, int _d_num, int _d_num_top, int _z_num,
 
 		// initializing weight matrixes
 		Wdh = ut->kaiming_uniform_initialization(d_num,d_num, Utils::nonlinearity::Linear);
-		g_Wdh = MatrixXf::Zero(d_num,d_num);
-		m_Wdh = MatrixXf::Zero(d_num,d_num);
-		v_Wdh = MatrixXf::Zero(d_num,d_num);
+		IOptimizer::allocate<MatrixXf>(optimizer, &Wdh, &g_Wdh, &m_Wdh, &v_Wdh);
 
 		Bh  = ut->kaiming_uniform_initialization(d_num);
-		g_Bh  = VectorXf::Zero(d_num);
-		m_Bh = VectorXf::Zero(d_num);
-		v_Bh = VectorXf::Zero(d_num);
+		IOptimizer::allocate<VectorXf>(optimizer, &Bh, &g_Bh, &m_Bh, &v_Bh);
 
 		Wzh = ut->kaiming_uniform_initialization(d_num,z_num, Utils::nonlinearity::Linear);
-		g_Wzh = MatrixXf::Zero(d_num,z_num);
-		m_Wzh = MatrixXf::Zero(d_num,z_num);
-		v_Wzh = MatrixXf::Zero(d_num,z_num);
+		IOptimizer::allocate<MatrixXf>(optimizer, &Wzh, &g_Wzh, &m_Wzh, &v_Wzh);
 
 		if (!top){
 			Wdh_top = ut->kaiming_uniform_initialization(d_num,d_num_top, Utils::nonlinearity::Linear);
-			g_Wdh_top = MatrixXf::Zero(d_num,d_num_top);
-			m_Wdh_top = MatrixXf::Zero(d_num,d_num_top);
-			v_Wdh_top = MatrixXf::Zero(d_num,d_num_top);
+			IOptimizer::allocate<MatrixXf>(optimizer, &Wdh_top, &g_Wdh_top, &m_Wdh_top, &v_Wdh_top);
 			c->dp_top = VectorXf::Zero(d_num_top);
 			c->dq_top = VectorXf::Zero(d_num_top);
 			Wdh_top_transpose = Wdh_top.transpose();
 		}
 
 		Wdup = ut->kaiming_uniform_initialization(z_num,d_num, Utils::nonlinearity::Tanh);
-		g_Wdup = MatrixXf::Zero(z_num,d_num);
-		m_Wdup = MatrixXf::Zero(z_num,d_num);
-		v_Wdup = MatrixXf::Zero(z_num,d_num);
+		IOptimizer::allocate<MatrixXf>(optimizer, &Wdup, &g_Wdup, &m_Wdup, &v_Wdup);
 
 		Wdlp = ut->kaiming_uniform_initialization(z_num,d_num, Utils::nonlinearity::Linear);
-		g_Wdlp = MatrixXf::Zero(z_num,d_num);
-		m_Wdlp = MatrixXf::Zero(z_num,d_num);
-		v_Wdlp = MatrixXf::Zero(z_num,d_num);
+		IOptimizer::allocate<MatrixXf>(optimizer, &Wdlp, &g_Wdlp, &m_Wdlp, &v_Wdlp);
 
 		Wduq = ut->kaiming_uniform_initialization(z_num,d_num, Utils::nonlinearity::Tanh);
-		g_Wduq = MatrixXf::Zero(z_num,d_num);
-		m_Wduq = MatrixXf::Zero(z_num,d_num);
-		v_Wduq = MatrixXf::Zero(z_num,d_num);
+		IOptimizer::allocate<MatrixXf>(optimizer, &Wduq, &g_Wduq, &m_Wduq, &v_Wduq);
 
 		Wdlq = ut->kaiming_uniform_initialization(z_num,d_num, Utils::nonlinearity::Linear);
-		g_Wdlq = MatrixXf::Zero(z_num,d_num);
-		m_Wdlq = MatrixXf::Zero(z_num,d_num);
-		v_Wdlq = MatrixXf::Zero(z_num,d_num);
+		IOptimizer::allocate<MatrixXf>(optimizer, &Wdlq, &g_Wdlq, &m_Wdlq, &v_Wdlq);
 
 		Bup = ut->kaiming_uniform_initialization(z_num);
-		g_Bup = VectorXf::Zero(z_num);
-		m_Bup = VectorXf::Zero(z_num);
-		v_Bup = VectorXf::Zero(z_num);
+		IOptimizer::allocate<VectorXf>(optimizer, &Bup, &g_Bup, &m_Bup, &v_Bup);
 
 		Blp = ut->kaiming_uniform_initialization(z_num);
-		g_Blp = VectorXf::Zero(z_num);
-		m_Blp = VectorXf::Zero(z_num);
-		v_Blp = VectorXf::Zero(z_num);
+		IOptimizer::allocate<VectorXf>(optimizer, &Blp, &g_Blp, &m_Blp, &v_Blp);
 
 		Buq = ut->kaiming_uniform_initialization(z_num);
-		g_Buq = VectorXf::Zero(z_num);
-		m_Buq = VectorXf::Zero(z_num);
-		v_Buq = VectorXf::Zero(z_num);
+		IOptimizer::allocate<VectorXf>(optimizer, &Buq, &g_Buq, &m_Buq, &v_Buq);
 
 		Blq = ut->kaiming_uniform_initialization(z_num);
-		g_Blq = VectorXf::Zero(z_num);
-		m_Blq = VectorXf::Zero(z_num);
-		v_Blq = VectorXf::Zero(z_num);
-
-
-		for (int i = 0; i < _prim_num ; i++){
-
-			vectorXf1DContainer au, g_au, m_au, v_au, al, g_al, m_al, v_al;
-
-			for (int j = 0; j < _prim_len ; j++){
-				au.push_back(ut->kaiming_uniform_initialization(z_num));
-				g_au.push_back(VectorXf::Zero(z_num));
-				m_au.push_back(VectorXf::Zero(z_num));
-				v_au.push_back(VectorXf::Zero(z_num));
-				al.push_back(ut->kaiming_uniform_initialization(z_num));
-				g_al.push_back(VectorXf::Zero(z_num));
-				m_al.push_back(VectorXf::Zero(z_num));
-				v_al.push_back(VectorXf::Zero(z_num));
-
-			}
-			t_au.push_back(au); t_g_au.push_back(g_au); t_m_au.push_back(m_au); t_v_au.push_back(v_au);
-			t_al.push_back(al); t_g_al.push_back(g_al); t_m_al.push_back(m_al); t_v_al.push_back(v_al);
-		}
+		IOptimizer::allocate<VectorXf>(optimizer, &Blq, &g_Blq, &m_Blq, &v_Blq);
 
+		enroll_id = -1;
+		frozen = 0;
 		gen_time_thres = 3;
 		e_window_size = 0;
 		e_gen_time = 0;
@@ -192,7 +152,38 @@ LayerPvrnnBeta::LayerPvrnnBeta(int _id, int _d_num, int _d_num_top, int _z_num,
 		e_store_gen = false;
 		e_store_inference = false;
 
-		for (int p = 0; p < prim_num; p++){
+		allocPrimitives(prim_num);
+
+		// generation step specialized for the layer shape, if instantiated
+		genKernel = getGenerationKernel(d_num, z_num, 0, d_num_top);
+		sparse_density = 0.0;
+	}
+
+	void LayerPvrnnBeta::allocPrimitives(int _n){
+
+		for (int i = 0; i < _n ; i++){
+
+			vectorXf1DContainer au, g_au, m_au, v_au, al, g_al, m_al, v_al;
+
+			// the models loaded for inference only get the A variables of the exported primitives from the file
+			for (int j = 0; j < prim_len && optimizer != nullptr; j++){
+				au.push_back(ut->kaiming_uniform_initialization(z_num));
+				g_au.push_back(VectorXf::Zero(z_num));
+				m_au.push_back(VectorXf());
+				v_au.push_back(VectorXf());
+				aOptimizer->allocate<VectorXf>(&au.back(), &m_au.back(), &v_au.back());
+				al.push_back(ut->kaiming_uniform_initialization(z_num));
+				g_al.push_back(VectorXf::Zero(z_num));
+				m_al.push_back(VectorXf());
+				v_al.push_back(VectorXf());
+				aOptimizer->allocate<VectorXf>(&al.back(), &m_al.back(), &v_al.back());
+
+			}
+			t_au.push_back(au); t_g_au.push_back(g_au); t_m_au.push_back(m_au); t_v_au.push_back(v_au);
+			t_al.push_back(al); t_g_al.push_back(g_al); t_m_al.push_back(m_al); t_v_al.push_back(v_al);
+		}
+
+		for (int p = 0; p < _n; p++){
 
 			arrayXf1DContainer hp, dp, up, lp, sp, np, zp;
 
@@ -237,6 +228,96 @@ LayerPvrnnBeta::LayerPvrnnBeta(int _id, int _d_num, int _d_num_top, int _z_num,
 
 	}
 
+	void LayerPvrnnBeta::addPrimitives(int _n){
+
+		allocPrimitives(_n);
+		prim_num += _n;
+		a_synced.clear();
+	}
+
+	void LayerPvrnnBeta::t_enroll(int _prim_id){
+		enroll_id = _prim_id;
+	}
+
+	void LayerPvrnnBeta::t_freeze(int _groups){
+		frozen = _groups;
+	}
+
+	void LayerPvrnnBeta::getPrunable(vector<MatrixXf*>& _w){
+		_w.push_back(&Wdh);
+		_w.push_back(&Wzh);
+		if (!top)
+			_w.push_back(&Wdh_top);
+		_w.push_back(&Wdup);
+		_w.push_back(&Wdlp);
+		_w.push_back(&Wduq);
+		_w.push_back(&Wdlq);
+	}
+
+	void LayerPvrnnBeta::t_prune(float _sparsity, float _threshold){
+		vector<MatrixXf*> w;
+		getPrunable(w);
+		pruning.prune(w, _sparsity, _threshold);
+		if (!top)
+			Wdh_top_transpose = Wdh_top.transpose();
+		w_synced.clear();
+	}
+
+	static void addView(vector<Map<VectorXf> >& _output, MatrixXf& _x){
+		_output.push_back(Map<VectorXf>(_x.data(), _x.size()));
+	}
+
+	static void addView(vector<Map<VectorXf> >& _output, VectorXf& _x){
+		_output.push_back(Map<VectorXf>(_x.data(), _x.size()));
+	}
+
+	void LayerPvrnnBeta::t_gradients(vector<Map<VectorXf> >& _output){
+
+		// the same groups as in t_optimize, in a fixed order
+		if (!isFrozen(GROUP_H)){
+			addView(_output, g_Wdh);
+			addView(_output, g_Wzh);
+			addView(_output, g_Bh);
+			if (!top)
+				addView(_output, g_Wdh_top);
+		}
+		if (!isFrozen(GROUP_P)){
+			addView(_output, g_Wdup);
+			addView(_output, g_Wdlp);
+			addView(_output, g_Bup);
+			addView(_output, g_Blp);
+		}
+		if (!isFrozen(GROUP_Q)){
+			addView(_output, g_Wduq);
+			addView(_output, g_Wdlq);
+			addView(_output, g_Buq);
+			addView(_output, g_Blq);
+		}
+	}
+
+	void LayerPvrnnBeta::t_variables(int _prim_id, vector<Map<VectorXf> >& _output){
+
+		// the caller may overwrite the variables
+		a_synced.clear();
+		for (int t = 0; t < prim_len; t++){
+			addView(_output, t_au[_prim_id][t]);
+			addView(_output, t_m_au[_prim_id][t]);
+			addView(_output, t_v_au[_prim_id][t]);
+			addView(_output, t_al[_prim_id][t]);
+			addView(_output, t_m_al[_prim_id][t]);
+			addView(_output, t_v_al[_prim_id][t]);
+		}
+	}
+
+	void LayerPvrnnBeta::t_own(const bool1DContainer& _owned){
+		owned = _owned;
+	}
+
+	bool LayerPvrnnBeta::isFrozen(int _group){
+		// all the weights are frozen while enrolling a primitive
+		return (frozen & _group) || (enroll_id >= 0 && _group != GROUP_A);
+	}
+
 	int LayerPvrnnBeta::getStateDim(){
 		return stateDim;
 	}
@@ -311,10 +392,7 @@ LayerPvrnnBeta::LayerPvrnnBeta(int _id, int _d_num, int _d_num_top, int _z_num,
 		 ut->randN<ArrayXf>(&np);
 		 VectorXf zp = up + sp*np;
 
-		 hp = one_sub_eps*hp + eps*(Wdh*dp + Wzh*zp + Bh);
-
-		 if (!top)
-			 hp += eps*(Wdh_top*c->dp_top);
+		 generationInput(dp.data(), zp.data(), nullptr, (top ? nullptr : c->dp_top.data()), hp);
 
 		 dp = hp;
 		 ut->tanH<VectorXf>(&dp);
@@ -491,31 +569,40 @@ LayerPvrnnBeta::LayerPvrnnBeta(int _id, int _d_num, int _d_num_top, int _z_num,
 		 g_uq = (g_z + wFactor*((uq - up)/sp_pow_2));
 		 g_lq = g_z*sq*nq + wFactor*(-1.0 + (sq_pow_2/sp_pow_2));
 
-		 // Parameter gradients
+		 VectorXf g_uqtanh = g_uq.array().transpose()*(1.0 - uq_pow_2);
+
+		 // Parameter gradients, skipped for the frozen groups
 
-		 g_Wdh += eps*g_h*dq_prev_transpose;
-		 g_Bh += eps*g_h;
+		 if (!isFrozen(GROUP_H)){
 
+			 g_Wdh += eps*g_h*dq_prev_transpose;
+			 g_Bh += eps*g_h;
 
-		 if (!top){
-			 g_Wdh_top += eps * g_h * c->dq_top.transpose();
+
+			 if (!top){
+				 g_Wdh_top += eps * g_h * c->dq_top.transpose();
+			 }
+
+			 g_Wzh += eps* g_h* zq;
 		 }
 
-		 g_Wzh += eps* g_h* zq;
+		 if (!isFrozen(GROUP_Q)){
 
-		 VectorXf g_uqtanh = g_uq.array().transpose()*(1.0 - uq_pow_2);
+			 g_Wduq += g_uqtanh*dq_prev_transpose;
+			 g_Buq += g_uqtanh;
+			 g_Wdlq += g_lq.transpose()*dq_prev_transpose;
+			 g_Blq += g_lq;
+		 }
 
-		 g_Wduq += g_uqtanh*dq_prev_transpose;
-		 g_Buq += g_uqtanh;
-		 g_Wdlq += g_lq.transpose()*dq_prev_transpose;
-		 g_Blq += g_lq;
+		 if (!isFrozen(GROUP_P)){
 
-		 VectorXf g_uptanh = g_up.array().transpose()*(1.0 - up_pow_2);
+			 VectorXf g_uptanh = g_up.array().transpose()*(1.0 - up_pow_2);
 
-		 g_Wdup += g_uptanh*dp_prev_transpose;
-		 g_Bup += g_uptanh;
-		 g_Wdlp += g_lp.transpose()*dp_prev_transpose;
-		 g_Blp += g_lp;
+			 g_Wdup += g_uptanh*dp_prev_transpose;
+			 g_Bup += g_uptanh;
+			 g_Wdlp += g_lp.transpose()*dp_prev_transpose;
+			 g_Blp += g_lp;
+		 }
 
 		 t_g_au[_prim_id][_time-1] = g_uqtanh;
 		 t_g_al[_prim_id][_time-1] = g_lq;
@@ -528,46 +615,80 @@ LayerPvrnnBeta::LayerPvrnnBeta(int _id, int _d_num, int _d_num_top, int _z_num,
 
 	 }
 
-	 void LayerPvrnnBeta::t_optAdam(int _epoch, float _alpha, float _beta1, float _beta2){
+	 void LayerPvrnnBeta::t_optimize(int _epoch, float _alpha, float _beta1, float _beta2){
+
+		// updating the unfrozen groups, the transposes are only refreshed when their weights change
+		if (!isFrozen(GROUP_H)){
+
+			optimizer->step<MatrixXf>(&Wdh, &g_Wdh, &m_Wdh, &v_Wdh, _epoch, _alpha, _beta1, _beta2 );
+			optimizer->step<MatrixXf>(&Wzh, &g_Wzh, &m_Wzh, &v_Wzh, _epoch, _alpha, _beta1, _beta2 );
+			optimizer->step<VectorXf>(&Bh,   &g_Bh,   &m_Bh,   &v_Bh,   _epoch, _alpha, _beta1, _beta2 );
 
-		ut->adam<MatrixXf>(&Wdh, &g_Wdh, &m_Wdh, &v_Wdh, _epoch, _alpha, _beta1, _beta2 );
-		ut->adam<MatrixXf>(&Wzh, &g_Wzh, &m_Wzh, &v_Wzh, _epoch, _alpha, _beta1, _beta2 );
+			// Clearing parameter gradients
 
-		ut->adam<MatrixXf>(&Wdup, &g_Wdup, &m_Wdup, &v_Wdup, _epoch, _alpha, _beta1, _beta2 );
-		ut->adam<MatrixXf>(&Wdlp, &g_Wdlp, &m_Wdlp, &v_Wdlp, _epoch, _alpha, _beta1, _beta2 );
-		ut->adam<MatrixXf>(&Wduq, &g_Wduq, &m_Wduq, &v_Wduq, _epoch, _alpha, _beta1, _beta2 );
-		ut->adam<MatrixXf>(&Wdlq, &g_Wdlq, &m_Wdlq, &v_Wdlq, _epoch, _alpha, _beta1, _beta2 );
+			ut->zero<MatrixXf>(&g_Wdh);
+			ut->zero<MatrixXf>(&g_Wzh);
+			ut->zero<VectorXf>(&g_Bh);
 
-		ut->adam<VectorXf>(&Bh,   &g_Bh,   &m_Bh,   &v_Bh,   _epoch, _alpha, _beta1, _beta2 );
-		ut->adam<VectorXf>(&Bup, &g_Bup, &m_Bup, &v_Bup, _epoch, _alpha, _beta1, _beta2 );
-		ut->adam<VectorXf>(&Blp, &g_Blp, &m_Blp, &v_Blp, _epoch, _alpha, _beta1, _beta2 );
-		ut->adam<VectorXf>(&Buq, &g_Buq, &m_Buq, &v_Buq, _epoch, _alpha, _beta1, _beta2 );
-		ut->adam<VectorXf>(&Blq, &g_Blq, &m_Blq, &v_Blq, _epoch, _alpha, _beta1, _beta2 );
+			if (! top){
+				optimizer->step<MatrixXf>(&Wdh_top,  &g_Wdh_top,  &m_Wdh_top,  &v_Wdh_top,  _epoch, _alpha, _beta1, _beta2 );
+				ut->zero<MatrixXf>(&g_Wdh_top);
+				Wdh_top_transpose = Wdh_top.transpose();
+			}
+			w_synced.clear();
+		}
 
-		// Clearing parameter gradients
+		if (!isFrozen(GROUP_P)){
 
-		ut->zero<MatrixXf>(&g_Wdh);
-		ut->zero<MatrixXf>(&g_Wzh);
+			optimizer->step<MatrixXf>(&Wdup, &g_Wdup, &m_Wdup, &v_Wdup, _epoch, _alpha, _beta1, _beta2 );
+			optimizer->step<MatrixXf>(&Wdlp, &g_Wdlp, &m_Wdlp, &v_Wdlp, _epoch, _alpha, _beta1, _beta2 );
+			optimizer->step<VectorXf>(&Bup, &g_Bup, &m_Bup, &v_Bup, _epoch, _alpha, _beta1, _beta2 );
+			optimizer->step<VectorXf>(&Blp, &g_Blp, &m_Blp, &v_Blp, _epoch, _alpha, _beta1, _beta2 );
 
-		ut->zero<MatrixXf>(&g_Wdup);
-		ut->zero<MatrixXf>(&g_Wdlp);
-		ut->zero<MatrixXf>(&g_Wduq);
-		ut->zero<MatrixXf>(&g_Wdlq);
+			ut->zero<MatrixXf>(&g_Wdup);
+			ut->zero<MatrixXf>(&g_Wdlp);
+			ut->zero<VectorXf>(&g_Bup);
+			ut->zero<VectorXf>(&g_Blp);
+			w_synced.clear();
+		}
 
-		ut->zero<VectorXf>(&g_Bh);
-		ut->zero<VectorXf>(&g_Bup);
-		ut->zero<VectorXf>(&g_Blp);
-		ut->zero<VectorXf>(&g_Buq);
-		ut->zero<VectorXf>(&g_Blq);
+		if (!isFrozen(GROUP_Q)){
 
+			optimizer->step<MatrixXf>(&Wduq, &g_Wduq, &m_Wduq, &v_Wduq, _epoch, _alpha, _beta1, _beta2 );
+			optimizer->step<MatrixXf>(&Wdlq, &g_Wdlq, &m_Wdlq, &v_Wdlq, _epoch, _alpha, _beta1, _beta2 );
+			optimizer->step<VectorXf>(&Buq, &g_Buq, &m_Buq, &v_Buq, _epoch, _alpha, _beta1, _beta2 );
+			optimizer->step<VectorXf>(&Blq, &g_Blq, &m_Blq, &v_Blq, _epoch, _alpha, _beta1, _beta2 );
 
-		if (! top){
-			ut->adam<MatrixXf>(&Wdh_top,  &g_Wdh_top,  &m_Wdh_top,  &v_Wdh_top,  _epoch, _alpha, _beta1, _beta2 );
-			ut->zero<MatrixXf>(&g_Wdh_top);
-			Wdh_top_transpose = Wdh_top.transpose();
+			ut->zero<MatrixXf>(&g_Wduq);
+			ut->zero<MatrixXf>(&g_Wdlq);
+			ut->zero<VectorXf>(&g_Buq);
+			ut->zero<VectorXf>(&g_Blq);
+			w_synced.clear();
+		}
+
+		// the sparse copies are outdated, the dense steps are used until the next setPrecision
+		if (genKernel == &generationStepSparse){
+			sparse.clear();
+			genKernel = getGenerationKernel(d_num, z_num, 0, d_num_top);
+		}
+
+		// the pruned weights are kept at zero, and the transposes of the updated ones are refreshed
+		if (!pruning.empty()){
+			pruning.apply();
+			if (!isFrozen(GROUP_H)){
+				if (!top)
+					Wdh_top_transpose = Wdh_top.transpose();
+			}
+		}
+
+		if (!isFrozen(GROUP_A)){
+			a_synced.clear();
 		}
 
-		for (int s = 0; s < prim_num ; s++){
+		for (int s = 0; s < prim_num && !isFrozen(GROUP_A); s++){
+			if ((enroll_id >= 0 && s != enroll_id) || (!owned.empty() && !owned[s]))
+				continue;
+
 			vectorXf1DContainer::iterator 	 au_i = t_au[s].begin();
 			vectorXf1DContainer::iterator  g_au_i = t_g_au[s].begin();
 			vectorXf1DContainer::iterator  m_au_i = t_m_au[s].begin();
@@ -579,8 +700,8 @@ LayerPvrnnBeta::LayerPvrnnBeta(int _id, int _d_num, int _d_num_top, int _z_num,
 			vectorXf1DContainer::iterator  v_al_i = t_v_al[s].begin();
 
 			for (int t = 0; t < prim_len ; t++, au_i++, g_au_i++, m_au_i++, v_au_i++, al_i++, g_al_i++, m_al_i++, v_al_i++){
-				ut->adam<VectorXf>(au_i.base(),   g_au_i.base(),   m_au_i.base(),   v_au_i.base(),   _epoch, _alpha, _beta1, _beta2 );
-				ut->adam<VectorXf>(al_i.base(),   g_al_i.base(),   m_al_i.base(),   v_al_i.base(),   _epoch, _alpha, _beta1, _beta2 );
+				aOptimizer->step<VectorXf>(au_i.base(),   g_au_i.base(),   m_au_i.base(),   v_au_i.base(),   _epoch, _alpha, _beta1, _beta2 );
+				aOptimizer->step<VectorXf>(al_i.base(),   g_al_i.base(),   m_al_i.base(),   v_al_i.base(),   _epoch, _alpha, _beta1, _beta2 );
 				ut->zero<VectorXf>(g_au_i.base());
 				ut->zero<VectorXf>(g_al_i.base());
 
@@ -803,6 +924,8 @@ LayerPvrnnBeta::LayerPvrnnBeta(int _id, int _d_num, int _d_num_top, int _z_num,
 	 	else{
 	 		throw oist::Exception("Error while loading the parameters");
 	 	}
+	 	w_synced = _path;
+	 	a_synced = _path;
 
 	 }
 
@@ -824,95 +947,335 @@ LayerPvrnnBeta::LayerPvrnnBeta(int _id, int _d_num, int _d_num_top, int _z_num,
 				w_p.push_back(&Wdh_top); w_m.push_back(&m_Wdh_top); w_v.push_back(&v_Wdh_top);
 			}
 
-		 	stringstream strmWp, strmWm, strmWv;
+		 	// the files of the parameters unchanged since the last save are kept (e.g. frozen groups)
+		 	if (_path != w_synced){
 
-		 	strmWp << _path << "/L" << id << "_w_p.d";
-			strmWm << _path << "/L" << id << "_w_m.d";
-			strmWv << _path << "/L" << id << "_w_v.d";
+			 	stringstream strmWp, strmWm, strmWv;
 
-			ofstream wFile(strmWp.str(),std::ofstream::out); ofstream m_wFile(strmWm.str(),std::ofstream::out);	ofstream v_wFile(strmWv.str(),std::ofstream::out);
+			 	strmWp << _path << "/L" << id << "_w_p.d";
+				strmWm << _path << "/L" << id << "_w_m.d";
+				strmWv << _path << "/L" << id << "_w_v.d";
 
-			stringstream strmBp, strmBm, strmBv;
+				ofstream wFile(strmWp.str(),std::ofstream::out); ofstream m_wFile(strmWm.str(),std::ofstream::out);	ofstream v_wFile(strmWv.str(),std::ofstream::out);
 
-			strmBp << _path << "/L" << id << "_b_p.d";
-			strmBm << _path << "/L" << id << "_b_m.d";
-			strmBv << _path << "/L" << id << "_b_v.d";
+				stringstream strmBp, strmBm, strmBv;
 
-			ofstream bFile(strmBp.str(),std::ofstream::out); ofstream m_bFile(strmBm.str(),std::ofstream::out);	ofstream v_bFile(strmBv.str(),std::ofstream::out);
+				strmBp << _path << "/L" << id << "_b_p.d";
+				strmBm << _path << "/L" << id << "_b_m.d";
+				strmBv << _path << "/L" << id << "_b_v.d";
 
-			stringstream strmAup, strmAum, strmAuv;
+				ofstream bFile(strmBp.str(),std::ofstream::out); ofstream m_bFile(strmBm.str(),std::ofstream::out);	ofstream v_bFile(strmBv.str(),std::ofstream::out);
 
-			strmAup << _path << "/L" << id << "_au_p.d";
-			strmAum << _path << "/L" << id << "_au_m.d";
-			strmAuv << _path << "/L" << id << "_au_v.d";
+		 		ofstream* buff_wFile[] = 	{&wFile,   &m_wFile,   &v_wFile};
+		 		ofstream* buff_bFile[] = 	{&bFile,   &m_bFile,   &v_bFile};
 
-			ofstream AuFile(strmAup.str(),std::ofstream::out); ofstream m_AuFile(strmAum.str(),std::ofstream::out);	ofstream v_AuFile(strmAuv.str(),std::ofstream::out);
+		 		if (wFile.is_open()   && m_wFile.is_open()   && v_wFile.is_open()   &&
+		 			bFile.is_open()   && m_bFile.is_open()   && v_bFile.is_open()){
 
-			stringstream strmAlp, strmAlm, strmAlv;
+		 			// storing the weight matrices
+		 			for (int i = 0 ; i < (int)w_p.size() ; i++){
 
-			strmAlp << _path << "/L" << id << "_al_p.d";
-			strmAlm << _path << "/L" << id << "_al_m.d";
-			strmAlv << _path << "/L" << id << "_al_v.d";
+		 				MatrixXf* buff [] = {w_p[i], w_m[i], w_v[i]};
+		 				for (int k = 0 ; k < 3 ; k++){
+		 					ut->saveEigen<MatrixXf>(buff_wFile[k], buff[k], delimiter);
+		 				}
+		 			}
 
-			ofstream AlFile(strmAlp.str(),std::ofstream::out); ofstream m_AlFile(strmAlm.str(),std::ofstream::out);	ofstream v_AlFile(strmAlv.str(),std::ofstream::out);
+		 			// storing the bias vectors
+		 			for (int i = 0 ; i < (int)b_p.size() ; i++){
 
-	 		ofstream* buff_wFile[] = 	{&wFile,   &m_wFile,   &v_wFile};
-	 		ofstream* buff_bFile[] = 	{&bFile,   &m_bFile,   &v_bFile};
+		 				VectorXf* buff [] = {b_p[i], b_m[i], b_v[i]};
+		 				for (int k = 0 ; k < 3 ; k++){
+		 					ut->saveEigen<VectorXf>(buff_bFile[k], buff[k], delimiter);
+		 				}
+		 			}
 
-	 		if (wFile.is_open()   && m_wFile.is_open()   && v_wFile.is_open()   &&
-	 			bFile.is_open()   && m_bFile.is_open()   && v_bFile.is_open()   &&
-				AuFile.is_open() && m_AuFile.is_open() && v_AuFile.is_open() &&
-				AlFile.is_open() && m_AlFile.is_open() && v_AlFile.is_open() ){
+		 			wFile.close();	 m_wFile.close(); v_wFile.close();
+		 			bFile.close();	 m_bFile.close(); v_bFile.close();
+		 		}
+		 		else{
+		 			throw oist::Exception("Error while saving the parameters");
+		 		}
+		 		w_synced = _path;
+		 	}
 
-	 			// storing the weight matrices
-	 			for (int i = 0 ; i < (int)w_p.size() ; i++){
+		 	if (_path != a_synced){
 
-	 				MatrixXf* buff [] = {w_p[i], w_m[i], w_v[i]};
-	 				for (int k = 0 ; k < 3 ; k++){
-	 					ut->saveEigen<MatrixXf>(buff_wFile[k], buff[k], delimiter);
-	 				}
-	 			}
+				stringstream strmAup, strmAum, strmAuv;
 
-	 			// storing the bias vectors
-	 			for (int i = 0 ; i < (int)b_p.size() ; i++){
+				strmAup << _path << "/L" << id << "_au_p.d";
+				strmAum << _path << "/L" << id << "_au_m.d";
+				strmAuv << _path << "/L" << id << "_au_v.d";
 
-	 				VectorXf* buff [] = {b_p[i], b_m[i], b_v[i]};
-	 				for (int k = 0 ; k < 3 ; k++){
-	 					ut->saveEigen<VectorXf>(buff_bFile[k], buff[k], delimiter);
-	 				}
-	 			}
+				ofstream AuFile(strmAup.str(),std::ofstream::out); ofstream m_AuFile(strmAum.str(),std::ofstream::out);	ofstream v_AuFile(strmAuv.str(),std::ofstream::out);
 
-	 			// saving the AMu and ALs vectors
-	 			for (int s = 0 ; s < prim_num; s++){
-					for (int t = 0 ; t < prim_len; t++){
+				stringstream strmAlp, strmAlm, strmAlv;
 
-						try{
-							ut->saveEigen<VectorXf>(&AuFile, &t_au[s][t], delimiter);
-							ut->saveEigen<VectorXf>(&AlFile, &t_al[s][t], delimiter);
-							ut->saveEigen<VectorXf>(&m_AuFile, &t_m_au[s][t], delimiter);
-							ut->saveEigen<VectorXf>(&m_AlFile, &t_m_al[s][t], delimiter);
-							ut->saveEigen<VectorXf>(&v_AuFile, &t_v_au[s][t], delimiter);
-							ut->saveEigen<VectorXf>(&v_AlFile, &t_v_al[s][t], delimiter);
-						}
-						catch(oist::Exception& _e){
-							stringstream stream;
-							stream << "Unsuccessful loading of L" << id << " A vectors, msg[" << _e.what() << "]" << endl;
-							throw oist::Exception(stream.str());
+				strmAlp << _path << "/L" << id << "_al_p.d";
+				strmAlm << _path << "/L" << id << "_al_m.d";
+				strmAlv << _path << "/L" << id << "_al_v.d";
+
+				ofstream AlFile(strmAlp.str(),std::ofstream::out); ofstream m_AlFile(strmAlm.str(),std::ofstream::out);	ofstream v_AlFile(strmAlv.str(),std::ofstream::out);
+
+		 		if (AuFile.is_open() && m_AuFile.is_open() && v_AuFile.is_open() &&
+					AlFile.is_open() && m_AlFile.is_open() && v_AlFile.is_open() ){
+
+		 			// saving the AMu and ALs vectors
+		 			for (int s = 0 ; s < prim_num; s++){
+						for (int t = 0 ; t < prim_len; t++){
+
+							try{
+								ut->saveEigen<VectorXf>(&AuFile, &t_au[s][t], delimiter);
+								ut->saveEigen<VectorXf>(&AlFile, &t_al[s][t], delimiter);
+								ut->saveEigen<VectorXf>(&m_AuFile, &t_m_au[s][t], delimiter);
+								ut->saveEigen<VectorXf>(&m_AlFile, &t_m_al[s][t], delimiter);
+								ut->saveEigen<VectorXf>(&v_AuFile, &t_v_au[s][t], delimiter);
+								ut->saveEigen<VectorXf>(&v_AlFile, &t_v_al[s][t], delimiter);
+							}
+							catch(oist::Exception& _e){
+								stringstream stream;
+								stream << "Unsuccessful loading of L" << id << " A vectors, msg[" << _e.what() << "]" << endl;
+								throw oist::Exception(stream.str());
+							}
 						}
 					}
-				}
 
-	 			wFile.close();	 m_wFile.close(); v_wFile.close();
-	 			bFile.close();	 m_bFile.close(); v_bFile.close();
-	 			AuFile.close(); m_AuFile.close(); v_AuFile.close();
-	 			AlFile.close(); m_AlFile.close(); v_AlFile.close();
-	 			}
-
-	 		else{
-	 			throw oist::Exception("Error while saving the parameters");
-	 		}
+		 			AuFile.close(); m_AuFile.close(); v_AuFile.close();
+		 			AlFile.close(); m_AlFile.close(); v_AlFile.close();
+		 		}
+		 		else{
+		 			throw oist::Exception("Error while saving the parameters");
+		 		}
+		 		a_synced = _path;
+		 	}
 	 }
 
+	void LayerPvrnnBeta::getParamBuffers(vector<string>& _w_names, vector<MatrixXf*>& _w_p, vector<MatrixXf*>& _w_m, vector<MatrixXf*>& _w_v,
+			vector<string>& _b_names, vector<VectorXf*>& _b_p, vector<VectorXf*>& _b_m, vector<VectorXf*>& _b_v){
+
+		_w_names.push_back("Wdh");	_w_names.push_back("Wzh");	_w_names.push_back("Wdup");	_w_names.push_back("Wdlp");	_w_names.push_back("Wduq");	_w_names.push_back("Wdlq");
+		_w_p.push_back(&Wdh);	_w_p.push_back(&Wzh);	_w_p.push_back(&Wdup);	_w_p.push_back(&Wdlp);	_w_p.push_back(&Wduq);	_w_p.push_back(&Wdlq);
+		_w_m.push_back(&m_Wdh);	_w_m.push_back(&m_Wzh);	_w_m.push_back(&m_Wdup);	_w_m.push_back(&m_Wdlp);	_w_m.push_back(&m_Wduq);	_w_m.push_back(&m_Wdlq);
+		_w_v.push_back(&v_Wdh);	_w_v.push_back(&v_Wzh);	_w_v.push_back(&v_Wdup);	_w_v.push_back(&v_Wdlp);	_w_v.push_back(&v_Wduq);	_w_v.push_back(&v_Wdlq);
+
+		_b_names.push_back("Bh");	_b_names.push_back("Bup");	_b_names.push_back("Blp");	_b_names.push_back("Buq");	_b_names.push_back("Blq");
+		_b_p.push_back(&Bh);	_b_p.push_back(&Bup);	_b_p.push_back(&Blp);	_b_p.push_back(&Buq);	_b_p.push_back(&Blq);
+		_b_m.push_back(&m_Bh);	_b_m.push_back(&m_Bup);	_b_m.push_back(&m_Blp);	_b_m.push_back(&m_Buq);	_b_m.push_back(&m_Blq);
+		_b_v.push_back(&v_Bh);	_b_v.push_back(&v_Bup);	_b_v.push_back(&v_Blp);	_b_v.push_back(&v_Buq);	_b_v.push_back(&v_Blq);
+
+		if (!top){
+			_w_names.push_back("Wdh_top");
+			_w_p.push_back(&Wdh_top);	_w_m.push_back(&m_Wdh_top);	_w_v.push_back(&v_Wdh_top);
+		}
+	}
+
+	void LayerPvrnnBeta::load(Checkpoint* _ckpt){
+
+		vector<string> w_names, b_names;
+		vector<MatrixXf*> w_p, w_m, w_v;
+		vector<VectorXf*> b_p, b_m, b_v;
+
+		getParamBuffers(w_names, w_p, w_m, w_v, b_names, b_p, b_m, b_v);
+
+		stringstream strm; strm << "L" << id << "_";
+		string prefix = strm.str();
+
+		try{
+			for (int i = 0 ; i < (int)w_p.size() ; i++){
+				_ckpt->get<MatrixXf>(prefix + w_names[i] + "_p", w_p[i]);
+				_ckpt->get<MatrixXf>(prefix + w_names[i] + "_m", w_m[i]);
+				_ckpt->get<MatrixXf>(prefix + w_names[i] + "_v", w_v[i]);
+			}
+			for (int i = 0 ; i < (int)b_p.size() ; i++){
+				_ckpt->get<VectorXf>(prefix + b_names[i] + "_p", b_p[i]);
+				_ckpt->get<VectorXf>(prefix + b_names[i] + "_m", b_m[i]);
+				_ckpt->get<VectorXf>(prefix + b_names[i] + "_v", b_v[i]);
+			}
+			for (int s = 0 ; s < prim_num; s++){
+				stringstream strmAu; strmAu << prefix << "au" << s;
+				stringstream strmAl; strmAl << prefix << "al" << s;
+				_ckpt->get(strmAu.str() + "_p", &t_au[s]);
+				_ckpt->get(strmAu.str() + "_m", &t_m_au[s]);
+				_ckpt->get(strmAu.str() + "_v", &t_v_au[s]);
+				_ckpt->get(strmAl.str() + "_p", &t_al[s]);
+				_ckpt->get(strmAl.str() + "_m", &t_m_al[s]);
+				_ckpt->get(strmAl.str() + "_v", &t_v_al[s]);
+			}
+
+			// loading auxiliary matrices
+			if (!top){
+				Wdh_top_transpose = Wdh_top.transpose();
+			}
+		}catch(oist::Exception& _e){
+			stringstream stream;
+			stream << "Unsuccessful loading of L" << id << " parameters, msg[" << _e.what() << "]" << endl;
+			throw oist::Exception(stream.str());
+		}
+		w_synced.clear();
+		a_synced.clear();
+	}
+
+	void LayerPvrnnBeta::save(Checkpoint* _ckpt){
+
+		vector<string> w_names, b_names;
+		vector<MatrixXf*> w_p, w_m, w_v;
+		vector<VectorXf*> b_p, b_m, b_v;
+
+		getParamBuffers(w_names, w_p, w_m, w_v, b_names, b_p, b_m, b_v);
+
+		stringstream strm; strm << "L" << id << "_";
+		string prefix = strm.str();
+
+		for (int i = 0 ; i < (int)w_p.size() ; i++){
+			_ckpt->add<MatrixXf>(prefix + w_names[i] + "_p", w_p[i]);
+			_ckpt->add<MatrixXf>(prefix + w_names[i] + "_m", w_m[i]);
+			_ckpt->add<MatrixXf>(prefix + w_names[i] + "_v", w_v[i]);
+		}
+		for (int i = 0 ; i < (int)b_p.size() ; i++){
+			_ckpt->add<VectorXf>(prefix + b_names[i] + "_p", b_p[i]);
+			_ckpt->add<VectorXf>(prefix + b_names[i] + "_m", b_m[i]);
+			_ckpt->add<VectorXf>(prefix + b_names[i] + "_v", b_v[i]);
+		}
+		for (int s = 0 ; s < prim_num; s++){
+			stringstream strmAu; strmAu << prefix << "au" << s;
+			stringstream strmAl; strmAl << prefix << "al" << s;
+			_ckpt->add(strmAu.str() + "_p", &t_au[s]);
+			_ckpt->add(strmAu.str() + "_m", &t_m_au[s]);
+			_ckpt->add(strmAu.str() + "_v", &t_v_au[s]);
+			_ckpt->add(strmAl.str() + "_p", &t_al[s]);
+			_ckpt->add(strmAl.str() + "_m", &t_m_al[s]);
+			_ckpt->add(strmAl.str() + "_v", &t_v_al[s]);
+		}
+	}
+
+	void LayerPvrnnBeta::exportInference(Checkpoint* _ckpt, const int1DContainer& _prim_ids){
+
+		vector<string> w_names, b_names;
+		vector<MatrixXf*> w_p, w_m, w_v;
+		vector<VectorXf*> b_p, b_m, b_v;
+
+		getParamBuffers(w_names, w_p, w_m, w_v, b_names, b_p, b_m, b_v);
+
+		stringstream strm; strm << "L" << id << "_";
+		string prefix = strm.str();
+
+		// only the parameters, the Adam moments are not required in experiment mode
+		for (int i = 0 ; i < (int)w_p.size() ; i++){
+			_ckpt->add<MatrixXf>(prefix + w_names[i] + "_p", w_p[i]);
+		}
+		for (int i = 0 ; i < (int)b_p.size() ; i++){
+			_ckpt->add<VectorXf>(prefix + b_names[i] + "_p", b_p[i]);
+		}
+		for (int i = 0 ; i < (int)_prim_ids.size(); i++){
+			stringstream strmAu; strmAu << prefix << "au" << _prim_ids[i] << "_p";
+			stringstream strmAl; strmAl << prefix << "al" << _prim_ids[i] << "_p";
+			_ckpt->add(strmAu.str(), &t_au[_prim_ids[i]]);
+			_ckpt->add(strmAl.str(), &t_al[_prim_ids[i]]);
+		}
+	}
+
+	void LayerPvrnnBeta::loadInference(Checkpoint* _ckpt, const int1DContainer& _prim_ids){
+
+		vector<string> w_names, b_names;
+		vector<MatrixXf*> w_p, w_m, w_v;
+		vector<VectorXf*> b_p, b_m, b_v;
+
+		getParamBuffers(w_names, w_p, w_m, w_v, b_names, b_p, b_m, b_v);
+
+		stringstream strm; strm << "L" << id << "_";
+		string prefix = strm.str();
+
+		try{
+			for (int i = 0 ; i < (int)w_p.size() ; i++){
+				_ckpt->get<MatrixXf>(prefix + w_names[i] + "_p", w_p[i]);
+			}
+			for (int i = 0 ; i < (int)b_p.size() ; i++){
+				_ckpt->get<VectorXf>(prefix + b_names[i] + "_p", b_p[i]);
+			}
+
+			// the A variables are sized on demand, they are not allocated by the models loaded for inference only
+			for (int i = 0 ; i < (int)_prim_ids.size(); i++){
+				stringstream strmAu; strmAu << prefix << "au" << _prim_ids[i] << "_p";
+				stringstream strmAl; strmAl << prefix << "al" << _prim_ids[i] << "_p";
+				if ((int)t_au[_prim_ids[i]].size() != prim_len)
+					t_au[_prim_ids[i]].assign(prim_len, VectorXf::Zero(z_num));
+				if ((int)t_al[_prim_ids[i]].size() != prim_len)
+					t_al[_prim_ids[i]].assign(prim_len, VectorXf::Zero(z_num));
+				_ckpt->get(strmAu.str(), &t_au[_prim_ids[i]]);
+				_ckpt->get(strmAl.str(), &t_al[_prim_ids[i]]);
+			}
+
+			// loading auxiliary matrices
+			if (!top){
+				Wdh_top_transpose = Wdh_top.transpose();
+			}
+		}catch(oist::Exception& _e){
+			stringstream stream;
+			stream << "Unsuccessful loading of L" << id << " parameters, msg[" << _e.what() << "]" << endl;
+			throw oist::Exception(stream.str());
+		}
+	}
+
+	void LayerPvrnnBeta::releaseTraining(const int1DContainer& _prim_ids){
+
+		// the A variables of the primitives not exported are released
+		vector<bool> exported(prim_num, false);
+		for (int i = 0 ; i < (int)_prim_ids.size(); i++){
+			exported[_prim_ids[i]] = true;
+		}
+		for (int s = 0 ; s < prim_num; s++){
+			if (!exported[s]){
+				vectorXf1DContainer().swap(t_au[s]);
+				vectorXf1DContainer().swap(t_al[s]);
+			}
+		}
+
+		free_training();
+	}
+
+	void LayerPvrnnBeta::free_training(){
+
+		vector<string> w_names, b_names;
+		vector<MatrixXf*> w_p, w_m, w_v;
+		vector<VectorXf*> b_p, b_m, b_v;
+
+		getParamBuffers(w_names, w_p, w_m, w_v, b_names, b_p, b_m, b_v);
+
+		// Adam moments of the parameters
+		for (int i = 0 ; i < (int)w_p.size() ; i++){
+			w_m[i]->resize(0,0);
+			w_v[i]->resize(0,0);
+		}
+		for (int i = 0 ; i < (int)b_p.size() ; i++){
+			b_m[i]->resize(0);
+			b_v[i]->resize(0);
+		}
+
+		// gradients of the parameters
+		g_Wdh.resize(0,0);
+		g_Wzh.resize(0,0);
+		g_Wdup.resize(0,0);
+		g_Wdlp.resize(0,0);
+		g_Wduq.resize(0,0);
+		g_Wdlq.resize(0,0);
+		if (!top){
+			g_Wdh_top.resize(0,0);
+		}
+		g_Bh.resize(0);
+		g_Bup.resize(0);
+		g_Blp.resize(0);
+		g_Buq.resize(0);
+		g_Blq.resize(0);
+
+		// gradients and Adam moments of the A variables
+		vectorXf2DContainer().swap(t_g_au);
+		vectorXf2DContainer().swap(t_m_au);
+		vectorXf2DContainer().swap(t_v_au);
+		vectorXf2DContainer().swap(t_g_al);
+		vectorXf2DContainer().swap(t_m_al);
+		vectorXf2DContainer().swap(t_v_al);
+	}
+
 	 void LayerPvrnnBeta::free_memory(){
 
 		// memory from training
@@ -1067,8 +1430,10 @@ LayerPvrnnBeta::LayerPvrnnBeta(int _id, int _d_num, int _d_num_top, int _z_num,
 				e_au.push_back(VectorXf::Zero(z_num)); 		e_al.push_back(VectorXf::Zero(z_num));
 				e_au_copy.push_back(VectorXf::Zero(z_num)); e_al_copy.push_back(VectorXf::Zero(z_num));
 				g_au.push_back(VectorXf::Zero(z_num)); 		g_al.push_back(VectorXf::Zero(z_num));
-				m_au.push_back(VectorXf::Zero(z_num)); 		m_al.push_back(VectorXf::Zero(z_num));
-				v_au.push_back(VectorXf::Zero(z_num)); 		v_al.push_back(VectorXf::Zero(z_num));
+				m_au.push_back(VectorXf()); 				m_al.push_back(VectorXf());
+				v_au.push_back(VectorXf()); 				v_al.push_back(VectorXf());
+				aOptimizer->allocate<VectorXf>(&e_au.back(), &m_au.back(), &v_au.back());
+				aOptimizer->allocate<VectorXf>(&e_al.back(), &m_al.back(), &v_al.back());
 
 			}
 
@@ -1153,8 +1518,132 @@ LayerPvrnnBeta::LayerPvrnnBeta(int _id, int _d_num, int _d_num_top, int _z_num,
 
 	}
 
+	void LayerPvrnnBeta::setPrecision(Precision _precision){
+
+		// the generation steps use the copies of the weights in reduced precision, or the specialized step for the layer shape
+		reduced.clear();
+		sparse.clear();
+		if (_precision != PRECISION_FP32){
+			reduced.Wdup.set(Wdup, _precision);
+			reduced.Wdlp.set(Wdlp, _precision);
+			reduced.Wduq.set(Wduq, _precision);
+			reduced.Wdlq.set(Wdlq, _precision);
+			reduced.Wdh.set(Wdh, _precision);
+			reduced.Wzh.set(Wzh, _precision);
+			if (!top)
+				reduced.Wdh_top.set(Wdh_top, _precision);
+			reduced.in = VectorXf::Zero(d_num);
+			genKernel = &generationStepReduced;
+			return;
+		}
+
+		// the pruned weights are copied in the sparse format, with their transposes for the post-diction gradients,
+		// except for the layers whose dense weights fit in the cache
+		genKernel = getGenerationKernel(d_num, z_num, 0, d_num_top);
+		if (sparse_density <= 0.0 || getGenerationBytes() < SPARSE_MIN_BYTES)
+			return;
+		sparse.Wdup.set(Wdup, sparse_density);
+		sparse.Wdlp.set(Wdlp, sparse_density);
+		sparse.Wduq.set(Wduq, sparse_density);
+		sparse.Wdlq.set(Wdlq, sparse_density);
+		sparse.Wdh.set(Wdh, sparse_density);
+		sparse.Wzh.set(Wzh, sparse_density);
+		if (!top)
+			sparse.Wdh_top.set(Wdh_top, sparse_density);
+		if (!sparse.hasSparse()){
+			sparse.clear();
+			return;
+		}
+		sparse.Wdup_t.set(Wdup.transpose(), sparse_density);
+		sparse.Wdlp_t.set(Wdlp.transpose(), sparse_density);
+		sparse.Wduq_t.set(Wduq.transpose(), sparse_density);
+		sparse.Wdlq_t.set(Wdlq.transpose(), sparse_density);
+		sparse.Wdh_t.set(Wdh.transpose(), sparse_density);
+		sparse.Wzh_t.set(Wzh.transpose(), sparse_density);
+		sparse.in = VectorXf::Zero(d_num);
+		genKernel = &generationStepSparse;
+	}
+
+	void LayerPvrnnBeta::setSparseDensity(float _density){
+		sparse_density = _density;
+	}
+
+	size_t LayerPvrnnBeta::getGenerationBytes(){
+
+		if (genKernel == &generationStepReduced)
+			return reduced.bytes();
+		if (genKernel == &generationStepSparse)
+			return sparse.bytes();
+		size_t n = Wdup.size() + Wdlp.size() + Wduq.size() + Wdlq.size() + Wdh.size() + Wzh.size();
+		if (!top)
+			n += Wdh_top.size();
+		return n*sizeof(float);
+	}
+
+	void LayerPvrnnBeta::generationStep(const float* _au, const float* _al, const float* _d_bottom, const float* _d_top,
+			float* _h, float* _d, float* _u, float* _l, float* _s, float* _n, float* _z){
+
+		GenerationStep step;
+		if (_au != nullptr){
+			step.Wdu = Wduq.data();	step.Bu = Buq.data();
+			step.Wdl = Wdlq.data();	step.Bl = Blq.data();
+		}
+		else{
+			step.Wdu = Wdup.data();	step.Bu = Bup.data();
+			step.Wdl = Wdlp.data();	step.Bl = Blp.data();
+		}
+		step.au = _au;
+		step.al = _al;
+		step.Wdh = Wdh.data();
+		step.Wzh = Wzh.data();
+		step.Bh = Bh.data();
+		step.Wdh_bottom = nullptr;
+		step.d_bottom = _d_bottom;
+		step.Wdh_top = top ? nullptr : Wdh_top.data();
+		step.d_top = _d_top;
+		step.eps = eps;
+		step.one_sub_eps = one_sub_eps;
+		step.ut = ut;
+		step.reduced = &reduced;
+		step.sparse = &sparse;
+		step.h = _h;	step.d = _d;
+		step.u = _u;	step.l = _l;	step.s = _s;	step.n = _n;	step.z = _z;
+
+		genKernel(step);
+	}
+
+	void LayerPvrnnBeta::generationInput(const float* _d, const float* _z, const float*, const float* _d_top, VectorXf& _h){
+
+		VectorXf in = Bh;
+		kernels->gemv(Wdh.data(), _d, in.data(), d_num, d_num);
+		kernels->gemv(Wzh.data(), _z, in.data(), d_num, z_num);
+		if (_d_top != nullptr)
+			kernels->gemv(Wdh_top.data(), _d_top, in.data(), d_num, d_num_top);
+
+		_h = one_sub_eps*_h + eps*in;
+	}
+
 	void LayerPvrnnBeta::e_generate(){
 
+		 if (genKernel != nullptr){
+			 bool posterior = e_gen_time < gen_time_thres;
+			 generationStep(posterior ? t_au[e_prim_id][e_gen_time].data() : nullptr,
+					 posterior ? t_al[e_prim_id][e_gen_time].data() : nullptr, nullptr, (top ? nullptr : c->dp_top.data()),
+					 hp_gen.data(), c->dp_gen.data(), up_gen.data(), lp_gen.data(), sp_gen.data(), np_gen.data(), zp_gen.data());
+			 e_gen_time += 1;
+
+			 if (e_store_gen == true){
+				 *(e_hp_gen_store_i++) = hp_gen;
+				 *(e_dp_gen_store_i++) = c->dp_gen;
+				 *(e_up_gen_store_i++) = up_gen;
+				 *(e_lp_gen_store_i++) = lp_gen;
+				 *(e_sp_gen_store_i++) = sp_gen;
+				 *(e_np_gen_store_i++) = np_gen;
+				 *(e_zp_gen_store_i++) = zp_gen;
+			 }
+			 return;
+		 }
+
 		 //generating from the prior distribution
 		 VectorXf hp = hp_gen;
 		 VectorXf dp = c->dp_gen;
@@ -1178,10 +1667,7 @@ LayerPvrnnBeta::LayerPvrnnBeta(int _id, int _d_num, int _d_num_top, int _z_num,
 		 ut->randN<ArrayXf>(&np);
 		 VectorXf zp = up + sp*np;
 
-		 hp = one_sub_eps*hp + eps*(Wdh*dp + Wzh*zp + Bh);
-
-		 if (!top)
-			 hp += eps*(Wdh_top*c->dp_top);
+		 generationInput(dp.data(), zp.data(), nullptr, (top ? nullptr : c->dp_top.data()), hp);
 
 		 dp = hp;
 		 ut->tanH<VectorXf>(&dp);
@@ -1208,6 +1694,27 @@ LayerPvrnnBeta::LayerPvrnnBeta(int _id, int _d_num, int _d_num_top, int _z_num,
 
 	void LayerPvrnnBeta::e_forward(){
 
+		if (genKernel != nullptr){
+			// the prior and the posterior steps are computed in place in the stored states
+			e_hp.push_back(e_hp.back());
+			c->e_dp.push_back(c->e_dp.back());
+			e_hq.push_back(e_hq.back());
+			c->e_dq.push_back(c->e_dq.back());
+			arrayXf1DContainer* states[] = {&e_up, &e_lp, &e_sp, &e_np, &e_zp, &e_uq, &e_lq, &e_sq, &e_nq, &e_zq};
+			for (arrayXf1DContainer* state : states)
+				state->push_back(ArrayXf(z_num));
+
+			generationStep(nullptr, nullptr, nullptr, (top ? nullptr : c->dp_top.data()), e_hp.back().data(), c->e_dp.back().data(),
+					e_up.back().data(), e_lp.back().data(), e_sp.back().data(), e_np.back().data(), e_zp.back().data());
+			const float* au = (e_au_i++)->data();
+			const float* al = (e_al_i++)->data();
+			generationStep(au, al, nullptr, (top ? nullptr : c->dq_top.data()), e_hq.back().data(), c->e_dq.back().data(),
+					e_uq.back().data(), e_lq.back().data(), e_sq.back().data(), e_nq.back().data(), e_zq.back().data());
+
+			c->e_kld.push_back(get_kld(e_up.back(), e_sp.back(), e_uq.back(), e_sq.back()));
+			return;
+		}
+
 		// --------------- generating the prior distribution ---------------
 		VectorXf hp = e_hp.back();
 		VectorXf dp = c->e_dp.back();
@@ -1292,26 +1799,54 @@ LayerPvrnnBeta::LayerPvrnnBeta(int _id, int _d_num, int _d_num_top, int _z_num,
 		ArrayXf uq_pow_2 = uq.pow(2.0);
 
 
-		VectorXf g_d = eps*c->g_h_next.transpose()*Wdh;
+		RowVectorXf g_uptanh_transpose = g_up_next_transpose.array()*(1.0 - up_next.pow(2.0).transpose());
+		RowVectorXf g_uqtanh_transpose = g_uq_next_transpose.array()*(1.0 - uq_next.pow(2.0).transpose());
 
-		if (bottom){
-			g_d +=  c->g_dqloss;
+		// with pruned weights, the products of the dense implementation are computed with the sparse transposes
+		bool sparseCopies = genKernel == &generationStepSparse;
+		VectorXf g_d;
+		if (sparseCopies){
+			VectorXf g_h_next = eps*c->g_h_next;
+			g_d = VectorXf::Zero(d_num);
+			sparse.Wdh_t.gemv(g_h_next.data(), g_d.data());
+			if (bottom){
+				g_d += c->g_dqloss;
+			}
+			if (!top){
+				VectorXf g_hq_top = eps_top*c->g_hq_top;
+				sparse.Wdh_top.gemv(g_hq_top.data(), g_d.data());
+			}
+			sparse.Wdup_t.gemv(g_uptanh_transpose.data(), g_d.data());
+			sparse.Wduq_t.gemv(g_uqtanh_transpose.data(), g_d.data());
+			sparse.Wdlp_t.gemv(g_lp_next_transpose.data(), g_d.data());
+			sparse.Wdlq_t.gemv(g_lq_next_transpose.data(), g_d.data());
 		}
+		else{
+			g_d = eps*c->g_h_next.transpose()*Wdh;
 
-		if (!top){
-			g_d += ((VectorXf)(eps_top*c->g_hq_top.transpose()*Wdh_top_transpose)).transpose();
-		}
+			if (bottom){
+				g_d +=  c->g_dqloss;
+			}
 
-		RowVectorXf g_uptanh_transpose = g_up_next_transpose.array()*(1.0 - up_next.pow(2.0).transpose());
-		RowVectorXf g_uqtanh_transpose = g_uq_next_transpose.array()*(1.0 - uq_next.pow(2.0).transpose());
+			if (!top){
+				g_d += ((VectorXf)(eps_top*c->g_hq_top.transpose()*Wdh_top_transpose)).transpose();
+			}
 
-		g_d += g_uptanh_transpose*Wdup;
-		g_d += g_uqtanh_transpose*Wduq;
-		g_d += g_lp_next_transpose*Wdlp;
-		g_d += g_lq_next_transpose*Wdlq;
+			g_d += g_uptanh_transpose*Wdup;
+			g_d += g_uqtanh_transpose*Wduq;
+			g_d += g_lp_next_transpose*Wdlp;
+			g_d += g_lq_next_transpose*Wdlq;
+		}
 
 		VectorXf g_h = g_d.array()*(1.0 - dq.pow(2.0)) + (one_sub_eps * c->g_h_next.array());
-		ArrayXf g_z = eps*g_h.transpose()*Wzh;
+		ArrayXf g_z;
+		if (sparseCopies){
+			VectorXf g_h_eps = eps*g_h;
+			g_z = ArrayXf::Zero(z_num);
+			sparse.Wzh_t.gemv(g_h_eps.data(), g_z.data());
+		}
+		else
+			g_z = eps*g_h.transpose()*Wzh;
 
 		RowVectorXf g_up = (w_div_z_sum*((up - uq)/sp_pow_2));
 		RowVectorXf g_lp = w_div_z_sum*(1.0 - (((ArrayXf)(uq-up)).pow(2.0) + sq_pow_2)/sp_pow_2);
@@ -1331,7 +1866,7 @@ LayerPvrnnBeta::LayerPvrnnBeta(int _id, int _d_num, int _d_num_top, int _z_num,
 
 	}
 
-	void LayerPvrnnBeta::e_optAdam(int _epoch, float _alpha, float _beta1, float _beta2){
+	void LayerPvrnnBeta::e_optimize(int _epoch, float _alpha, float _beta1, float _beta2){
 
 
 		vectorXf1DContainer::iterator 	 au_i = e_au.begin();
@@ -1346,8 +1881,8 @@ LayerPvrnnBeta::LayerPvrnnBeta(int _id, int _d_num, int _d_num_top, int _z_num,
 
 		for (int t = 0; t < e_window_size ; t++, au_i++, g_au_i++, m_au_i++, v_au_i++, al_i++, g_al_i++, m_al_i++, v_al_i++){
 
-			ut->adam<VectorXf>(au_i.base(),   g_au_i.base(),   m_au_i.base(),   v_au_i.base(),   _epoch, _alpha, _beta1, _beta2 );
-			ut->adam<VectorXf>(al_i.base(),   g_al_i.base(),   m_al_i.base(),   v_al_i.base(),   _epoch, _alpha, _beta1, _beta2 );
+			aOptimizer->step<VectorXf>(au_i.base(),   g_au_i.base(),   m_au_i.base(),   v_au_i.base(),   _epoch, _alpha, _beta1, _beta2 );
+			aOptimizer->step<VectorXf>(al_i.base(),   g_al_i.base(),   m_al_i.base(),   v_al_i.base(),   _epoch, _alpha, _beta1, _beta2 );
 
 			ut->zero<VectorXf>(g_au_i.base());
 			ut->zero<VectorXf>(g_al_i.base());
@@ -1655,6 +2190,22 @@ LayerPvrnnBeta::LayerPvrnnBeta(int _id, int _d_num, int _d_num_top, int _z_num,
 
 	void LayerPvrnnBeta::a_predict(){
 
+		 if (genKernel != nullptr){
+			 // the step is computed in place in the stored states
+			 hp_gen_store.push_back(hp_gen);
+			 dp_gen_store.push_back(c->dp_gen);
+			 up_gen_store.push_back(ArrayXf(z_num));
+			 lp_gen_store.push_back(ArrayXf(z_num));
+			 sp_gen_store.push_back(ArrayXf(z_num));
+			 np_gen_store.push_back(ArrayXf(z_num));
+			 zp_gen_store.push_back(ArrayXf(z_num));
+			 generationStep(nullptr, nullptr, nullptr, (top ? nullptr : c->dp_top.data()), hp_gen_store.back().data(), dp_gen_store.back().data(), up_gen_store.back().data(),
+					 lp_gen_store.back().data(), sp_gen_store.back().data(), np_gen_store.back().data(), zp_gen_store.back().data());
+			 hp_gen = hp_gen_store.back();
+			 c->dp_gen = dp_gen_store.back();
+			 return;
+		 }
+
 		 VectorXf hp = hp_gen;
 		 VectorXf dp = c->dp_gen;
 
@@ -1666,10 +2217,7 @@ LayerPvrnnBeta::LayerPvrnnBeta(int _id, int _d_num, int _d_num_top, int _z_num,
 		 ut->randN<ArrayXf>(&np_);
 		 VectorXf Zp_ = mp_ + sp_*np_;
 
-		 hp = one_sub_eps*hp + eps*(Wdh*dp + Wzh*Zp_ + Bh);
-
-		 if (!top)
-			 hp += eps*(Wdh_top*c->dp_top);
+		 generationInput(dp.data(), Zp_.data(), nullptr, (top ? nullptr : c->dp_top.data()), hp);
 
 		 dp = hp;
 		 ut->tanH<VectorXf>(&dp);
@@ -53,19 +53,28 @@
 #include "../context/ContextPvrnnBeta.h"
 #include "../includes.h"
 #include "../utils/Utils.h"
+#include "../optimizer/IOptimizer.h"
 #include "../layer/ILayer.h"
+#include "../layer/LayerKernel.h"
 
 namespace oist {
 
 /**
  * This class implements a layer type PV-RNN
  * */
-class LayerPvrnnBeta : public ILayer{
+class LayerPvrnnBeta final : public ILayer{
 
 private:
 
 	ContextPvrnnBeta* c;
 	Utils* ut;
+	IOptimizer* optimizer;		// weights and bias
+	IOptimizer* aOptimizer;		// A variables
+	GenerationKernel genKernel;	// specialized generation step, null for the dynamic implementation
+	ReducedWeights reduced;		// inference copies of the weights in reduced precision, set by setPrecision
+	SparseWeights sparse;		// inference copies of the pruned weights, set by setPrecision
+	float sparse_density;		// maximum density of the sparse copies, zero to disable them
+	Pruning pruning;			// masks of the pruned weights
 
 	int id;
 	int d_num;
@@ -82,6 +91,11 @@ private:
 	float w1_div_z_sum;
 	float w_div_z_sum;
 	int prim_num;
+	int enroll_id; // primitive being enrolled, the weights are frozen (-1 if disabled)
+	int frozen; // bit mask of the frozen parameter groups
+	string w_synced; // path of the text files holding the current weights (empty if outdated)
+	string a_synced; // path of the text files holding the current A variables (empty if outdated)
+	bool1DContainer owned; // primitives whose A variables are optimized by this worker (all if empty)
 	int prim_len;
 	float w1;
 	float w;
@@ -139,7 +153,7 @@ private:
 	RowVectorXf g_up_next_transpose;
 	RowVectorXf g_lp_next_transpose;
 
-	// --- ADAM optimization
+	// --- optimizer state (see IOptimizer)
 
 	MatrixXf m_Wdh;
 	MatrixXf m_Wzh;
@@ -304,7 +318,34 @@ private:
 
 	float get_kld(ArrayXf& _mp, ArrayXf& _sp, ArrayXf& _mq, ArrayXf& _sq);
 
+	void getParamBuffers(vector<string>& w_names, vector<MatrixXf*>& w_p, vector<MatrixXf*>& w_m, vector<MatrixXf*>& w_v,
+			vector<string>& b_names, vector<VectorXf*>& b_p, vector<VectorXf*>& b_m, vector<VectorXf*>& b_v);
+
 	void free_memory();
+	void free_training();
+	void allocPrimitives(int n);
+	bool isFrozen(int group);
+
+	/**
+	 * Computes a step of the latent states with the specialized kernel, in place in the given buffers
+	 * @param au A variable of the mean, the step is sampled from the prior if null, else from the posterior
+	 * @param al A variable of the log sigma
+	 * @param d_bottom State d of the bottom layer, null if none
+	 * @param d_top State d of the top layer, null if none
+	 * */
+	void generationStep(const float* au, const float* al, const float* d_bottom, const float* d_top,
+			float* h, float* d, float* u, float* l, float* s, float* n, float* z);
+
+	/**
+	 * Updates the latent state h of the dynamic generation step, the gate products are accumulated
+	 * in a single buffer by the kernels of the selected instruction set
+	 * @param d Previous state d
+	 * @param z Sampled state z
+	 * @param d_bottom Unused, the layers of PV-RNN Beta have no bottom input (same signature as LayerPvrnn)
+	 * @param d_top State d of the top layer, null if none
+	 * @param h Latent state h, updated in place
+	 * */
+	void generationInput(const float* d, const float* z, const float* d_bottom, const float* d_top, VectorXf& h);
 
 public:
 
@@ -321,8 +362,10 @@ public:
 	 * @param prim_len Length of primitives
 	 * @param w1 Meta-parameter w (t=1)
 	 * @param w Meta-parameter w
+	 * @param optimizer Optimizer of the weights and bias
+	 * @param aOptimizer Optimizer of the A variables
 	 * */
-	LayerPvrnnBeta(int id, int d_num, int d_num_top, int z_num, int z_sum, int tau, int tau_top, int prim_num, int prim_len, float w1, float w);
+	LayerPvrnnBeta(int id, int d_num, int d_num_top, int z_num, int z_sum, int tau, int tau_top, int prim_num, int prim_len, float w1, float w, IOptimizer* optimizer, IOptimizer* aOptimizer);
 	/**
 	 * Destructor
 	 * */
@@ -330,6 +373,7 @@ public:
 
 
 	int getStateDim();
+	void addPrimitives(int);
 
     // ------------------------- context methods
 
@@ -342,9 +386,32 @@ public:
 	void t_forward(int, int);
 	void t_initBackward();
 	void t_backward(int, int);
-	void t_optAdam(int, float, float, float);
+	void t_optimize(int, float, float, float);
+	void t_enroll(int);
+	void t_freeze(int);
+
+	/**
+	 * Gets the weight matrices pruned by magnitude, i.e. the ones of the products (the biases are kept)
+	 * @param w Output container
+	 * */
+	void getPrunable(vector<MatrixXf*>& w);
+
+	/**
+	 * Prunes the weights by magnitude, the pruned entries are kept at zero by the following optimization steps
+	 * @param sparsity Fraction of pruned entries of each matrix, used when the threshold is negative
+	 * @param threshold Magnitude threshold shared with the other layers, or negative
+	 * */
+	void t_prune(float sparsity, float threshold);
+	void t_gradients(vector<Map<VectorXf> >&);
+	void t_variables(int, vector<Map<VectorXf> >&);
+	void t_own(const bool1DContainer&);
 	void load(string);
 	void save(string);
+	void load(Checkpoint*);
+	void save(Checkpoint*);
+	void exportInference(Checkpoint*, const int1DContainer&);
+	void loadInference(Checkpoint*, const int1DContainer&);
+	void releaseTraining(const int1DContainer&);
 
 	// ------------------------- Analysis methods
 
@@ -355,6 +422,26 @@ public:
 	// ------------------------ Experiment methods
 
 	void e_enable(int, int, float, int, bool, bool);
+
+	/**
+	 * Sets the storage precision of the weights of the generation steps, the copies are made from the current weights
+	 * @param precision Precision, the single precision weights are used directly with PRECISION_FP32, or copied
+	 * in the sparse format when pruned (see @ref setSparseDensity)
+	 * */
+	void setPrecision(Precision precision);
+
+	/**
+	 * Sets the maximum density of the pruned weights copied in the sparse format by @ref setPrecision, the
+	 * sparse copies are also used by the post-diction gradients. The layers smaller than SPARSE_MIN_BYTES keep
+	 * the dense weights
+	 * @param density Maximum fraction of non-zero entries, zero to disable the sparse copies
+	 * */
+	void setSparseDensity(float density);
+
+	/**
+	 * Gets the number of bytes of the weights read by the generation steps, in the current precision
+	 * */
+	size_t getGenerationBytes();
 	void e_generate();
 	void e_initForward();
 	void e_forward();
@@ -362,7 +449,7 @@ public:
 	void e_backward(int);
 	void e_copyParam();
 	void e_overwriteParam();
-	void e_optAdam(int, float, float, float);
+	void e_optimize(int, float, float, float);
 	float* e_getState(float*);
 	void e_save(string);
 
@@ -0,0 +1,109 @@
+/*<!--
+
+ BSD 3-Clause License
+
+  Copyright (c) 2020 Okinawa Institute of Science and Technology (OIST).
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above
+     copyright notice, this list of conditions and the following
+     disclaimer in the documentation and/or other materials provided
+     with the distribution.
+   * Neither the name of Willow Garage, Inc. nor the names of its
+     contributors may be used to endorse or promote products derived
+     from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+ Author: Hendry F. Chame <hendryfchame@gmail.com>
+
+ Publication:
+
+   Chame, H. F., Ahmadi, A., & Tani, J. (2020).
+   A hybrid human-neurorobotics approach to primary intersubjectivity via
+   active inference. Frontiers in psychology, 11.
+
+   Okinawa Institute of Science and Technology Graduate University (OIST)
+   Cognitive Neurorobotics Research Unit (CNRU)
+   1919-1, Tancha, Onna, Kunigami District, Okinawa 904-0495, Japan
+
+-->*/
+
+
+#include "../utils/Utils.h"
+#include "LayerPvrnnLowRank.h"
+
+namespace oist {
+
+	RecurrentLowRank::RecurrentLowRank(int _rank){
+		rank = _rank;
+	}
+
+	void RecurrentLowRank::initialize(Utils* _ut, RecurrentWeight _weight, int _rows, int _cols, IOptimizer* _optimizer){
+
+		U[_weight] = _ut->kaiming_uniform_initialization(_rows, rank, Utils::nonlinearity::Linear);
+		V[_weight] = _ut->kaiming_uniform_initialization(rank, _cols, Utils::nonlinearity::Linear).transpose();
+		IOptimizer::allocate<MatrixXf>(_optimizer, &U[_weight], &g_U[_weight], &m_U[_weight], &v_U[_weight]);
+		IOptimizer::allocate<MatrixXf>(_optimizer, &V[_weight], &g_V[_weight], &m_V[_weight], &v_V[_weight]);
+		proj = VectorXf::Zero(rank);
+		proj_t = RowVectorXf::Zero(rank);
+	}
+
+	void RecurrentLowRank::getBuffers(RecurrentWeight _weight, vector<string>& _names, vector<MatrixXf*>& _p, vector<MatrixXf*>& _g, vector<MatrixXf*>& _m, vector<MatrixXf*>& _v){
+
+		static const string names[] = {"Wdh", "Wdh_bottom", "Wdh_top"};
+		_names.push_back(names[_weight] + "_U");	_p.push_back(&U[_weight]);	_g.push_back(&g_U[_weight]);	_m.push_back(&m_U[_weight]);	_v.push_back(&v_U[_weight]);
+		_names.push_back(names[_weight] + "_V");	_p.push_back(&V[_weight]);	_g.push_back(&g_V[_weight]);	_m.push_back(&m_V[_weight]);	_v.push_back(&v_V[_weight]);
+	}
+
+	template <>
+	void LayerPvrnnOf<RecurrentLowRank>::t_prune(float _sparsity, float _threshold){
+		vector<MatrixXf*> w;
+		getPrunable(w);
+		pruning.prune(w, _sparsity, _threshold);
+		w_synced.clear();
+		if (id == 0)
+			cout << "Warning: the low-rank layers keep the dense products, the pruned weights are set to zero without speeding up the generation" << endl;
+	}
+
+	template <>
+	void LayerPvrnnOf<RecurrentLowRank>::setPrecision(Precision _precision){
+
+		// the factorized weights are kept in single precision
+		if (_precision != PRECISION_FP32){
+			stringstream stream;
+			stream << "The low-rank layers (network type 'pvrnnlr') only support the precision 'fp32', not '" << precisionName(_precision) << "'";
+			throw Exception(stream.str());
+		}
+	}
+
+	template <>
+	void LayerPvrnnOf<RecurrentLowRank>::setSparseDensity(float){
+		// the products are kept dense
+		throw Exception("The low-rank layers (network type 'pvrnnlr') keep the dense products, the 'sparsedensity' property is not supported");
+	}
+
+	template <>
+	void LayerPvrnnOf<RecurrentLowRank>::generationStep(const float*, const float*, const float*, const float*,
+			float*, float*, float*, float*, float*, float*, float*){
+		throw Exception("The low-rank layers (network type 'pvrnnlr') have no specialized generation steps");
+	}
+
+}/* namespace oist */
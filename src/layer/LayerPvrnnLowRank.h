@@ -0,0 +1,182 @@
+/*<!--
+
+ BSD 3-Clause License
+
+  Copyright (c) 2020 Okinawa Institute of Science and Technology (OIST).
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above
+     copyright notice, this list of conditions and the following
+     disclaimer in the documentation and/or other materials provided
+     with the distribution.
+   * Neither the name of Willow Garage, Inc. nor the names of its
+     contributors may be used to endorse or promote products derived
+     from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+ Author: Hendry F. Chame <hendryfchame@gmail.com>
+
+ Publication:
+
+   Chame, H. F., Ahmadi, A., & Tani, J. (2020).
+   A hybrid human-neurorobotics approach to primary intersubjectivity via
+   active inference. Frontiers in psychology, 11.
+
+   Okinawa Institute of Science and Technology Graduate University (OIST)
+   Cognitive Neurorobotics Research Unit (CNRU)
+   1919-1, Tancha, Onna, Kunigami District, Okinawa 904-0495, Japan
+
+-->*/
+
+
+
+#ifndef SRC_LAYER_PVRNN_LOWRANK_H_
+#define SRC_LAYER_PVRNN_LOWRANK_H_
+
+#include "../layer/LayerPvrnn.h"
+
+namespace oist {
+
+/**
+ * Factorized storage of the recurrent (Wdh) and cross-layer (Wdh_bottom, Wdh_top) weights of LayerPvrnnOf,
+ * with rank r as U*V^T, hence their products cost O(d*r) instead of O(d^2)
+ * */
+class RecurrentLowRank {
+
+	int rank;
+
+	// --- Parameters, the factors U (d_num x rank) and V (inputs x rank) of the weights W = U*V^T, indexed by RecurrentWeight
+
+	MatrixXf U[3];
+	MatrixXf V[3];
+
+	// --- Gradients and optimizer state (see IOptimizer)
+
+	MatrixXf g_U[3];
+	MatrixXf g_V[3];
+	MatrixXf m_U[3];
+	MatrixXf m_V[3];
+	MatrixXf v_U[3];
+	MatrixXf v_V[3];
+
+	VectorXf proj;			// pre-allocated projections on the rank r factors
+	RowVectorXf proj_t;
+
+public:
+
+	// the specialized generation steps are available for the dense weights only
+	static const bool factorized = true;
+
+	/**
+	 * Constructor
+	 * @param rank Rank of the factorized recurrent and cross-layer weights
+	 * */
+	RecurrentLowRank(int rank);
+
+	/**
+	 * Initializes the factors of a weight, their gradients and their optimizer state. The variance of
+	 * the product (rank/rank/inputs) is the one of the dense initialization (1/inputs)
+	 * */
+	void initialize(Utils* ut, RecurrentWeight weight, int rows, int cols, IOptimizer* optimizer);
+
+	void getBuffers(RecurrentWeight weight, vector<string>& names, vector<MatrixXf*>& p, vector<MatrixXf*>& g, vector<MatrixXf*>& m, vector<MatrixXf*>& v);
+
+	/**
+	 * The factors are already reduced by the factorization, only the dense matrices of the layer are pruned
+	 * */
+	void getPrunable(RecurrentWeight, vector<MatrixXf*>&){}
+
+	/**
+	 * Computes the product U*(V^T*x), projecting the input on the rank r factor first
+	 * */
+	void product(RecurrentWeight weight, const VectorXf& x, VectorXf& out){
+		proj.noalias() = V[weight].transpose()*x;
+		out.noalias() = U[weight]*proj;
+	}
+
+	void backward(RecurrentWeight weight, const VectorXf& g, VectorXf& out){
+		if (weight == RECURRENT){
+			proj.noalias() = U[weight].transpose()*g;
+			out.noalias() = V[weight]*proj;
+		}
+		else{
+			proj.noalias() = V[weight].transpose()*g;
+			out.noalias() = U[weight]*proj;
+		}
+	}
+
+	/**
+	 * Accumulates the gradients of the factors, given the gradient g*x^T of W = U*V^T, i.e. g*(V^T*x)^T for U and x*(U^T*g)^T for V
+	 * */
+	void addGradient(RecurrentWeight weight, const VectorXf& g, const VectorXf& x){
+		proj_t.noalias() = x.transpose()*V[weight];
+		g_U[weight].noalias() += g*proj_t;
+		proj_t.noalias() = g.transpose()*U[weight];
+		g_V[weight].noalias() += x*proj_t;
+	}
+
+	void gemv(RecurrentWeight weight, const float* x, float* out){
+		proj.noalias() = V[weight].transpose()*Map<const VectorXf>(x, V[weight].rows());
+		kernels->gemv(U[weight].data(), proj.data(), out, U[weight].rows(), rank);
+	}
+
+	void update(){
+		// the products use the factors directly
+	}
+};
+
+/**
+ * Layer type PV-RNN whose recurrent and cross-layer weights are factorized, the other weights and the states are the
+ * ones of LayerPvrnn. The members below are specialized, since the factorized layers keep their weights in single
+ * precision with dense products
+ * */
+typedef LayerPvrnnOf<RecurrentLowRank> LayerPvrnnLowRank;
+
+/**
+ * Prunes the weights by magnitude, the products of the factorized layer are not sped up by the pruned entries
+ * @param sparsity Fraction of pruned entries of each matrix, used when the threshold is negative
+ * @param threshold Magnitude threshold shared with the other layers, or negative
+ * */
+template <> void LayerPvrnnOf<RecurrentLowRank>::t_prune(float sparsity, float threshold);
+
+/**
+ * Sets the storage precision of the weights of the generation steps. The factorized layer keeps
+ * its weights in single precision, since they are already reduced by the factorization
+ * @param precision Precision, an exception is thrown for any precision but PRECISION_FP32
+ * */
+template <> void LayerPvrnnOf<RecurrentLowRank>::setPrecision(Precision precision);
+
+/**
+ * Sets the maximum density of the pruned weights copied in the sparse format. The factorized layer
+ * keeps the dense products, whose cost is dominated by the factors, hence an exception is always thrown
+ * @param density Maximum fraction of non-zero entries
+ * */
+template <> void LayerPvrnnOf<RecurrentLowRank>::setSparseDensity(float density);
+
+/**
+ * The factorized layer has no specialized generation steps, the dynamic step is always used
+ * */
+template <> void LayerPvrnnOf<RecurrentLowRank>::generationStep(const float* au, const float* al, const float* d_bottom, const float* d_top,
+		float* h, float* d, float* u, float* l, float* s, float* n, float* z);
+
+} /* namespace oist */
+
+#endif /* SRC_LAYER_PVRNN_LOWRANK_H_ */
@@ -49,6 +49,8 @@
 
 
 #include "LibNRL.h"
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace oist {
 
@@ -65,7 +67,13 @@ LibNRL::LibNRL() : dataPrefix("primitive") {
 		propPath = string("");
 
 		dataset = nullptr;
+		YStream = nullptr;
+		reducer = nullptr;
+		workerRank = 0;
+		nWorkers = 1;
 		model = nullptr;
+		optimizer = nullptr;
+		aOptimizer = nullptr;
 		logFile = nullptr;
 		robot = nullptr;
 		ut = Utils::getInstance();
@@ -75,6 +83,7 @@ LibNRL::LibNRL() : dataPrefix("primitive") {
 		robotName = string("");
 		networkName = string("");
 		strEpoch = string("");
+		strCheckpoint = string("");
 		propPath = string("");
 		stdoutLog = false;
 
@@ -83,11 +92,25 @@ LibNRL::LibNRL() : dataPrefix("primitive") {
 		seqLen = 0;
 
 		loaded = false;;
+		inferenceOnly = false;
+		binaryCheckpoint = false;
+		saveBufferId = 0;
+		saveError = string("");
+		v_async = false;
+		v_size = 0;
+		v_model = nullptr;
+		v_done = true;
+		v_step = 0;
+		v_recError = 0.0;
+		v_pendingStep = 0;
+		v_result = 0.0;
 		dsoft = 10;
 		sigma = 0.2;
+		sparseTol = 0.0;
 		maxLoss = std::numeric_limits<float>::max();
 
 		// variables for training mode
+		t_enrollId = -1;
 		t_nEpoch = 0;
 		t_step = 1;
 		t_alpha = 0.001;
@@ -109,18 +132,40 @@ LibNRL::LibNRL() : dataPrefix("primitive") {
 
 
 	void LibNRL::newModel(string path){
+		createModel(path, string(""));
+	}
+
+	void LibNRL::newInference(string path, string exportPath){
+		createModel(path, exportPath);
+	}
+
+	void LibNRL::createModel(string path, string exportPath){
 
 		deallocate();
 
+		// the models created from an exported file skip the data-set encoding and the training memory
+		bool inference = !exportPath.empty();
+
 		propPath = path;
 
+		// kernels of the best instruction set of the CPU, unless overridden by the NRL_ISA environment variable
+		string isa = selectKernels();
+		cout << "Instruction set: " << isa << endl;
+
 		map<string,float1DContainer> float1DMap;
 		map<string,string> stringMap;
 		map<string,bool> boolMap;
 
 		loaded = false;
+		inferenceOnly = false;
+		binaryCheckpoint = false;
 		dsoft = 10;
 		sigma = 0.2;
+		sparseTol = 0.0;
+		v_async = false;
+		v_size = 0;
+		v_step = 0;
+		v_recError = 0.0;
 
 		t_retrain = false;
 		t_nEpoch = 0;
@@ -157,6 +202,29 @@ LibNRL::LibNRL() : dataPrefix("primitive") {
 			if(stringMap.find("robot") == stringMap.end()) throw Exception("'robot' property not found");
 			robotName = stringMap["robot"];
 
+			// optional property, the workers launched by the same process share the session by default
+			session = (stringMap.find("session") != stringMap.end()) ? stringMap["session"] : to_string(getppid());
+
+			// optional property, the text format is kept by default
+			if(stringMap.find("checkpoint") != stringMap.end()){
+				if (stringMap["checkpoint"] == "binary")
+					binaryCheckpoint = true;
+				else if (stringMap["checkpoint"] != "text"){
+					stringstream stream;
+					stream << "unknown 'checkpoint' property [" << stringMap["checkpoint"] << "]";
+					throw Exception(stream.str());
+				}
+			}
+
+			// optional properties, Adam is used by default, and the A variables use the optimizer of the weights
+			string optimizerName = "adam";
+			if(stringMap.find("optimizer") != stringMap.end())
+				optimizerName = stringMap["optimizer"];
+			optimizer = createOptimizer(optimizerName);
+			if(stringMap.find("aoptimizer") != stringMap.end())
+				optimizerName = stringMap["aoptimizer"];
+			aOptimizer = createOptimizer(optimizerName);
+
 			if(boolMap.find("shuffle") == boolMap.end()) throw Exception("'shuffle' property not found");
 			t_shuffle = boolMap["shuffle"];
 
@@ -197,8 +265,9 @@ LibNRL::LibNRL() : dataPrefix("primitive") {
 			stringstream stream;
 			stream << modelPath << "/epoch.d";
 			strEpoch = stream.str();
+			strCheckpoint = modelPath + "/model.ckpt";
 
-			if (t_retrain){
+			if (t_retrain && !inference){
 				ifstream eFile(strEpoch);
 				if (!eFile.is_open()){
 					cout << "Warning: the file [" << strEpoch << "] is unavailable, retrain set false";
@@ -225,27 +294,81 @@ LibNRL::LibNRL() : dataPrefix("primitive") {
 			}
 
 			dataset = new oist::Dataset(dataPath, dataPrefix, nSamples, dsoft, sigma, ut, robot);
-			dataset->encodeSoftmax(YSoftmax);
+			// optional property, the encoded data-set is not cached by default
+			if(boolMap.find("datacache") != boolMap.end())
+				dataset->setCache(boolMap["datacache"]);
+
+			// optional property, the training targets are truncated below the tolerance
+			if(float1DMap.find("sparsetol") != float1DMap.end())
+				sparseTol = float1DMap["sparsetol"][0];
+
+			Checkpoint ckpt;
+			if (inference){
+				// only the length of the sequences is required, it is stored in the exported file
+				ckpt.read(exportPath, true);
+				float1DContainer fSeqLen;
+				if (!ckpt.getMeta("length", fSeqLen) || fSeqLen.empty())
+					throw Exception("The exported file does not store the length of the sequences, the model should be exported again");
+				dataset->setPrimLength(int(fSeqLen[0]));
+			}
+			// optional property, the encoded data-set is kept in memory by default
+			else if(float1DMap.find("streambudget") != float1DMap.end() && float1DMap["streambudget"][0] > 0.0){
+				size_t budget = (size_t)(float1DMap["streambudget"][0]*1024.0*1024.0);
+				// one file per process, since the workers of a distributed training share the model directory
+				stringstream streamFile; streamFile << modelPath << "/dataset" << getpid() << ".stream";
+				YStream = new DataStream(streamFile.str(), budget, sparseTol > 0.0);
+				float ratio = dataset->encodeSoftmax(*YStream, sparseTol, YEntropy);
+				if (sparseTol > 0.0)
+					cout << "Sparse targets: " << ratio*100.0 << "% of the encoding units are stored" << endl;
+			}
+			else{
+				dataset->encodeSoftmax(YSoftmax);
+				if (sparseTol > 0.0){
+					float ratio = dataset->truncateSoftmax(YSoftmax, sparseTol, YSparse);
+					YSoftmax.clear();
+					dataset->targetEntropy(YSparse, YEntropy);
+					cout << "Sparse targets: " << ratio*100.0 << "% of the encoding units are stored" << endl;
+				}
+				else
+					dataset->targetEntropy(YSoftmax, YEntropy);
+			}
 
 			nSeq = nSamples.size();
 
 			t_prim_Ids.clear();
 			for (int i = 0; i < nSeq; i++)
 				t_prim_Ids.push_back(i);
+			e_prim_Ids = t_prim_Ids;
+			t_enrollId = -1;
 
 			nDof = ((float)robot->getDOF())*1.0;
 			seqLen = dataset->getPrimLength();
 
-			if (networkName == "pvrnn")
-				model = new NetworkPvrnn(float1DMap, dataset);
-			else if (networkName == "pvrnnbeta")
-				model = new NetworkPvrnnBeta(float1DMap, dataset);
-			else{
-				stringstream stream;
-				stream << "unknown 'network' property [" << networkName << "]";
-				throw Exception(stream.str());
+			model = createNetwork(float1DMap, inference);
+
+			if (inference){
+				loadInference(ckpt);
+				cout << "Model loaded!" << endl;
+				return;
 			}
 
+			// optional property, all the parameters are trained by default
+			if(stringMap.find("freeze") != stringMap.end()){
+				freezeSpec = stringMap["freeze"];
+				freezeModel(model, freezeSpec, float1DMap["d"].size());
+			}
+
+			// optional properties, all the primitives are validated in the training thread by default
+			if(boolMap.find("asyncvalidation") != boolMap.end())
+				v_async = boolMap["asyncvalidation"];
+			if(float1DMap.find("validationsize") != float1DMap.end())
+				v_size = int(float1DMap["validationsize"][0]);
+			if (v_async && YStream != nullptr){
+				cout << "Warning: the streamed data-set is validated in the training thread, 'asyncvalidation' set false" << endl;
+				v_async = false;
+			}
+			v_props = float1DMap;
+
 
 		}catch(Exception& _e){
 			cout << "Error: " << _e.what() << endl;
@@ -299,14 +422,846 @@ LibNRL::LibNRL() : dataPrefix("primitive") {
 			cout << modelNUllMsg << endl;
 			return;
 		}
+		if (inferenceOnly){
+			cout << "Warning: The model was loaded for inference only, a new model should be created before calling load!" << endl;
+			return;
+		}
 		try{
-			model->load(string(modelPath));
+			loadModel();
 			loaded = true;
 		}catch(oist::Exception& e){
 			cout << "Error: "<<  e.what() << endl;
 		}
 	}
 
+	void LibNRL::exportInference(string path, int* pIDs, int n){
+		if (model == nullptr){
+			cout << modelNUllMsg << endl;
+			return;
+		}
+		if (loaded == false){
+			cout << "Warning: The model should be loaded before calling exportInference!" << endl;
+			return;
+		}
+		try{
+			int1DContainer prim_Ids;
+			if (n <= 0)
+				prim_Ids = e_prim_Ids;
+			for (int i = 0; i < n; i++){
+				if (find(e_prim_Ids.begin(), e_prim_Ids.end(), pIDs[i]) == e_prim_Ids.end()){
+					stringstream stream;
+					stream << "The primitive ID " << pIDs[i] << " is not available in the model";
+					throw Exception(stream.str());
+				}
+				if (find(prim_Ids.begin(), prim_Ids.end(), pIDs[i]) == prim_Ids.end())
+					prim_Ids.push_back(pIDs[i]);
+			}
+
+			Checkpoint ckpt;
+			ckpt.setMeta("inference", 1.0f);
+			ckpt.setMeta("primitives", float1DContainer(prim_Ids.begin(), prim_Ids.end()));
+			ckpt.setMeta("length", (float)seqLen);
+			model->exportInference(&ckpt, prim_Ids);
+			ckpt.write(path);
+			cout << "Model exported to [" << path << "]" << endl;
+		}catch(oist::Exception& e){
+			cout << "Error: "<<  e.what() << endl;
+		}
+	}
+
+	void LibNRL::loadInference(string path){
+		if (model == nullptr){
+			cout << modelNUllMsg << endl;
+			return;
+		}
+		if (inferenceOnly){
+			cout << "Warning: The model was already loaded for inference, a new model should be created before calling loadInference!" << endl;
+			return;
+		}
+		try{
+			waitValidation(true);
+			waitSave();
+
+			Checkpoint ckpt;
+			ckpt.read(path, true);
+			loadInference(ckpt);
+			cout << "Model loaded!" << endl;
+		}catch(oist::Exception& e){
+			// the parameters may be partially overwritten, the model should be loaded again
+			loaded = false;
+			cout << "Error: "<<  e.what() << endl;
+		}
+	}
+
+	void LibNRL::loadInference(Checkpoint& ckpt){
+
+		float1DContainer fPrimIds;
+		if (!ckpt.getMeta("primitives", fPrimIds))
+			throw Exception("The checkpoint was not exported for inference");
+
+		int1DContainer prim_Ids;
+		for (unsigned int i = 0; i < fPrimIds.size(); i++){
+			int pID = int(fPrimIds[i]);
+			if (pID < 0 || pID > nSeq - 1){
+				stringstream stream;
+				stream << "The exported primitive ID " << pID << " is not available in the data-set";
+				throw Exception(stream.str());
+			}
+			prim_Ids.push_back(pID);
+		}
+
+		// the training memory is released once the model is loaded, the model cannot be trained anymore
+		model->loadInference(&ckpt, prim_Ids);
+		inferenceOnly = true;
+		e_prim_Ids = prim_Ids;
+		loaded = true;
+	}
+
+	void LibNRL::appendData(int* samples, int n){
+		if (model == nullptr){
+			cout << modelNUllMsg << endl;
+			return;
+		}
+		if (inferenceOnly){
+			cout << "Error: the model was loaded for inference only, the data-set cannot be extended" << endl;
+			return;
+		}
+		if (YStream != nullptr){
+			cout << "Error: the streamed data-set cannot be extended" << endl;
+			return;
+		}
+		if (reducer != nullptr){
+			cout << "Error: the data-set of a distributed training cannot be extended" << endl;
+			return;
+		}
+
+		// the validation replica is created again with the new primitives
+		waitValidation(true);
+		if (v_model != nullptr)
+			delete v_model;
+		v_model = nullptr;
+
+		try{
+			int1DContainer newSamples(samples, samples + n);
+			tensorXf1DContainer Y;
+			int added = dataset->appendSoftmax(newSamples, Y);
+
+			// only the new samples are encoded, they are moved to the end of each primitive
+			float1DContainer ent;
+			if (sparseTol > 0.0){
+				sparseXf4DContainer sp;
+				dataset->truncateSoftmax(Y, sparseTol, sp);
+				dataset->targetEntropy(sp, ent);
+				YSparse.resize(n);
+				for (int p = 0; p < n; p++)
+					YSparse[p].insert(YSparse[p].end(), make_move_iterator(sp[p].begin()), make_move_iterator(sp[p].end()));
+			}else{
+				dataset->targetEntropy(Y, ent);
+				YSoftmax.resize(n);
+				for (int p = 0; p < n; p++)
+					YSoftmax[p].append(Y[p]);
+			}
+			YEntropy.resize(n, 0.0);
+			for (int p = 0; p < n; p++)
+				YEntropy[p] += ent[p];
+
+			if (added > 0){
+				model->addPrimitives(added);
+				for (int p = nSeq; p < n; p++){
+					if (t_enrollId < 0 && owns(p))
+						t_prim_Ids.push_back(p);
+					e_prim_Ids.push_back(p);
+				}
+				nSeq = n;
+			}
+			nSamples = newSamples;
+
+			// the loss is not comparable with the one of the former data-set
+			maxLoss = std::numeric_limits<float>::max();
+			cout << "Data-set extended. Primitive number: " << nSeq << endl;
+		}catch(oist::Exception& e){
+			cout << "Error: "<<  e.what() << endl;
+		}
+	}
+
+	void LibNRL::t_enroll(int pID){
+		if (model == nullptr){
+			cout << modelNUllMsg << endl;
+			return;
+		}
+		if (inferenceOnly){
+			cout << "Error: the model was loaded for inference only, training is unavailable" << endl;
+			return;
+		}
+		if (pID > nSeq - 1){
+			cout << "Warning: the primitive ID "<< pID << " is greater than " << nSeq-1 << " available IDs. The enrollment is not changed" << endl;
+			return;
+		}
+
+		waitValidation(true);
+
+		// only the enrolled primitive is forwarded and back-propagated, since the weights are frozen
+		t_enrollId = (pID < 0) ? -1 : pID;
+		model->t_enroll(t_enrollId);
+		t_prim_Ids.clear();
+		for (int i = 0; i < nSeq; i++){
+			if ((t_enrollId < 0 || i == t_enrollId) && owns(i))
+				t_prim_Ids.push_back(i);
+		}
+
+		// the loss is not comparable with the one of the former training set
+		maxLoss = std::numeric_limits<float>::max();
+	}
+
+	void LibNRL::t_prune(float sparsity, bool global){
+		if (model == nullptr){
+			cout << modelNUllMsg << endl;
+			return;
+		}
+		if (inferenceOnly){
+			cout << "Error: the model was loaded for inference only, training is unavailable" << endl;
+			return;
+		}
+		if (sparsity < 0.0 || sparsity >= 1.0){
+			cout << "Error: the sparsity " << sparsity << " should be in [0, 1). The model is not pruned" << endl;
+			return;
+		}
+
+		try{
+			waitValidation(true);
+			model->t_prune(sparsity, global);
+			cout << "Model pruned. Sparsity: " << sparsity << (global ? " (global)" : " (per matrix)") <<
+					", generation weights: " << model->getGenerationBytes()/1024.0 << " kB" << endl;
+		}catch(oist::Exception& e){
+			cout << "Error: "<<  e.what() << endl;
+			return;
+		}
+
+		// the loss is not comparable with the one of the former model
+		maxLoss = std::numeric_limits<float>::max();
+	}
+
+	void LibNRL::t_sweep(string path, int nThreads){
+		if (model == nullptr){
+			cout << modelNUllMsg << endl;
+			return;
+		}
+		if (inferenceOnly){
+			cout << "Error: the model was loaded for inference only, training is unavailable" << endl;
+			return;
+		}
+		if (YStream != nullptr){
+			cout << "Error: the streamed data-set cannot be shared by the sweep runs" << endl;
+			return;
+		}
+		if (t_enrollId >= 0){
+			cout << "Error: the sweep runs train the whole model, the enrollment should be disabled" << endl;
+			return;
+		}
+		if (reducer != nullptr){
+			cout << "Error: the sweep runs cannot be distributed" << endl;
+			return;
+		}
+
+		try{
+			waitValidation(true);
+			waitSave();
+
+			ifstream file(path);
+			if (!file.is_open()){
+				stringstream stream;
+				stream << "The sweep file [" << path << "] could not be opened";
+				throw Exception(stream.str());
+			}
+
+			// the data-set properties are fixed, since the encoded data-set is shared
+			const string fixed[] = {"dsoft", "sigma", "nsamples", "activejoints", "sparsetol", "streambudget", "validationsize"};
+
+			map<string,float1DContainer> base = v_props;
+			base["epochs"] = float1DContainer(1, (float)t_nEpoch);
+			base["alpha"] = float1DContainer(1, t_alpha);
+			base["beta1"] = float1DContainer(1, t_beta1);
+			base["beta2"] = float1DContainer(1, t_beta2);
+
+			vector<SweepRun> runs;
+			string line;
+			while (getline(file, line)){
+				ut->trim(line, " \t\r\n");
+				if (line.empty() || line[0] == '#')
+					continue;
+
+				SweepRun run;
+				run.id = runs.size();
+				run.spec = line;
+				run.props = base;
+				run.step = 0;
+				run.loss = 0.0;
+				run.recError = 0.0;
+
+				istringstream tokens(line);
+				string token;
+				while (tokens >> token){
+					size_t pos = token.find('=');
+					string key = token.substr(0, pos);
+					ut->tolower(key);
+					if (pos == std::string::npos || base.find(key) == base.end() ||
+						find(begin(fixed), end(fixed), key) != end(fixed)){
+						stringstream stream;
+						stream << "invalid property of the sweep run " << run.id << " [" << token << "]";
+						throw Exception(stream.str());
+					}
+					vector<string> values;
+					ut->split(values, token.substr(pos + 1));
+					float1DContainer value;
+					for (unsigned int i = 0; i < values.size(); i++){
+						try{
+							value.push_back(std::stof(values[i]));
+						}catch(...){
+							stringstream stream;
+							stream << "invalid value of the sweep run " << run.id << " [" << token << "]";
+							throw Exception(stream.str());
+						}
+					}
+					run.props[key] = value;
+				}
+
+				// the cost of an epoch is dominated by the recurrent weights of the layers
+				double cost = 0.0;
+				float1DContainer& d = run.props["d"];
+				float1DContainer& z = run.props["z"];
+				for (unsigned int l = 0; l < d.size(); l++)
+					cost += d[l]*(d[l] + (l < z.size() ? z[l] : 0.0));
+				run.cost = cost*run.props["epochs"][0];
+
+				stringstream strm; strm << modelPath << "/sweep" << run.id;
+				run.path = strm.str();
+				if (mkdir(run.path.c_str(), 0755) != 0 && errno != EEXIST){
+					stringstream stream;
+					stream << "The directory of the sweep run [" << run.path << "] could not be created";
+					throw Exception(stream.str());
+				}
+				runs.push_back(run);
+			}
+			if (runs.empty())
+				throw Exception("The sweep file does not contain any run");
+
+			vector<int> order;
+			for (unsigned int i = 0; i < runs.size(); i++)
+				order.push_back(i);
+			sort(order.begin(), order.end(), [&runs](int a, int b){ return runs[a].cost > runs[b].cost; });
+
+			if (nThreads <= 0)
+				nThreads = std::max(1u, std::thread::hardware_concurrency());
+			nThreads = std::min(nThreads, (int)runs.size());
+			cout << "Sweep of " << runs.size() << " runs in " << nThreads << " threads" << endl;
+
+			// the threads take the next pending run, so that all of them are busy until the last runs
+			std::atomic<int> next(0);
+			vector<std::thread> pool;
+			for (int i = 0; i < nThreads; i++){
+				pool.push_back(std::thread([this, &runs, &order, &next](){
+					int k;
+					while ((k = next++) < (int)order.size())
+						trainRun(runs[order[k]]);
+				}));
+			}
+			for (unsigned int i = 0; i < pool.size(); i++)
+				pool[i].join();
+
+			ofstream summary(modelPath + "/sweep.txt", std::ofstream::out);
+			for (unsigned int i = 0; i < runs.size(); i++){
+				summary << "Run [" << runs[i].id << "] - Properties [" << runs[i].spec << "] - ";
+				if (runs[i].error.empty())
+					summary << "Epoch [" << runs[i].step << "] - RE_P [" << runs[i].recError << "] - loss [" << runs[i].loss << "]" << endl;
+				else
+					summary << "Error [" << runs[i].error << "]" << endl;
+			}
+			cout << "Sweep end" << endl;
+		}catch(oist::Exception& e){
+			cout << "Error: "<<  e.what() << endl;
+		}
+	}
+
+	void LibNRL::t_distribute(int rank, int workers){
+		if (model == nullptr){
+			cout << modelNUllMsg << endl;
+			return;
+		}
+		if (inferenceOnly){
+			cout << "Error: the model was loaded for inference only, training is unavailable" << endl;
+			return;
+		}
+
+		try{
+			waitValidation(true);
+			waitSave();
+			if (reducer != nullptr)
+				delete reducer;
+			reducer = nullptr;
+			workerRank = 0;
+			nWorkers = 1;
+			model->t_own(bool1DContainer());
+
+			if (workers > 1){
+				// the shared buffers are sized for the weight gradients, and for the A variables gathered by the checkpoints
+				vector<Map<VectorXf> > sum, gather;
+				model->t_gradients(sum);
+				for (int pId = 0; pId < nSeq; pId++)
+					model->t_variables(pId, gather);
+				size_t capacity = 3, gatherCapacity = 0;
+				for (unsigned int i = 0; i < sum.size(); i++)
+					capacity += sum[i].size();
+				for (unsigned int i = 0; i < gather.size(); i++)
+					gatherCapacity += gather[i].size();
+
+				// the workers of the same model and session share the segment
+				stringstream name;
+				name << "/nrl_" << std::hex << std::hash<string>()(modelPath) << "_" << std::hash<string>()(session);
+				reducer = new AllReduce(name.str(), rank, workers, capacity, gatherCapacity);
+				workerRank = rank;
+				nWorkers = workers;
+
+				// each worker only optimizes the A variables of its primitives
+				bool1DContainer owned;
+				for (int pId = 0; pId < nSeq; pId++)
+					owned.push_back(owns(pId));
+				model->t_own(owned);
+
+				// each worker draws its own noise
+				if (rank > 0)
+					ut->seed(rank);
+				if (v_async){
+					cout << "Warning: the distributed training is validated in the training thread, 'asyncvalidation' set false" << endl;
+					v_async = false;
+				}
+				cout << "Worker " << rank << " of " << workers << " attached" << endl;
+			}
+
+			t_prim_Ids.clear();
+			for (int i = 0; i < nSeq; i++){
+				if ((t_enrollId < 0 || i == t_enrollId) && owns(i))
+					t_prim_Ids.push_back(i);
+			}
+		}catch(oist::Exception& e){
+			cout << "Error: "<<  e.what() << endl;
+		}
+	}
+
+	void LibNRL::saveModel(int step, float loss){
+
+		// all the workers of a distributed training have the same weights, and the worker 0 gathers the A variables
+		if (reducer != nullptr)
+			gatherVariables();
+		if (workerRank > 0)
+			return;
+
+		if (binaryCheckpoint){
+			// the snapshot is taken in the idle buffer, so training only waits for
+			// the previous checkpoint if it is still being written
+			Checkpoint* ckpt = &saveBuffer[saveBufferId];
+			ckpt->clear();
+			ckpt->setMeta("epoch", (float)step);
+			ckpt->setMeta("loss", loss);
+			model->save(ckpt);
+
+			waitSave();
+			saveThread = std::thread(&LibNRL::writeCheckpoint, this, ckpt, step, loss);
+			saveBufferId = 1 - saveBufferId;
+		}
+		else{
+			model->save(modelPath);
+			writeEpoch(strEpoch, step, loss);
+		}
+	}
+
+	void LibNRL::writeCheckpoint(Checkpoint* ckpt, int step, float loss){
+		try{
+			ckpt->write(strCheckpoint);
+			writeEpoch(strEpoch, step, loss);
+		}catch(Exception& _e){
+			saveError = _e.what();
+		}catch(...){
+			saveError = string("unknown exception when writing the checkpoint");
+		}
+	}
+
+	void LibNRL::writeEpoch(const string& file, int step, float loss){
+		ofstream eFile(file,std::ofstream::out);
+		if (eFile.is_open()){
+			eFile << step << ut->getDelimiter() << loss;
+			eFile.close();
+		}
+	}
+
+	void LibNRL::waitSave(){
+		if (saveThread.joinable())
+			saveThread.join();
+		if (!saveError.empty()){
+			cout << "Error: " << saveError << endl;
+			if (logFile != nullptr && logFile->is_open())
+				*logFile << "Error: " << saveError << endl;
+			saveError.clear();
+		}
+	}
+
+	void LibNRL::freezeModel(INetwork* net, string spec, int nLayers){
+
+		int1DContainer groups(nLayers, 0);
+		bool output = false;
+
+		vector<string> tokens;
+		ut->split(tokens, spec);
+
+		for (unsigned int i = 0; i < tokens.size(); i++){
+			string& token = tokens[i];
+			if (token.empty())
+				continue;
+
+			int layer = -1;
+			int group = GROUP_ALL;
+			string strGroup = token;
+
+			if (token.size() > 1 && token[0] == 'l'){
+				size_t sep = token.find('_');
+				string strLayer = token.substr(1, sep == std::string::npos ? std::string::npos : sep - 1);
+				strGroup = (sep == std::string::npos) ? "" : token.substr(sep + 1);
+				if (strLayer.empty() || strLayer.find_first_not_of("0123456789") != std::string::npos ||
+					(layer = std::stoi(strLayer)) >= nLayers){
+					stringstream stream;
+					stream << "invalid layer in the 'freeze' property [" << token << "]";
+					throw Exception(stream.str());
+				}
+			}
+
+			if (strGroup == "h") group = GROUP_H;
+			else if (strGroup == "p") group = GROUP_P;
+			else if (strGroup == "q") group = GROUP_Q;
+			else if (strGroup == "a") group = GROUP_A;
+			else if (strGroup == "o" && layer < 0){
+				output = true;
+				continue;
+			}
+			else if (!strGroup.empty() || layer < 0){
+				stringstream stream;
+				stream << "unknown group in the 'freeze' property [" << token << "]";
+				throw Exception(stream.str());
+			}
+
+			for (int l = 0; l < nLayers; l++){
+				if (layer < 0 || layer == l)
+					groups[l] |= group;
+			}
+		}
+		net->t_freeze(groups, output);
+	}
+
+	INetwork* LibNRL::createNetwork(map<string,float1DContainer>& props, bool inference){
+
+		// the networks without optimizer of the weights allocate no gradients, Adam moments and A variables
+		IOptimizer* wOptimizer = inference ? nullptr : optimizer;
+		if (networkName == "pvrnn")
+			return new NetworkPvrnn(props, dataset, wOptimizer, aOptimizer);
+		else if (networkName == "pvrnnbeta")
+			return new NetworkPvrnnBeta(props, dataset, wOptimizer, aOptimizer);
+		else if (networkName == "pvrnnlr")
+			return new NetworkPvrnnLowRank(props, dataset, wOptimizer, aOptimizer);
+
+		stringstream stream;
+		stream << "unknown 'network' property [" << networkName << "]";
+		throw Exception(stream.str());
+	}
+
+	IOptimizer* LibNRL::createOptimizer(const string& name){
+
+		if (name == "adam")
+			return new OptimizerAdam();
+		else if (name == "factored")
+			return new OptimizerFactored();
+		else if (name == "momentum")
+			return new OptimizerMomentum();
+
+		stringstream stream;
+		stream << "unknown optimizer [" << name << "]";
+		throw Exception(stream.str());
+	}
+
+	void LibNRL::releaseOptimizers(){
+
+		if (optimizer != nullptr)
+			delete optimizer;
+		if (aOptimizer != nullptr)
+			delete aOptimizer;
+		optimizer = nullptr;
+		aOptimizer = nullptr;
+	}
+
+	void LibNRL::trainRun(SweepRun& run){
+
+		INetwork* net = nullptr;
+		ofstream log(run.path + "/training.txt", std::ofstream::out);
+
+		try{
+			int nEpoch = int(run.props["epochs"][0]);
+			float alpha = run.props["alpha"][0];
+			float beta1 = run.props["beta1"][0];
+			float beta2 = run.props["beta2"][0];
+
+			// the initialization draws from the global generator of Eigen, hence the runs are created one at a time
+			// with their own seed, so that a run does not depend on the scheduling
+			{
+				std::lock_guard<std::mutex> lock(sweepMutex);
+				std::srand(run.id + 1);
+				net = createNetwork(run.props);
+				if (!freezeSpec.empty())
+					freezeModel(net, freezeSpec, run.props["d"].size());
+			}
+			ut->seed(run.id);
+
+			int1DContainer prim_Ids;
+			for (int i = 0; i < nSeq; i++)
+				prim_Ids.push_back(i);
+
+			float best = std::numeric_limits<float>::max();
+			float loss = 0.0;
+			float reconstruction = 0.0;
+			float regulation = 0.0;
+			chrono::high_resolution_clock::time_point mst1 = chrono::high_resolution_clock::now();
+
+			// outputs of all the primitives of an epoch, refilled at each epoch
+			TensorXf All_X(net->getOutputUnits());
+			All_X.reserve(prim_Ids.size()*size_t(seqLen));
+
+			for (int step = 1; step <= nEpoch; step++){
+				All_X.clear();
+
+				if (t_shuffle)
+					ut->shuffle<int1DContainer>(&prim_Ids);
+
+				for (unsigned int i = 0; i < prim_Ids.size(); i++)
+					net->t_forward(seqLen, prim_Ids[i], All_X);
+
+				loss = 0.0;
+				reconstruction = 0.0;
+				regulation = 0.0;
+				for (unsigned int i = 0; i < prim_Ids.size(); i++)
+					backward(net, prim_Ids[i], All_X[i], reconstruction, regulation, loss);
+				net->t_optimize(step, alpha, beta1, beta2);
+
+				if (step % 100 == 0 || step == nEpoch){
+					float mseGen = validate(net);
+
+					chrono::high_resolution_clock::time_point mst2 = chrono::high_resolution_clock::now();
+					chrono::duration<double, std::milli> msdiff = mst2 - mst1;
+					float oTime = (float)msdiff.count();
+
+					log << "Epoch ["<< step <<
+						"] - Time ["<< oTime <<
+						"ms] - RE_Q ["<< reconstruction <<
+						"] - RE_P ["<< mseGen <<
+						"] - Regulation ["<< regulation <<
+						"] - loss [" << loss << "]" << endl;
+
+					if (best > loss || !t_greedy){
+						best = loss;
+						if (binaryCheckpoint){
+							Checkpoint ckpt;
+							ckpt.setMeta("epoch", (float)step);
+							ckpt.setMeta("loss", loss);
+							net->save(&ckpt);
+							ckpt.write(run.path + "/model.ckpt");
+						}
+						else
+							net->save(run.path);
+						writeEpoch(run.path + "/epoch.d", step, loss);
+						run.step = step;
+						run.loss = loss;
+						run.recError = mseGen;
+						log << "The model has been saved" << endl;
+					}
+					mst1 = chrono::high_resolution_clock::now();
+				}
+			}
+		}catch(Exception& _e){
+			run.error = _e.what();
+		}catch(...){
+			run.error = string("unknown exception when training the run");
+		}
+
+		if (!run.error.empty())
+			log << "Error: " << run.error << endl;
+		log << endl << "Training  end" << endl;
+
+		std::lock_guard<std::mutex> lock(sweepMutex);
+		if (net != nullptr)
+			delete net;
+		cout << "Sweep run [" << run.id << "] end" << (run.error.empty() ? "" : " with errors") << endl;
+	}
+
+	bool LibNRL::owns(int pID){
+		return pID % nWorkers == workerRank;
+	}
+
+	void LibNRL::reduceGradients(float& rec, float& reg, float& loss){
+
+		float errors[3] = {rec, reg, loss};
+		vector<Map<VectorXf> > sum, gather;
+		model->t_gradients(sum);
+		sum.push_back(Map<VectorXf>(errors, 3));
+		reducer->reduce(sum, gather, int1DContainer());
+
+		rec = errors[0];
+		reg = errors[1];
+		loss = errors[2];
+	}
+
+	void LibNRL::gatherVariables(){
+
+		vector<Map<VectorXf> > sum, gather;
+		int1DContainer owner;
+		for (int pId = 0; pId < nSeq; pId++){
+			model->t_variables(pId, gather);
+			owner.resize(gather.size(), pId % nWorkers);
+		}
+		reducer->reduce(sum, gather, owner);
+	}
+
+	void LibNRL::backward(INetwork* net, int pID, const SequenceViewXf& X, float& rec, float& reg, float& loss){
+
+		if (YStream != nullptr){
+			if (YStream->isSparse())
+				net->t_backward(pID, X, YStream->getSparse(pID), YEntropy[pID], rec, reg, loss);
+			else
+				net->t_backward(pID, X, YStream->getDense(pID), YEntropy[pID], rec, reg, loss);
+			YStream->release(pID);
+		}
+		else if (sparseTol > 0.0)
+			net->t_backward(pID, X, YSparse[pID], YEntropy[pID], rec, reg, loss);
+		else
+			net->t_backward(pID, X, YSoftmax[pID], YEntropy[pID], rec, reg, loss);
+	}
+
+	float LibNRL::recError(INetwork* net, int pID, const SequenceViewXf& X){
+
+		float error;
+		if (YStream != nullptr){
+			if (YStream->isSparse())
+				error = net->getRecError(X, YStream->getSparse(pID), YEntropy[pID]);
+			else
+				error = net->getRecError(X, YStream->getDense(pID), YEntropy[pID]);
+			YStream->release(pID);
+		}
+		else if (sparseTol > 0.0)
+			error = net->getRecError(X, YSparse[pID], YEntropy[pID]);
+		else
+			error = net->getRecError(X, YSoftmax[pID], YEntropy[pID]);
+		return error;
+	}
+
+	float LibNRL::validate(INetwork* net){
+
+		int1DContainer pIDs;
+		for (int pId = 0; pId < nSeq; pId++){
+			if ((t_enrollId < 0 || pId == t_enrollId) && owns(pId))
+				pIDs.push_back(pId);
+		}
+		if (v_size > 0 && v_size < (int)pIDs.size()){
+			ut->shuffle<int1DContainer>(&pIDs);
+			pIDs.resize(v_size);
+			sort(pIDs.begin(), pIDs.end());
+		}
+
+		if (YStream != nullptr)
+			YStream->prefetch(pIDs);
+
+		float mseGen = 0.0;
+		TensorXf X(net->getOutputUnits());
+		X.reserve(pIDs.size()*size_t(seqLen));
+		for (unsigned int i = 0; i < pIDs.size(); i++){
+			net->t_generate(seqLen, pIDs[i], X);
+			mseGen += recError(net, pIDs[i], X[i]);
+		}
+		return mseGen;
+	}
+
+	float LibNRL::validation(int step){
+
+		if (!v_async){
+			float mseGen = validate(model);
+			return (reducer != nullptr) ? reducer->sum(mseGen) : mseGen;
+		}
+
+		// a new snapshot is only taken once the previous one is evaluated
+		if (waitValidation(false)){
+			int1DContainer pIDs;
+			for (int pId = 0; pId < nSeq; pId++)
+				pIDs.push_back(pId);
+
+			// the replica only needs the parameters and the A variables, not the Adam moments
+			v_snapshot.clear();
+			model->exportInference(&v_snapshot, pIDs);
+			v_pendingStep = step;
+			v_done = false;
+			v_thread = std::thread(&LibNRL::runValidation, this);
+		}
+		return v_recError;
+	}
+
+	void LibNRL::runValidation(){
+		try{
+			if (v_model == nullptr)
+				v_model = createNetwork(v_props, true);
+			int1DContainer pIDs;
+			for (int pId = 0; pId < nSeq; pId++)
+				pIDs.push_back(pId);
+			v_model->loadInference(&v_snapshot, pIDs);
+			v_result = validate(v_model);
+		}catch(Exception& _e){
+			v_error = _e.what();
+		}catch(...){
+			v_error = string("unknown exception when validating the parameter snapshot");
+		}
+		v_done = true;
+	}
+
+	bool LibNRL::waitValidation(bool wait){
+		if (!v_thread.joinable())
+			return true;
+		if (!wait && !v_done)
+			return false;
+		v_thread.join();
+
+		bool logged = (logFile != nullptr && logFile->is_open());
+		if (!v_error.empty()){
+			cout << "Error: " << v_error << endl;
+			if (logged)
+				*logFile << "Error: " << v_error << endl;
+			v_error.clear();
+		}
+		else{
+			v_step = v_pendingStep;
+			v_recError = v_result;
+			if (stdoutLog)
+				cout << "Validation - Epoch [" << v_step << "] - RE_P [" << v_recError << "]" << endl;
+			if (logged)
+				*logFile << "Validation - Epoch [" << v_step << "] - RE_P [" << v_recError << "]" << endl;
+		}
+		return true;
+	}
+
+	void LibNRL::loadModel(){
+
+		waitSave();
+
+		// a binary model falls back to the text files, which allows converting older models
+		if (binaryCheckpoint && Checkpoint::exists(strCheckpoint)){
+			Checkpoint ckpt;
+			ckpt.read(strCheckpoint, true);
+			model->load(&ckpt);
+		}
+		else
+			model->load(modelPath);
+	}
+
 	// ------------- training mode ---------------------
 
 	void LibNRL::t_init(bool show){
@@ -314,10 +1269,17 @@ LibNRL::LibNRL() : dataPrefix("primitive") {
 			cout << modelNUllMsg << endl;
 			return;
 		}
+		if (inferenceOnly){
+			cout << "Error: the model was loaded for inference only, training is unavailable" << endl;
+			return;
+		}
 		stdoutLog = show;
 
 		t_step = 1;
-		stringstream strm; strm << modelPath << "/training.txt";
+		stringstream strm; strm << modelPath << "/training";
+		if (workerRank > 0)
+			strm << workerRank;
+		strm << ".txt";
 
 		if(t_retrain)
 			logFile = new ofstream(strm.str(),std::ofstream::app);
@@ -340,7 +1302,7 @@ LibNRL::LibNRL() : dataPrefix("primitive") {
 					ut->loadContainer<float1DContainer>(&eFile, &vec, ut->getDelimiter());
 					t_step = int(vec[0]+1);
 					maxLoss = vec[1];
-					model->load(modelPath);
+					loadModel();
 					//net.print();
 					cout << endl << "Retraining the model ..." << endl;
 					*logFile << "Retraining the model ..." << endl;
@@ -362,6 +1324,10 @@ LibNRL::LibNRL() : dataPrefix("primitive") {
 			cout << modelNUllMsg << endl;
 			return;
 		}
+		if (inferenceOnly){
+			cout << "Error: the model was loaded for inference only, training is unavailable" << endl;
+			return;
+		}
 		bool keepRunning = true;
 
 		t_nEpoch = t_step + n - 1;
@@ -372,38 +1338,38 @@ LibNRL::LibNRL() : dataPrefix("primitive") {
 
 			  chrono::high_resolution_clock::time_point mst1 = chrono::high_resolution_clock::now();
 
+			  // outputs of all the primitives of an epoch, refilled at each epoch
+			  TensorXf All_X(model->getOutputUnits());
+			  All_X.reserve(t_prim_Ids.size()*size_t(seqLen));
+
 			  for (; t_step <= t_nEpoch; t_step++){
-				  vectorXf3DContainer All_X;
+				  All_X.clear();
 
 				  if (t_shuffle)
 					  ut->shuffle<int1DContainer>(&t_prim_Ids);
 
+				  // the streamed targets are loaded in background during the forward pass
+				  if (YStream != nullptr)
+					  YStream->prefetch(t_prim_Ids);
+
 				  int1DContainer::iterator t_prim_Ids_i = t_prim_Ids.begin();
-				  for (int pId = 0; pId < nSeq; pId++, t_prim_Ids_i++){
-					  vectorXf2DContainer X;
-					  model->t_forward(seqLen, *t_prim_Ids_i, X);
-					  All_X.push_back(X);
+				  for (int pId = 0; pId < (int)t_prim_Ids.size(); pId++, t_prim_Ids_i++){
+					  model->t_forward(seqLen, *t_prim_Ids_i, All_X);
 				  }
 
 				  t_prim_Ids_i = t_prim_Ids.begin();
 				  loss = 0.0;
 				  reconstruction = 0.0;
 				  regulation = 0.0;
-				  for (int pId = 0; pId < nSeq; pId++, t_prim_Ids_i++){
-					  vectorXf3DContainer Y_p = YSoftmax[*t_prim_Ids_i];
-					  vectorXf2DContainer X = All_X[pId];
-					  model->t_backward(*t_prim_Ids_i, X, Y_p, reconstruction, regulation, loss);
+				  for (int pId = 0; pId < (int)t_prim_Ids.size(); pId++, t_prim_Ids_i++){
+					  backward(model, *t_prim_Ids_i, All_X[pId], reconstruction, regulation, loss);
 				  }
-				  model->t_optAdam(t_step, t_alpha, t_beta1, t_beta2);
+				  if (reducer != nullptr)
+					  reduceGradients(reconstruction, regulation, loss);
+				  model->t_optimize(t_step, t_alpha, t_beta1, t_beta2);
 
 				  if (t_step % n == 0){
-					  float mseGen = 0.0;
-					  for (int pId = 0; pId < nSeq; pId++){
-						  vectorXf2DContainer X;
-						  vectorXf3DContainer Y_p = YSoftmax[pId];
-						  model->t_generate(seqLen, pId, X);
-						  mseGen +=  model->getRecError(X, Y_p);
-					  }
+					  float mseGen = validation(t_step);
 
 					  chrono::high_resolution_clock::time_point mst2 = chrono::high_resolution_clock::now();
 					  chrono::duration<double, std::milli> msdiff = mst2 - mst1;
@@ -436,14 +1402,10 @@ LibNRL::LibNRL() : dataPrefix("primitive") {
 
 					  if (maxLoss > loss || !t_greedy){
 						  maxLoss = loss;
-						  model->save(modelPath);
+						  saveModel(t_step, loss);
 						  output[6] = 1.0;
-						  ofstream eFile(strEpoch,std::ofstream::out);
-						  if (eFile.is_open()){
-							  eFile << t_step << ut->getDelimiter() << loss;
-							  eFile.close();
-						  }
-						  *logFile<< "The model has been saved" << endl;
+						  if (workerRank == 0)
+						  	*logFile<< "The model has been saved" << endl;
 					  }
 					  mst1 = chrono::high_resolution_clock::now();
 				  }
@@ -458,6 +1420,8 @@ LibNRL::LibNRL() : dataPrefix("primitive") {
 			cout << modelNUllMsg << endl;
 			return;
 		}
+		waitValidation(true);
+		waitSave();
 		cout << endl << "Training end" << endl;
 		*logFile << endl << "Training  end" << endl;
 		logFile->close();
@@ -470,10 +1434,17 @@ LibNRL::LibNRL() : dataPrefix("primitive") {
 			cout << modelNUllMsg << endl;
 			return;
 		}
+		if (inferenceOnly){
+			cout << "Error: the model was loaded for inference only, training is unavailable" << endl;
+			return;
+		}
 		bool keepRunning = true;
 		t_step = 1;
 
-		stringstream strm; strm << modelPath << "/training.txt";
+		stringstream strm; strm << modelPath << "/training";
+		if (workerRank > 0)
+			strm << workerRank;
+		strm << ".txt";
 		if(t_retrain)
 			logFile = new ofstream(strm.str(),std::ofstream::app);
 		else
@@ -495,7 +1466,7 @@ LibNRL::LibNRL() : dataPrefix("primitive") {
 					ut->loadContainer<float1DContainer>(&eFile, &vec, ut->getDelimiter());
 					t_step = int(vec[0]+1);
 					maxLoss = vec[1];
-					model->load(modelPath);
+					loadModel();
 					//net.print();
 					cout << endl << "Retraining the model ..." << endl;
 					*logFile << "Retraining the model ..." << endl;
@@ -523,38 +1494,38 @@ LibNRL::LibNRL() : dataPrefix("primitive") {
 
 			  chrono::high_resolution_clock::time_point mst1 = chrono::high_resolution_clock::now();
 
+			  // outputs of all the primitives of an epoch, refilled at each epoch
+			  TensorXf All_X(model->getOutputUnits());
+			  All_X.reserve(t_prim_Ids.size()*size_t(seqLen));
+
 			  for (; t_step <= t_nEpoch; t_step++){
-				  vectorXf3DContainer All_X;
+				  All_X.clear();
 
 				  if (t_shuffle)
 					  ut->shuffle<int1DContainer>(&t_prim_Ids);
 
+				  // the streamed targets are loaded in background during the forward pass
+				  if (YStream != nullptr)
+					  YStream->prefetch(t_prim_Ids);
+
 				  int1DContainer::iterator t_prim_Ids_i = t_prim_Ids.begin();
-				  for (int pId = 0; pId < nSeq; pId++, t_prim_Ids_i++){
-					  vectorXf2DContainer X;
-					  model->t_forward(seqLen, *t_prim_Ids_i, X);
-					  All_X.push_back(X);
+				  for (int pId = 0; pId < (int)t_prim_Ids.size(); pId++, t_prim_Ids_i++){
+					  model->t_forward(seqLen, *t_prim_Ids_i, All_X);
 				  }
 
 				  t_prim_Ids_i = t_prim_Ids.begin();
 				  loss = 0.0;
 				  reconstruction = 0.0;
 				  regulation = 0.0;
-				  for (int pId = 0; pId < nSeq; pId++, t_prim_Ids_i++){
-					  vectorXf3DContainer Y_p = YSoftmax[*t_prim_Ids_i];
-					  vectorXf2DContainer X = All_X[pId];
-					  model->t_backward(*t_prim_Ids_i, X, Y_p, reconstruction, regulation, loss);
+				  for (int pId = 0; pId < (int)t_prim_Ids.size(); pId++, t_prim_Ids_i++){
+					  backward(model, *t_prim_Ids_i, All_X[pId], reconstruction, regulation, loss);
 				  }
-				  model->t_optAdam(t_step, t_alpha, t_beta1, t_beta2);
+				  if (reducer != nullptr)
+					  reduceGradients(reconstruction, regulation, loss);
+				  model->t_optimize(t_step, t_alpha, t_beta1, t_beta2);
 
 				  if (t_step % 100 == 0){
-					  float mseGen = 0.0;
-					  for (int pId = 0; pId < nSeq; pId++){
-						  vectorXf2DContainer X;
-						  vectorXf3DContainer Y_p = YSoftmax[pId];
-						  model->t_generate(seqLen, pId, X);
-						  mseGen +=  model->getRecError(X, Y_p);
-					  }
+					  float mseGen = validation(t_step);
 
 					  chrono::high_resolution_clock::time_point mst2 = chrono::high_resolution_clock::now();
 					  chrono::duration<double, std::milli> msdiff = mst2 - mst1;
@@ -576,13 +1547,9 @@ LibNRL::LibNRL() : dataPrefix("primitive") {
 					
 					  if (maxLoss > loss || !t_greedy){
 						  maxLoss = loss;
-						  model->save(modelPath);
-						  ofstream eFile(strEpoch,std::ofstream::out);
-						  if (eFile.is_open()){
-							  eFile << t_step << ut->getDelimiter() << loss;
-							  eFile.close();
-						  }
-						  *logFile<< "The model has been saved" << endl;
+						  saveModel(t_step, loss);
+						  if (workerRank == 0)
+						  	*logFile<< "The model has been saved" << endl;
 					  }
 					  mst1 = chrono::high_resolution_clock::now();
 				  }
@@ -590,19 +1557,17 @@ LibNRL::LibNRL() : dataPrefix("primitive") {
 			  }			  
 			  if (maxLoss > loss || !t_greedy){
 				  maxLoss = loss;
-				  model->save(modelPath);
-				  ofstream eFile(strEpoch,std::ofstream::out);
-				  if (eFile.is_open()){
-					  eFile << t_step << ut->getDelimiter() << loss;
-					  eFile.close();
-				  }
-				  *logFile<< "The model has been saved" << endl;
+				  saveModel(t_step, loss);
+				  if (workerRank == 0)
+				  	*logFile<< "The model has been saved" << endl;
 			  }
 		  }catch(oist::Exception& e){
 			  cout << "Error: "<<  e.what() << endl;
 			  *logFile << "Error: "<<  e.what() << endl;
 		  }
 		}
+		waitValidation(true);
+		waitSave();
 		cout << endl << "Training end" << endl;
 		*logFile << endl << "Training  end" << endl;
 		logFile->close();
@@ -612,7 +1577,7 @@ LibNRL::LibNRL() : dataPrefix("primitive") {
 
 
 
-	void LibNRL::e_enable(int pID, int ws, float* param, int ne, int epoch, float alpha, float beta1, float beta2, bool store_s, bool store_p){
+	void LibNRL::e_enable(int pID, int ws, float* param, int ne, int epoch, float alpha, float beta1, float beta2, bool store_s, bool store_p, string precision){
 
 		if (model == nullptr){
 			cout << modelNUllMsg << endl;
@@ -628,13 +1593,29 @@ LibNRL::LibNRL() : dataPrefix("primitive") {
 			cout << "Warning: the primitive ID "<< pID << " is greater than " << nSeq-1 << " available IDs. Primitive 0 is selected by default" << endl;
 			pID = 0;
 		}
+		if (find(e_prim_Ids.begin(), e_prim_Ids.end(), pID) == e_prim_Ids.end()){
+			cout << "Warning: the primitive ID "<< pID << " was not exported with the model. Primitive " << e_prim_Ids[0] << " is selected by default" << endl;
+			pID = e_prim_Ids[0];
+		}
 		e_nEpoch = epoch;
 
 		e_alpha = alpha;
 		e_beta1 = beta1;
 		e_beta2 = beta2;
 		e_step = 1;
-		model->e_enable(pID, e_winSize, param, ne, store_s, store_p);
+
+		Precision e_precision;
+		if (!toPrecision(precision, e_precision)){
+			cout << "Warning: unknown precision [" << precision << "], 'fp32' is selected by default" << endl;
+			e_precision = PRECISION_FP32;
+		}
+		try{
+			model->e_enable(pID, e_winSize, param, ne, store_s, store_p, e_precision);
+		}catch(oist::Exception& e){
+			// the precision is rejected by the layers that hold their weights in single precision only
+			cout << "Warning: " << e.what() << ", 'fp32' is selected by default" << endl;
+			model->e_enable(pID, e_winSize, param, ne, store_s, store_p, PRECISION_FP32);
+		}
 
 	}
 
@@ -652,6 +1633,7 @@ LibNRL::LibNRL() : dataPrefix("primitive") {
 		int size []= {e_winSize, (int)nDof};
 
 		dataset->encodeSoftmax(input, size, Y);
+		float ent = dataset->targetEntropy(Y);
 
 		float maxLoss = std::numeric_limits<float>::max();
 
@@ -668,10 +1650,10 @@ LibNRL::LibNRL() : dataPrefix("primitive") {
 
 				vectorXf2DContainer X;
 				model->e_forward(X);
-				model->e_backward(X, Y, rec, reg, loss);
+				model->e_backward(X, Y, ent, rec, reg, loss);
 				if (show)
 					cout << "E[" << e_step << "]" << " REC[" << rec << "] " << " REG[" << reg << "] loss[" << loss << "]" << endl;
-				model->e_optAdam(e_step, e_alpha, e_beta1, e_beta2);
+				model->e_optimize(e_step, e_alpha, e_beta1, e_beta2);
 
 				if (maxLoss > loss){
 					  output[0] = loss;
@@ -737,6 +1719,89 @@ LibNRL::LibNRL() : dataPrefix("primitive") {
 		model->a_predict(n, input, string(path));
 	}
 
+	void LibNRL::a_precisionReport(const char* path, int n, float* input){
+		if (model == nullptr){
+			cout << modelNUllMsg << endl;
+			return;
+		}
+		if (loaded == false){
+			cout << "Warning: The model should be loaded before calling a_precisionReport!" << endl;
+			return;
+		}
+		if (n <= 0){
+			cout << "Warning: The number of time steps should be positive!" << endl;
+			return;
+		}
+
+		const Precision precisions[] = {PRECISION_FP32, PRECISION_BF16, PRECISION_FP16, PRECISION_INT8};
+		const unsigned int reportSeed = 1;
+		int o_dim = model->getOutputDim();
+
+		ofstream reportFile;
+		reportFile.open(path);
+		if (!reportFile.is_open()){
+			cout << "Error: The report file [" << path << "] cannot be opened!" << endl;
+			return;
+		}
+
+		stringstream report;
+		report << "precision weights[kB] step[us] rmse max_error final_rmse" << endl;
+
+		vector<float> reference(size_t(n)*o_dim);
+		vector<float> X(size_t(n)*o_dim);
+
+		// the report reseeds the generator and switches the precision, both are restored afterwards
+		string randomState = ut->getRandomState();
+		Precision activePrecision = model->getPrecision();
+
+		for (Precision p : precisions){
+			try{
+				model->setPrecision(p);
+			}catch(oist::Exception& e){
+				cout << "Warning: " << e.what() << endl;
+				continue;
+			}
+			size_t bytes = model->getGenerationBytes();
+
+			// untimed run to warm up the caches with the weights of this precision
+			ut->seed(reportSeed);
+			model->a_rollout(n, input, X.data());
+
+			// same noise for every precision, so that only the weights differ
+			ut->seed(reportSeed);
+			chrono::high_resolution_clock::time_point t1 = chrono::high_resolution_clock::now();
+			model->a_rollout(n, input, X.data());
+			chrono::high_resolution_clock::time_point t2 = chrono::high_resolution_clock::now();
+			chrono::duration<double, std::micro> usdiff = t2 - t1;
+
+			if (p == PRECISION_FP32){
+				reference = X;
+			}
+
+			double se = 0.0, finalSe = 0.0, maxError = 0.0;
+			for (int t = 0; t < n; t++){
+				for (int k = 0; k < o_dim; k++){
+					double e = fabs(double(X[size_t(t)*o_dim + k]) - double(reference[size_t(t)*o_dim + k]));
+					se += e*e;
+					maxError = max(maxError, e);
+					if (t == n-1){
+						finalSe += e*e;
+					}
+				}
+			}
+
+			report << precisionName(p) << " " << bytes/1024.0 << " " << usdiff.count()/n << " "
+				   << sqrt(se/(double(n)*o_dim)) << " " << maxError << " " << sqrt(finalSe/o_dim) << endl;
+		}
+
+		ut->setRandomState(randomState);
+		model->setPrecision(activePrecision);
+
+		reportFile << report.str();
+		reportFile.close();
+		cout << report.str();
+	}
+
 	void LibNRL::a_feedForwardOutputFromContext(float* input, float* output){
 		if (model == nullptr){
 			cout << modelNUllMsg << endl;
@@ -753,7 +1818,15 @@ LibNRL::LibNRL() : dataPrefix("primitive") {
 
 		loaded = false;
 
+		// the checkpoint and the validation in flight must be completed before releasing the model
+		waitValidation(true);
+		waitSave();
+		if (v_model != nullptr)
+			delete v_model;
+		v_model = nullptr;
+
 		if (model == nullptr){
+			releaseOptimizers();
 			return;
 		}
 		cout << endl << "Model deallocation ..." << endl;
@@ -761,17 +1834,28 @@ LibNRL::LibNRL() : dataPrefix("primitive") {
 		try{
 			// clearing data
 			YSoftmax.clear();
+			YSparse.clear();
+			YEntropy.clear();
 			activeJoints.clear();
 			nSamples.clear();
 
+			if (YStream != nullptr)
+				delete YStream;
+			if (reducer != nullptr)
+				delete reducer;
 			if (dataset != nullptr)
 				delete dataset;
 			if (model != nullptr)
 				delete model;
 			if (logFile != nullptr)
 				delete logFile;
+			releaseOptimizers();
 
 			model = nullptr;
+			YStream = nullptr;
+			reducer = nullptr;
+			workerRank = 0;
+			nWorkers = 1;
 			dataset = nullptr;		
 			logFile = nullptr;	
 			cout << endl;
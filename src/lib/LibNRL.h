@@ -52,6 +52,12 @@
 
 #include "../includes.h"
 #include "../utils/Utils.h"
+#include "../utils/Checkpoint.h"
+#include "../utils/AllReduce.h"
+
+#include <thread>
+#include <atomic>
+#include <mutex>
 
 #include "../robot/Cartesian.h"
 #include "../robot/Torobo.h"
@@ -62,6 +68,11 @@
 #include "../network/NetworkPvrnn.h"
 #include "../network/NetworkPvrnnBeta.h"
 
+#include "../optimizer/IOptimizer.h"
+#include "../optimizer/OptimizerAdam.h"
+#include "../optimizer/OptimizerFactored.h"
+#include "../optimizer/OptimizerMomentum.h"
+
 
 namespace oist {
 
@@ -77,6 +88,8 @@ class LibNRL {
 
 	Dataset* dataset;
 	INetwork* model;
+	IOptimizer* optimizer;		// weights and bias
+	IOptimizer* aOptimizer;		// A variables
 	ofstream* logFile;
 	IRobot* robot;
 	Utils* ut;
@@ -87,19 +100,33 @@ class LibNRL {
 	string networkName;
 	string strEpoch;
 	string propPath;
+	string strCheckpoint;
+	string session;				// distinguishes the shared segments of concurrent distributed trainings
 	string modelNUllMsg;
 	bool stdoutLog;
 
 	const string dataPrefix;
 
 	// softmax primitives in the data-set
-	vectorXf4DContainer YSoftmax;
+	tensorXf1DContainer YSoftmax;
+
+	// truncated softmax primitives, used instead of YSoftmax if sparseTol > 0
+	sparseXf4DContainer YSparse;
+
+	// sum of the Y*log(Y) terms of each training primitive, computed once at encoding time
+	float1DContainer YEntropy;
+	float sparseTol;
+
+	// encoded primitives kept on disk, used instead of YSoftmax and YSparse if not null
+	DataStream* YStream;
 
 	float nDof;
 	int nSeq;
 	int seqLen;
 
 	bool loaded;
+	bool inferenceOnly;
+	bool binaryCheckpoint;
 	float dsoft;
 	float sigma;
 	float maxLoss;
@@ -118,8 +145,53 @@ class LibNRL {
 	bool t_greedy;
 	float1DContainer t_w;
 	int1DContainer t_prim_Ids;
+	int t_enrollId;
+	string freezeSpec;
+
+	/**
+	 * Run of a hyper-parameter sweep, see @ref t_sweep
+	 * */
+	struct SweepRun {
+		int id;
+		string spec;							// properties overridden by the run
+		map<string,float1DContainer> props;		// network and training properties
+		string path;							// model path of the run
+		double cost;							// estimated cost, the longest runs are scheduled first
+		int step;								// epoch of the saved model
+		float loss;								// loss of the saved model
+		float recError;							// RE_P of the saved model
+		string error;
+	};
+	std::mutex sweepMutex;
+
+	// data-parallel training, each worker process trains the primitives with pID % nWorkers == workerRank
+	AllReduce* reducer;
+	int workerRank;
+	int nWorkers;
+
+	// binary checkpoint double buffer: one buffer receives the parameter snapshot
+	// while the other one may still be written by the saving thread
+	Checkpoint saveBuffer[2];
+	int saveBufferId;
+	std::thread saveThread;
+	string saveError;
+
+	// validation (RE_P) on a snapshot of the parameters, evaluated by a replica of the network in background
+	bool v_async;
+	int v_size;									// number of evaluated primitives, all of them if <= 0
+	map<string,float1DContainer> v_props;		// network properties for creating the replica
+	INetwork* v_model;
+	Checkpoint v_snapshot;
+	std::thread v_thread;
+	std::atomic<bool> v_done;
+	int v_step;									// epoch of the last completed validation (0 if none)
+	float v_recError;							// RE_P of the last completed validation
+	int v_pendingStep;							// epoch of the snapshot in flight
+	float v_result;								// RE_P of the snapshot in flight, written by the validation thread
+	string v_error;
 
 	// variables for experiment mode
+	int1DContainer e_prim_Ids;
 	int e_winSize;
 	int e_nEpoch;
 	int e_step;
@@ -146,6 +218,167 @@ class LibNRL {
 	 * */
 	void deallocate();
 
+	/**
+	 * Saves the model parameters in the format selected by the 'checkpoint' property,
+	 * and records the epoch and loss in the epoch file.
+	 * In binary format, the parameters are copied into a snapshot which is written
+	 * in background, while at most one checkpoint is in flight
+	 * @param step Current training epoch
+	 * @param loss Current loss
+	 * */
+	void saveModel(int step, float loss);
+
+	/**
+	 * Writes a checkpoint snapshot and records the epoch and loss in the epoch file.
+	 * It runs in the saving thread, hence errors are stored in @ref saveError
+	 * @param ckpt Checkpoint snapshot
+	 * @param step Training epoch of the snapshot
+	 * @param loss Loss of the snapshot
+	 * */
+	void writeCheckpoint(Checkpoint* ckpt, int step, float loss);
+
+	/**
+	 * Records the epoch and loss of the saved model
+	 * @param file Epoch file full path
+	 * @param step Training epoch
+	 * @param loss Loss
+	 * */
+	void writeEpoch(const string& file, int step, float loss);
+
+	/**
+	 * Waits until the checkpoint in flight (if any) is written to disk
+	 * */
+	void waitSave();
+
+	/**
+	 * Loads the model parameters in the format selected by the 'checkpoint' property.
+	 * The binary format falls back to the text files when no checkpoint file is available
+	 * */
+	void loadModel();
+
+	/**
+	 * Freezes the parameter groups listed in the 'freeze' property, whose *delimiter* separated
+	 * tokens are 'o' (output layer), 'h', 'p', 'q', 'a' (group in all the layers), 'l<k>' (all the
+	 * groups of the layer k) or 'l<k>_<g>' (group g of the layer k), with layers indexed from 0
+	 * @param net Network model
+	 * @param spec Property value
+	 * @param nLayers Number of layers
+	 * */
+	void freezeModel(INetwork* net, string spec, int nLayers);
+
+	/**
+	 * Creates a network model of the type given by the 'network' property
+	 * @param props Network properties
+	 * @param inference Flag indicating that the model is only used for inference, hence it is created
+	 * without the gradients, the Adam moments and the A variables of the training
+	 * @return Network model
+	 * */
+	INetwork* createNetwork(map<string,float1DContainer>& props, bool inference = false);
+
+	/**
+	 * Creates a new model from the property file, see @ref newModel and @ref newInference
+	 * @param path Property file full path
+	 * @param exportPath Exported file full path, or empty for a model encoding the data-set for training
+	 * */
+	void createModel(string path, string exportPath);
+
+	/**
+	 * Loads the parameters of an exported checkpoint, the training memory is released on success only
+	 * @param ckpt Checkpoint read from the file exported by @ref exportInference
+	 * */
+	void loadInference(Checkpoint& ckpt);
+
+	/**
+	 * Creates an optimizer from its name in the 'optimizer' and 'aoptimizer' properties
+	 * @param name Optimizer name: 'adam', 'factored' or 'momentum'
+	 * @return Optimizer
+	 * */
+	IOptimizer* createOptimizer(const string& name);
+
+	/**
+	 * Releases the optimizers, once the networks using them are deleted
+	 * */
+	void releaseOptimizers();
+
+	/**
+	 * Trains a run of a hyper-parameter sweep with the shared data-set, it runs in a thread of the sweep pool
+	 * hence errors are stored in the run
+	 * @param run Sweep run
+	 * */
+	void trainRun(SweepRun& run);
+
+	/**
+	 * Checks if a primitive is trained by this worker (see @ref t_distribute)
+	 * @param pID Primitive ID
+	 * */
+	bool owns(int pID);
+
+	/**
+	 * Sums the gradients of the weights and the training errors across the workers, so that all the workers
+	 * apply the same update to the weights. The A variables are optimized by the worker of each primitive
+	 * @param rec Input/output reconstruction error
+	 * @param reg Input/output regulation error
+	 * @param loss Input/output loss function
+	 * */
+	void reduceGradients(float& rec, float& reg, float& loss);
+
+	/**
+	 * Gathers the A variables and their optimization moments from the worker of each primitive, before saving the model
+	 * */
+	void gatherVariables();
+
+	/**
+	 * Computes the backward pass of a training primitive against its targets (dense, truncated or streamed).
+	 * A streamed primitive is released afterwards
+	 * @param net Network model
+	 * @param pID Primitive ID
+	 * @param X Network output
+	 * @param rec Output reconstruction error
+	 * @param reg Output regulation error
+	 * @param loss Output loss function
+	 * */
+	void backward(INetwork* net, int pID, const SequenceViewXf& X, float& rec, float& reg, float& loss);
+
+	/**
+	 * Computes the reconstruction error of a primitive against its targets (dense, truncated or streamed).
+	 * A streamed primitive is released afterwards
+	 * @param net Network model
+	 * @param pID Primitive ID
+	 * @param X Network output
+	 * @return Reconstruction error
+	 * */
+	float recError(INetwork* net, int pID, const SequenceViewXf& X);
+
+	/**
+	 * Computes the validation metric RE_P, i.e. the reconstruction error of the primitives generated from the prior
+	 * distribution. If the 'validationsize' property is given, a random subset of the primitives is evaluated
+	 * @param net Network model, either the trained one or the replica of a parameter snapshot
+	 * @return Reconstruction error
+	 * */
+	float validate(INetwork* net);
+
+	/**
+	 * Gets the validation metric RE_P of a training epoch. In asynchronous mode ('asyncvalidation' property),
+	 * the parameters are copied into a snapshot evaluated in background, and the metric of the last completed
+	 * validation is returned, hence training never waits for the evaluation. A new snapshot is not taken while
+	 * the previous one is still evaluated
+	 * @param step Training epoch
+	 * @return Reconstruction error
+	 * */
+	float validation(int step);
+
+	/**
+	 * Evaluates the parameter snapshot in the validation thread, errors are stored in @ref v_error
+	 * */
+	void runValidation();
+
+	/**
+	 * Collects the validation in flight (if any)
+	 * @param wait Flag indicating to wait until the validation is completed
+	 * @return True if no validation is in flight anymore
+	 * */
+	bool waitValidation(bool wait);
+
 public:
 
 	static LibNRL* getInstance();
@@ -156,6 +389,15 @@ public:
 	 * */
 	void newModel(string path);
 
+	/**
+	 * Creates a new model for inference only from a file exported by @ref exportInference. The data-set
+	 * is not encoded and the memory used for training is not allocated, hence the training mode is
+	 * unavailable until a new model is created
+	 * @param path Property file full path
+	 * @param exportPath Exported file full path
+	 * */
+	void newInference(string path, string exportPath);
+
 	/**
 	 * Gets the number of degrees of freedom (DoF) of the network output
 	 * @return Number of DoF
@@ -179,6 +421,33 @@ public:
 	 * */	
 	void load();
 
+	/**
+	 * Exports the loaded model for experiment-only deployments. The file contains only the parameters
+	 * required in experiment mode (no Adam moments), and the A variables of the selected primitives
+	 * @param path Output file full path
+	 * @param pIDs Array of primitive IDs to be exported
+	 * @param n Number of primitive IDs (if n <= 0, all the primitives are exported)
+	 * */
+	void exportInference(string path, int* pIDs, int n);
+
+	/**
+	 * Loads a model exported by @ref exportInference. The memory used for training is released once the
+	 * model is loaded, hence the training mode is unavailable until a new model is created. The
+	 * model created by @ref newInference does not require this call
+	 * @param path Exported file full path
+	 * */
+	void loadInference(string path);
+
+	/**
+	 * Appends samples or primitives to the data-set without reloading it. Only the new sample files are
+	 * encoded, and the A variables of the new primitives are appended to the model, so the training can
+	 * continue with @ref t_loop. The 'nsamples' property should be updated accordingly for creating the
+	 * model again from the saved parameters
+	 * @param samples Array with the new number of samples of each primitive, including the new primitives
+	 * @param n Number of primitives
+	 * */
+	void appendData(int* samples, int n);
+
 	// -------------------------- training mode --------------------------
 
 	/**
@@ -214,6 +483,55 @@ public:
 	 * */
 	void t_background();
 
+	/**
+	 * Enables the enrollment of a primitive, e.g. a primitive added with @ref appendData. The following training
+	 * epochs (@ref t_loop, @ref t_background) only optimize the A variables of the primitive, while the network
+	 * weights are frozen. Hence, each epoch only computes the forward and backward pass of the enrolled primitive
+	 * @param pID ID of the enrolled primitive, a negative value restores the training of the whole model
+	 * */
+	void t_enroll(int pID);
+
+	/**
+	 * Prunes the weights of the network layers by magnitude. The pruned weights stay zero through the following
+	 * training epochs (@ref t_loop, @ref t_background), which fine-tune the remaining ones, and are saved as the
+	 * other weights. The layers whose weights are sparse enough (see the 'sparsedensity' property) use sparse
+	 * products in the experiment and analysis modes. The masks of the pruned weights are kept in memory only,
+	 * pruning a reloaded model again with the same sparsity restores them
+	 * @param sparsity Fraction of pruned weights, in [0, 1)
+	 * @param global Flag indicating to prune the smallest weights of all the layers, otherwise each weight
+	 *     matrix is pruned to the sparsity
+	 * */
+	void t_prune(float sparsity, bool global);
+
+	/**
+	 * Trains several variants of the model concurrently on the data-set loaded by @ref newModel, which is encoded
+	 * once and shared read-only by all the runs. Each line of the sweep file is a run given by whitespace separated
+	 * 'key=value' tokens, which override the network properties ('d', 'z', 't', 'w', ...) and the training properties
+	 * ('epochs', 'alpha', 'beta1', 'beta2') of the properties file, e.g. 'd=40,10 alpha=0.002'. The properties of the
+	 * data-set cannot be overridden. The runs are trained in background by a pool of threads, the longest ones first,
+	 * and each one logs and saves its model in the directory 'sweep<k>' of the model path, with k the run line from 0.
+	 * A summary of the runs is written in the file 'sweep.txt' of the model path
+	 * @param path Sweep file full path
+	 * @param nThreads Number of threads (if nThreads <= 0, one per hardware thread)
+	 * */
+	void t_sweep(string path, int nThreads);
+
+	/**
+	 * Enables the data-parallel training in several processes of the same host. Each worker process creates the
+	 * same model with @ref newModel and calls this method with its index, then it trains as usual (@ref t_background,
+	 * or @ref t_init, @ref t_loop and @ref t_end with the same number of epochs). Each worker computes the forward and
+	 * backward passes of its primitives (pID % workers == rank), and the gradients are exchanged through POSIX shared
+	 * memory before the synchronized Adam update: the gradients of the weights are summed, and the ones of the A
+	 * variables are gathered from the worker of each primitive. Hence, all the workers keep the same parameters, and
+	 * the worker 0 saves the model and logs in 'training.txt', while the other workers log in 'training<rank>.txt'.
+	 * The workers meet in a segment named after the model path and the 'session' property, which defaults to the
+	 * parent process id, so that the workers started by the same launcher share it. The method waits until all the
+	 * workers are attached
+	 * @param rank Worker index from 0
+	 * @param workers Number of workers (if workers <= 1, the training is restored to a single process)
+	 * */
+	void t_distribute(int rank, int workers);
+
 
 	// -------------------------- experiment mode ------------------------
 
@@ -229,8 +547,9 @@ public:
 	 * @param beta2 Adam optimization hyper parameter \f$\beta_2\f$
 	 * @param store_s A flag indicating to store the states on disk (if true performance can be affected)
 	 * @param store_p A flag indicating to store intermediate BPPT computations (if true performance can be affected)
+	 * @param precision Storage precision of the weights for the generation ('fp32', 'bf16', 'fp16' or 'int8')
 	 * */
-	void e_enable(int pID, int ws, float* param, int ne, int epoch, float alpha, float beta1, float beta2, bool store_s, bool store_p);
+	void e_enable(int pID, int ws, float* param, int ne, int epoch, float alpha, float beta1, float beta2, bool store_s, bool store_p, string precision = "fp32");
 
 	/**
 	 * Computes the post-diction (inference) process
@@ -272,6 +591,17 @@ public:
 	 * */
 	void a_predict(const char* path, int n, float* input);
 
+	/**
+	 * Compares the generation with the weights held in each storage precision ('fp32', 'bf16', 'fp16' and 'int8').
+	 * The n time steps predictions are made from the same initial context and noise, and the decoded
+	 * outputs are compared with the single precision ones. The weight bytes read per step, the time per step,
+	 * the root mean square error, the maximum absolute error and the error of the last step are written to a file.
+	 * @param path Output file full path
+	 * @param n Number of time steps
+	 * @param input Array with latent state, whose dimension can be obtained through 'getStateDim'
+	 * */
+	void a_precisionReport(const char* path, int n, float* input);
+
 
 	/**
 	 * Computes the output from feed-forwarding a given context.
@@ -77,6 +77,16 @@ extern "C" {
 		nrl->newModel(string(path));
 	}
 
+	/**
+	 * Creates a new model for inference only from an exported file, without encoding the data-set
+	 * @param nrl Pointer to a LibNRL instance
+	 * @param path Full path to the properties file
+	 * @param exportPath Exported file full path
+	 * */
+	void newInference(LibNRL* nrl, const char* path, const char* exportPath){
+		nrl->newInference(string(path), string(exportPath));
+	}
+
 	/**
 	 * Loads the network model
 	 * @param nrl Pointer to a LibNRL instance
@@ -85,6 +95,36 @@ extern "C" {
 		nrl->load();
 	}
 
+	/**
+	 * Exports the loaded model for experiment-only deployments
+	 * @param nrl Pointer to a LibNRL instance
+	 * @param path Output file full path
+	 * @param pIDs Array of primitive IDs to be exported
+	 * @param n Number of primitive IDs (if n <= 0, all the primitives are exported)
+	 * */
+	void exportInference(LibNRL* nrl, const char* path, int* pIDs, int n){
+		nrl->exportInference(string(path), pIDs, n);
+	}
+
+	/**
+	 * Loads a model exported for experiment-only deployments
+	 * @param nrl Pointer to a LibNRL instance
+	 * @param path Exported file full path
+	 * */
+	void loadInference(LibNRL* nrl, const char* path){
+		nrl->loadInference(string(path));
+	}
+
+	/**
+	 * Appends samples or primitives to the data-set of the model
+	 * @param nrl Pointer to a LibNRL instance
+	 * @param samples Array with the new number of samples of each primitive
+	 * @param n Number of primitives
+	 * */
+	void appendData(LibNRL* nrl, int* samples, int n){
+		nrl->appendData(samples, n);
+	}
+
 	/**
 	 * Gets the number of degrees of freedom (DoF) of the network output
 	 * @param nrl Pointer to a LibNRL instance
@@ -123,6 +163,45 @@ extern "C" {
 		nrl->t_background();
 	}
 
+	/**
+	 * Enables the enrollment of a primitive, only its A variables are optimized
+	 * @param nrl Pointer to a LibNRL instance
+	 * @param pID ID of the enrolled primitive (a negative value restores the training of the whole model)
+	 * */
+	void t_enroll(LibNRL* nrl, int pID){
+		nrl->t_enroll(pID);
+	}
+
+	/**
+	 * Prunes the weights of the network layers by magnitude, the following epochs fine-tune the remaining ones
+	 * @param nrl Pointer to a LibNRL instance
+	 * @param sparsity Fraction of pruned weights, in [0, 1)
+	 * @param global Flag indicating to prune the smallest weights of all the layers, otherwise each weight matrix
+	 * */
+	void t_prune(LibNRL* nrl, float sparsity, bool global){
+		nrl->t_prune(sparsity, global);
+	}
+
+	/**
+	 * Trains several variants of the model concurrently on the shared data-set
+	 * @param nrl Pointer to a LibNRL instance
+	 * @param path Sweep file full path, one run per line given by 'key=value' property overrides
+	 * @param nThreads Number of threads (if nThreads <= 0, one per hardware thread)
+	 * */
+	void t_sweep(LibNRL* nrl, const char* path, int nThreads){
+		nrl->t_sweep(path, nThreads);
+	}
+
+	/**
+	 * Enables the data-parallel training in several processes of the same host
+	 * @param nrl Pointer to a LibNRL instance
+	 * @param rank Worker index from 0
+	 * @param workers Number of worker processes
+	 * */
+	void t_distribute(LibNRL* nrl, int rank, int workers){
+		nrl->t_distribute(rank, workers);
+	}
+
 	/**
 	 * Initialization of interactive training mode
 	 * @param nrl Pointer to a LibNRL instance
@@ -189,6 +268,37 @@ extern "C" {
 		nrl->e_enable(pID, ws, param, ne, epoch, alpha, beta1, beta2, store_s, store_p);
 	}
 
+	/**
+	 * Enables on-line experiment mode, with the weights of the generation stored in reduced precision
+	 * @param nrl Pointer to a LibNRL instance
+	 * @param pID Primitive ID
+	 * @param ws Sliding window size
+	 * @param param Parameters array for the neural network model
+	 * @param ne Number of experiment time steps
+	 * @param epoch Number of post-diction epochs
+	 * @param alpha Adam optimization hyper parameter \f$\alpha\f$
+	 * @param beta1 Adam optimization hyper parameter \f$\beta_1\f$
+	 * @param beta2 Adam optimization hyper parameter \f$\beta_2\f$
+	 * @param store_s A flag indicating to store the states on disk (if true performance can be affected)
+	 * @param store_p A flag indicating to store intermediate BPPT computations (if true performance can be affected)
+	 * @param precision Storage precision of the weights ('fp32', 'bf16', 'fp16' or 'int8')
+	 * */
+	void e_enablePrecision(LibNRL* nrl,
+				int pID,
+				int ws,
+				float* param,
+				int ne,
+				int epoch,
+				float alpha,
+				float beta1,
+				float beta2,
+				bool store_s,
+				bool store_p,
+				const char* precision){
+
+		nrl->e_enable(pID, ws, param, ne, epoch, alpha, beta1, beta2, store_s, store_p, precision);
+	}
+
 	/**
 	 * Computes the post-diction (inference) process
 	 * @param nrl Pointer to a LibNRL instance
@@ -248,6 +358,18 @@ extern "C" {
 		nrl->a_predict(path, n, input);
 	}
 
+	/**
+	 * Compares the generation with the weights held in each storage precision ('fp32', 'bf16', 'fp16' and 'int8')
+	 * and writes the errors with respect to single precision on disk.
+	 * @param nrl Pointer to a LibNRL instance
+	 * @param path Output file full path
+	 * @param n Number of time steps
+	 * @param input Array with latent state, whose dimension can be obtained through 'getStateDim'
+	 * */
+	void a_precisionReport(LibNRL* nrl, const char* path, int n, float* input){
+		nrl->a_precisionReport(path, n, input);
+	}
+
 	/**
 	 * Computes the output from feed-forwarding a given context.
 	 * This method does not modify the internal state of the network,
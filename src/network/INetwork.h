@@ -50,6 +50,9 @@
 #define NETWORK_INETWORK_H_
 
 #include "../includes.h"
+#include "../utils/Checkpoint.h"
+#include "../utils/Precision.h"
+#include "../utils/Tensor.h"
 
 namespace oist {
 
@@ -72,6 +75,18 @@ public:
 	 * */
 	virtual int getStateDim() = 0;
 
+	/**
+	 * Gets the number of outputs decoded by the network at each time step
+	 * @return An integer representing the dimension
+	 * */
+	virtual int getOutputDim() = 0;
+
+	/**
+	 * Gets the number of units per output (softmax encoding), i.e. the units of the tensors filled by
+	 * @ref t_forward and @ref t_generate
+	 * */
+	virtual const int1DContainer& getOutputUnits() = 0;
+
 	/**
 	 * Load the network model
 	 * @param path Model directory full path
@@ -84,13 +99,57 @@ public:
 	 * */
 	virtual void save(string path) = 0;
 
+	/**
+	 * Load the network model from a binary checkpoint
+	 * @param ckpt Checkpoint containing the model
+	 * */
+	virtual void load(Checkpoint* ckpt) = 0;
+
+	/**
+	 * Save the network model to a binary checkpoint. The network configuration
+	 * is stored in the checkpoint meta entries
+	 * @param ckpt Destination checkpoint
+	 * */
+	virtual void save(Checkpoint* ckpt) = 0;
+
+	/**
+	 * Export the parameters required for experiments, i.e. without gradients and Adam moments
+	 * @param ckpt Destination checkpoint
+	 * @param pIDs IDs of the primitives whose A variables are exported
+	 * */
+	virtual void exportInference(Checkpoint* ckpt, const int1DContainer& pIDs) = 0;
+
+	/**
+	 * Load the parameters exported by @ref exportInference and release the training memory. The memory
+	 * is only released once every block is loaded, hence the training state is kept if an exception is thrown
+	 * @param ckpt Checkpoint containing the network's blocks
+	 * @param pIDs IDs of the exported primitives
+	 * */
+	virtual void loadInference(Checkpoint* ckpt, const int1DContainer& pIDs) = 0;
+
+	/**
+	 * Appends the A variables of new primitives, the parameters and A variables of the existing primitives are kept
+	 * @param n Number of new primitives
+	 * */
+	virtual void addPrimitives(int n) = 0;
+
 	/**
 	 * Get the reconstruction error
-	 * @param gen Container with the output generation by network
+	 * @param gen Output sequence generated by the network (see @ref t_generate)
 	 * @param ref Container with the reference data
+	 * @param ent Sum of the ref*log(ref) terms, see @ref Dataset::targetEntropy
+	 * @return A real value for the reconstruction error
+	 * */
+	virtual float getRecError(const SequenceViewXf& gen, TensorXf& ref, float ent) = 0;
+
+	/**
+	 * Get the reconstruction error from truncated (sparse) reference data
+	 * @param gen Output sequence generated by the network (see @ref t_generate)
+	 * @param ref Container with the truncated reference data
+	 * @param ent Sum of the ref*log(ref) terms, see @ref Dataset::targetEntropy
 	 * @return A real value for the reconstruction error
 	 * */
-	virtual float getRecError(vectorXf2DContainer& gen, vectorXf3DContainer& ref) = 0;
+	virtual float getRecError(const SequenceViewXf& gen, sparseXf3DContainer& ref, float ent) = 0;
 
 	// ------------------------- training mode methods -------------------------
 
@@ -98,37 +157,100 @@ public:
 	 * *[Training mode]* Generation from the prior distribution
 	 * @param n number of time steps
 	 * @param pID Primitive ID
-	 * @param output Container for output recording
+	 * @param output Output tensor with the units of @ref getOutputUnits, the generated sequence is appended as a sample
 	 * */
-	virtual void t_generate(int n, int pID, vectorXf2DContainer& output) = 0;
+	virtual void t_generate(int n, int pID, TensorXf& output) = 0;
 
 	/**
 	 * *[Training mode]* Generation from the posterior distribution
 	 * @param n number of time steps
 	 * @param pID Primitive ID
-	 * @param output Container for output recording
+	 * @param output Output tensor with the units of @ref getOutputUnits, the generated sequence is appended as a sample
 	 * */
-	virtual void t_forward(int n, int pID, vectorXf2DContainer& output) = 0;
+	virtual void t_forward(int n, int pID, TensorXf& output) = 0;
 
 	/**
 	 * *[Training mode]* Back propagation through time computation (inference)
 	 * @param epoch current epoch number
-	 * @param X Input container with network generation from the posterior distribution @ref t_forward
+	 * @param X Output sequence generated from the posterior distribution (see @ref t_forward), the reconstruction
+	 *     error is computed from the output logarithms stored by the last @ref t_forward of the primitive
 	 * @param Y Input container with the reference data
+	 * @param ent Sum of the Y*log(Y) terms of the reference data, see @ref Dataset::targetEntropy
+	 * @param rec Output reconstruction error
+	 * @param reg Output regulation error
+	 * @param loss Output loss function
+	 * */
+	virtual void t_backward(int epoch, const SequenceViewXf& X, TensorXf& Y, float ent, float& rec, float& reg, float& loss) = 0;
+
+	/**
+	 * *[Training mode]* Back propagation through time computation (inference) from truncated (sparse) reference data.
+	 * The reconstruction error is only computed over the non-zero band of the reference data
+	 * @param epoch current epoch number
+	 * @param X Output sequence generated from the posterior distribution (see @ref t_forward), the reconstruction
+	 *     error is computed from the output logarithms stored by the last @ref t_forward of the primitive
+	 * @param Y Input container with the truncated reference data
+	 * @param ent Sum of the Y*log(Y) terms of the reference data, see @ref Dataset::targetEntropy
 	 * @param rec Output reconstruction error
 	 * @param reg Output regulation error
 	 * @param loss Output loss function
 	 * */
-	virtual void t_backward(int epoch, vectorXf2DContainer& X, vectorXf3DContainer& Y, float& rec, float& reg, float& loss) = 0;
+	virtual void t_backward(int epoch, const SequenceViewXf& X, sparseXf3DContainer& Y, float ent, float& rec, float& reg, float& loss) = 0;
 
 	/**
-	 * *[Training mode]* Computes ADAM optimization of parameters
+	 * *[Training mode]* Optimizes the parameters with the optimizer given at construction (see IOptimizer)
 	 * @param pID Primitive ID
-	 * @param alpha Adam optimization hyper parameter \f$\alpha\f$
-	 * @param beta1 Adam optimization hyper parameter \f$\beta_1\f$
-	 * @param beta2 Adam optimization hyper parameter \f$\beta_2\f$
+	 * @param alpha Optimization hyper parameter \f$\alpha\f$
+	 * @param beta1 Optimization hyper parameter \f$\beta_1\f$
+	 * @param beta2 Optimization hyper parameter \f$\beta_2\f$
+	 * */
+	virtual void t_optimize(int pID, float alpha, float beta1, float beta2) = 0;
+
+	/**
+	 * *[Training mode]* Enables the enrollment of a primitive: the weights are frozen, hence their gradients are
+	 * not accumulated nor optimized, and only the A variables of the primitive are optimized
+	 * @param pID ID of the enrolled primitive, a negative value restores the training of all the parameters
 	 * */
-	virtual void t_optAdam(int pID, float alpha, float beta1, float beta2) = 0;
+	virtual void t_enroll(int pID) = 0;
+
+	/**
+	 * *[Training mode]* Freezes parameter groups: their gradients are not accumulated nor optimized (the state
+	 * gradients are still backpropagated), and their text files are not rewritten while unchanged
+	 * @param groups Bit mask of the frozen groups per layer (see LayerGroup)
+	 * @param output Flag indicating to freeze the output layer
+	 * */
+	virtual void t_freeze(const int1DContainer& groups, bool output) = 0;
+
+	/**
+	 * *[Training mode]* Prunes the weights of the layers by magnitude (the biases, the A variables and the output
+	 * layer are kept). The pruned entries stay zero through the following optimization steps, e.g. a short
+	 * fine-tuning, and the pruned layers use sparse inference copies (see the 'sparsedensity' property)
+	 * @param sparsity Fraction of pruned weights, in [0, 1)
+	 * @param global Flag indicating to share the magnitude threshold among all the layers, otherwise each
+	 *     matrix is pruned to the sparsity
+	 * */
+	virtual void t_prune(float sparsity, bool global) = 0;
+
+	/**
+	 * *[Training mode]* Gets the gradients of the trained weights of the output and intermediate layers,
+	 * e.g. for reducing them across workers before @ref t_optimize. The frozen groups are not included
+	 * @param output Output container with a view of each gradient buffer
+	 * */
+	virtual void t_gradients(vector<Map<VectorXf> >& output) = 0;
+
+	/**
+	 * *[Training mode]* Gets the A variables of a primitive and their optimization moments in all the layers,
+	 * e.g. for gathering them from the worker that trains the primitive before saving the model
+	 * @param pID Primitive ID
+	 * @param output Output container with a view of each buffer
+	 * */
+	virtual void t_variables(int pID, vector<Map<VectorXf> >& output) = 0;
+
+	/**
+	 * *[Training mode]* Restricts the optimization of the A variables to the primitives trained by this worker
+	 * of a distributed training
+	 * @param owned Flag per primitive, empty for all the primitives
+	 * */
+	virtual void t_own(const bool1DContainer& owned) = 0;
 
 	// ------------------------- Analysis mode methods -------------------------
 
@@ -151,6 +273,33 @@ public:
 	 * */
 	virtual void a_feedForwardOutputFromContext(float* input, float* output) = 0;
 
+	/**
+	 * *[Analysis mode]* Generation from the prior distribution kept in memory, with the weights in the current precision
+	 * @param n Number of time steps
+	 * @param input Initial latent state of the layers concatenated
+	 * @param output Decoded output of each time step, n x the number of outputs
+	 * */
+	virtual void a_rollout(int n, float* input, float* output) = 0;
+
+	/**
+	 * Sets the storage precision of the inference copies of the weights (generation steps and output layer),
+	 * made from the current weights. The products are accumulated in single precision, and the training and
+	 * the post-diction gradients use the single precision weights, which are therefore kept in addition to the
+	 * copies, also by the models loaded for inference only
+	 * @param precision Precision, the single precision weights are used directly with PRECISION_FP32
+	 * */
+	virtual void setPrecision(Precision precision) = 0;
+
+	/**
+	 * Gets the storage precision of the inference copies of the weights, set by @ref setPrecision
+	 * */
+	virtual Precision getPrecision() = 0;
+
+	/**
+	 * Gets the number of bytes of the weights read by a generation step, in the current precision
+	 * */
+	virtual size_t getGenerationBytes() = 0;
+
 	// ------------------------- Experiment mode methods -------------------------
 
 	/**
@@ -166,9 +315,10 @@ public:
 	 * @param store_inf A flag indicating to store the inference process states. Valuable only if the parameter *store_gen*
 	 *     is set true. Thus should be used only for debugging, since memory allocation for large data may degrade performance.
 	 *     All the computation steps for the *back propagation trough time* (BPPT) algorithm are stored.
+	 * @param precision Storage precision of the inference copies of the weights, see @ref setPrecision
 	 * */
 
-	virtual void e_enable(int pID, int winSize, float* param, int nT, bool store_gen, bool store_inf) = 0;
+	virtual void e_enable(int pID, int winSize, float* param, int nT, bool store_gen, bool store_inf, Precision precision) = 0;
 
 	/**
 	 * *[Experiment mode]* Generation from the prior distribution
@@ -190,13 +340,15 @@ public:
 
 	/**
 	 * *[Experiment mode]* Back propagation through time computation (inference)
-	 * @param X Input container with network generation from the posterior distribution @ref e_forward
+	 * @param X Input container with network generation from the posterior distribution, the reconstruction
+	 *     error is computed from the output logarithms stored by the last @ref e_forward
 	 * @param Y Input container with the reference data
+	 * @param ent Sum of the Y*log(Y) terms of the reference data, see @ref Dataset::targetEntropy
 	 * @param rec Output reconstruction error
 	 * @param reg Output regulation error
 	 * @param loss Output loss function
 	 * */
-	virtual void e_backward(vectorXf2DContainer& X, vectorXf2DContainer& Y, float& rec, float& reg, float& loss) = 0;
+	virtual void e_backward(vectorXf2DContainer& X, vectorXf2DContainer& Y, float ent, float& rec, float& reg, float& loss) = 0;
 
 	/**
 	 * *[Experiment mode]* Copies the network's parameters. It is used for greedy optimization
@@ -209,13 +361,13 @@ public:
 	virtual void e_overwriteParam() = 0;
 
 	/**
-	 * *[Experiment mode]* Computes ADAM optimization of parameters
+	 * *[Experiment mode]* Optimizes the parameters with the optimizer given at construction (see IOptimizer)
 	 * @param pID Primitive ID
-	 * @param alpha Adam optimization hyper parameter \f$\alpha\f$
-	 * @param beta1 Adam optimization hyper parameter \f$\beta_1\f$
-	 * @param beta2 Adam optimization hyper parameter \f$\beta_2\f$
+	 * @param alpha Optimization hyper parameter \f$\alpha\f$
+	 * @param beta1 Optimization hyper parameter \f$\beta_1\f$
+	 * @param beta2 Optimization hyper parameter \f$\beta_2\f$
 	 * */
-	virtual void e_optAdam(int pID, float alpha, float beta1, float beta2) = 0;
+	virtual void e_optimize(int pID, float alpha, float beta1, float beta2) = 0;
 
 	/**
 	 * *[Experiment mode]* Writes the current network state to a float array.
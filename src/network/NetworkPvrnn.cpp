@@ -51,10 +51,26 @@
 
 namespace oist {
 
+	template <>
+	LayerPvrnn* NetworkPvrnnOf<LayerPvrnn>::newLayer(int _l, int _d_num_bottom, int _d_num_top, int _z_sum, IOptimizer* _optimizer, IOptimizer* _aOptimizer){
 
-	NetworkPvrnn::NetworkPvrnn(map<string,float1DContainer>& _float1DMap, Dataset* _dataset){
+		return new LayerPvrnn(_l, d_num[_l], _d_num_bottom, _d_num_top, z_num[_l], _z_sum, tau[_l], (_l > 0 ? tau[_l-1] : 0.0), (_l < layer_num ? tau[_l+1] : 0.0), prim_num, prim_len, w[_l], _optimizer, _aOptimizer);
+	}
+
+	template <>
+	LayerPvrnnLowRank* NetworkPvrnnOf<LayerPvrnnLowRank>::newLayer(int _l, int _d_num_bottom, int _d_num_top, int _z_sum, IOptimizer* _optimizer, IOptimizer* _aOptimizer){
+
+		if ((int)rank.size() != layer_num)
+			throw Exception("'rank' property should include an integer per layer for the network type 'pvrnnlr'");
+
+		return new LayerPvrnnLowRank(_l, d_num[_l], _d_num_bottom, _d_num_top, z_num[_l], _z_sum, tau[_l], (_l > 0 ? tau[_l-1] : 0.0), (_l < layer_num ? tau[_l+1] : 0.0), prim_num, prim_len, w[_l], _optimizer, _aOptimizer, RecurrentLowRank(rank[_l]));
+	}
+
+	template <class Layer>
+	NetworkPvrnnOf<Layer>::NetworkPvrnnOf(map<string,float1DContainer>& _float1DMap, Dataset* _dataset, IOptimizer* _optimizer, IOptimizer* _aOptimizer){
 
 		dataset = _dataset;
+		optimizer = _optimizer;
 
 		if(_float1DMap.find("d") == _float1DMap.end()) throw Exception("'d' property not found");
 		float1DContainer fDNum = _float1DMap["d"];
@@ -90,6 +106,36 @@ namespace oist {
 				throw Exception("'w' property should include positive real number(s)");
 		}
 
+		// optional, the pruned weights below this density use sparse inference copies (the layers set the default)
+		float1DContainer fDensity;
+		if(_float1DMap.find("sparsedensity") != _float1DMap.end()){
+			fDensity = _float1DMap["sparsedensity"];
+			if (fDensity.size() != 1 || fDensity[0] < 0 || fDensity[0] > 1)
+				throw Exception("'sparsedensity' property should be a real number in [0, 1]");
+		}
+
+		// optional, used by the low-rank layers
+		if(_float1DMap.find("rank") != _float1DMap.end()){
+			float1DContainer fRank = _float1DMap["rank"];
+			for (unsigned int i = 0; i < fRank.size(); i++){
+				int v = int(fRank[i]);
+				if (v <= 0)
+					throw Exception("'rank' property should include positive integer(s) greater than zero");
+				rank.push_back(v);
+			}
+		}
+
+		// optional, multi-timescale execution: update period of each layer, zero derives it from the time constants
+		if(_float1DMap.find("clock") != _float1DMap.end()){
+			float1DContainer fClock = _float1DMap["clock"];
+			for (unsigned int i = 0; i < fClock.size(); i++){
+				int v = int(fClock[i]);
+				if (v < 0)
+					throw Exception("'clock' property should include positive integer(s), or zero");
+				clock.push_back(v);
+			}
+		}
+
 		layer_num = d_num.size();
 		ut = Utils::getInstance();
 
@@ -98,6 +144,15 @@ namespace oist {
 		if (checksum != layer_num*4)
 			throw  Exception("The network parameters are not correctly defined");
 
+		if (clock.size() <= 1)
+			clock.assign(layer_num, clock.empty() ? 1 : clock[0]);
+		if ((int)clock.size() != layer_num)
+			throw Exception("'clock' property should include an integer per layer, or a single one for all the layers");
+		for (int l = 0; l < layer_num; l++){
+			if (clock[l] == 0)
+				clock[l] = max(1, tau[l]/tau[0]);
+		}
+
 		dataset->getNunitsPerDim(o_num);
 		prim_num = _dataset->getNPrim();
 		prim_len = dataset->getPrimLength();
@@ -111,14 +166,23 @@ namespace oist {
 		reg_coef = 1.0/((float)(z_sum*1.0));
 
 		cout << "Number of internal layers: " << layer_num << endl;
+		if (*max_element(clock.begin(), clock.end()) > 1){
+			cout << "Layer update periods:";
+			for (int l = 0; l < layer_num; l++)
+				cout << " " << clock[l];
+			cout << endl;
+		}
 		state_dim  = 0;
 		for (int l = 0; l < layer_num; l++){
 
 			int d_num_bottom = (l==0)? 0 : d_num[l-1];
 			int d_num_top = (l==layer_num-1)? 0 : d_num[l+1];
 
-			ILayer* layer = new LayerPvrnn(l, d_num[l], d_num_bottom, d_num_top, z_num[l], z_sum, tau[l], (l > 0 ? tau[l-1] : 0.0), (l < layer_num ? tau[l+1] : 0.0), prim_num, prim_len, w[l]);
+			Layer* layer = newLayer(l, d_num_bottom, d_num_top, z_sum, _optimizer, _aOptimizer);
 			layers.push_back(layer);
+			if (!fDensity.empty())
+				layer->setSparseDensity(fDensity[0]);
+			contexts.push_back(static_cast<ContextPvrnn*>(layer->getContext()));
 			state_dim += layer->getStateDim();
 	
 		}
@@ -126,7 +190,7 @@ namespace oist {
 		// connections to output layers
 		l0_d_num = d_num[0];
 		l0 = layers[0];
-		l0_context = static_cast<ContextPvrnn*>(l0->getContext());
+		l0_context = contexts[0];
 
 		for (int o = 0; o < o_dim ; o++){
 
@@ -135,16 +199,34 @@ namespace oist {
 			MatrixXf WdxT_ = Wdx_.transpose();
 			Wdo.push_back(Wdx_);
 			Wdo_transpose.push_back(WdxT_);
-			g_Wdo.push_back(MatrixXf::Zero(num, l0_d_num));
-			m_Wdo.push_back(MatrixXf::Zero(num, l0_d_num));
-			v_Wdo.push_back(MatrixXf::Zero(num, l0_d_num));
+			g_Wdo.push_back(MatrixXf());
+			m_Wdo.push_back(MatrixXf());
+			v_Wdo.push_back(MatrixXf());
+			IOptimizer::allocate<MatrixXf>(optimizer, &Wdo.back(), &g_Wdo.back(), &m_Wdo.back(), &v_Wdo.back());
 			Bo.push_back(ut->kaiming_uniform_initialization(num));
-			g_Bo.push_back(VectorXf::Zero(num));
-			m_Bo.push_back(VectorXf::Zero(num));
-			v_Bo.push_back(VectorXf::Zero(num));
+			g_Bo.push_back(VectorXf());
+			m_Bo.push_back(VectorXf());
+			v_Bo.push_back(VectorXf());
+			IOptimizer::allocate<VectorXf>(optimizer, &Bo.back(), &g_Bo.back(), &m_Bo.back(), &v_Bo.back());
 
 		}
 
+		// fused output head, all the heads are stacked in a single block for decoding
+		int o_total = 0;
+		for (int o = 0; o < o_dim ; o++){
+			o_offset.push_back(o_total);
+			o_total += o_num[o];
+		}
+		Wo_fused = MatrixXf::Zero(o_total, l0_d_num);
+		Bo_fused = VectorXf::Zero(o_total);
+		o_act = VectorXf::Zero(o_total);
+		e_precision = PRECISION_FP32;
+		dataset->getDecodingGrid(o_grid);
+		for (int o = 0; o < o_dim ; o++)
+			fuseOutput(o);
+
+		enroll_id = -1;
+		o_frozen = false;
 		e_prim_id = 0;
 		e_cur_time = 0;
 		e_num_times = 0;
@@ -153,106 +235,176 @@ namespace oist {
 		e_store_inference  = false;;
 	}
 
-	int NetworkPvrnn::getNLayers(){
+	template <class Layer>
+
+	int NetworkPvrnnOf<Layer>::getNLayers(){
 
 		return layer_num;
 	}
 
-	int NetworkPvrnn::getStateDim(){
+	template <class Layer>
+
+	int NetworkPvrnnOf<Layer>::getStateDim(){
 
 		return state_dim;
 
 	}
 
-	void NetworkPvrnn::t_generate(int _n, int _prim_id, vectorXf2DContainer& _X){
+	template <class Layer>
+
+	int NetworkPvrnnOf<Layer>::getOutputDim(){
+
+		return o_dim;
+
+	}
+
+	template <class Layer>
+
+	const int1DContainer& NetworkPvrnnOf<Layer>::getOutputUnits(){
+
+		return o_num;
+
+	}
+
+	template <class Layer>
+
+	void NetworkPvrnnOf<Layer>::t_generate(int _n, int _prim_id, TensorXf& _X){
+
+		 if (_X.getUnits() != o_num)
+			 throw Exception("The output tensor does not match the output units of the network");
+		 Map<MatrixXf> X = _X.append(_n);
 
 		 for (int l = 0 ; l < layer_num; l++){
 			 layers[l]->initContext(_prim_id);
 		 }
 
 		 for (int t = 0; t < _n; t++){
-			 arrayXf1DContainer dp_prev;
-			 for (int l = 0; l < layer_num; l++){
-				 dp_prev.push_back(static_cast<ContextPvrnn*>(layers[l]->getContext())->t_dp[_prim_id].back());
-			 }
-
+			 // the inputs from the bottom and top layers are their previous states, set before updating any layer
 			 for (int l = 0; l < layer_num; l++){
-				 ILayer* ll = layers[l];
-				 ContextPvrnn* lc = static_cast<ContextPvrnn*>(ll->getContext());
+				 ContextPvrnn* lc = contexts[l];
 
 				 if (l > 0 ){
-					 lc ->dp_bottom_prev = dp_prev[l-1];
+					 lc->dp_bottom_prev = contexts[l-1]->t_dp[_prim_id].back();
 				 }
 				 if (l < layer_num-1){
-					 lc ->dp_top_prev = dp_prev[l+1];
+					 lc->dp_top_prev = contexts[l+1]->t_dp[_prim_id].back();
 				 }
+				 lc->tick = ticks(l, t);
+			 }
 
-				 ll->t_generate(t, _prim_id);
+			 for (int l = 0; l < layer_num; l++){
+				 layers[l]->t_generate(t, _prim_id);
 			}
 			VectorXf dp0 = l0_context->t_dp[_prim_id].back();
 
-			vectorXf1DContainer Xt;
 			for (int o = 0; o < o_dim; o++){
 
 				 VectorXf Xto = Wdo[o]*dp0 + Bo[o];
 				 ut->softmax<VectorXf>(&Xto);
-				 Xt.push_back(Xto);
+				 X.col(t).segment(o_offset[o], o_num[o]) = Xto;
 			}
-
-			_X.push_back(Xt);
 		 }
 	 }
 
 
-	 void NetworkPvrnn::t_forward(int _n, int _prim_id, vectorXf2DContainer& _X){
+	 template <class Layer>
 
-		 for (int l = 0 ; l < layer_num; l++){
-			 layers[l]->initContext(_prim_id);
-		 }
 
-		 for (int t = 0; t < _n; t++){
-			 arrayXf1DContainer dp_prev;
-			 arrayXf1DContainer dq_prev;
+	 void NetworkPvrnnOf<Layer>::t_forward(int _n, int _prim_id, TensorXf& _X){
 
-			 for (int l = 0; l < layer_num; l++){
+		 if (_X.getUnits() != o_num)
+			 throw Exception("The output tensor does not match the output units of the network");
+		 Map<MatrixXf> X = _X.append(_n);
 
-				 ILayer* ll = layers[l];
-				 ContextPvrnn* lc = static_cast<ContextPvrnn*>(ll->getContext());
-				 dp_prev.push_back(lc->t_dp[_prim_id].back());
-				 dq_prev.push_back(lc->t_dq[_prim_id].back());
+		 // the output logarithms are kept per primitive since all the forward passes precede the backward ones
+		 if ((int)t_logX.size() <= _prim_id)
+			 t_logX.resize(_prim_id+1);
+		 MatrixXf& logX = t_logX[_prim_id];
+		 logX.resize(_X.getRows(), _n);
 
-			 }
+		 for (int l = 0 ; l < layer_num; l++){
+			 layers[l]->initContext(_prim_id);
+		 }
 
+		 for (int t = 0; t < _n; t++){
+			 // the inputs from the bottom and top layers are their previous states, set before updating any layer
 			 for (int l = 0; l < layer_num; l++){
 
-				 ILayer* ll = layers[l];
-				 ContextPvrnn* lc = static_cast<ContextPvrnn*>(ll->getContext());
+				 ContextPvrnn* lc = contexts[l];
 
 				 if (l > 0 ){
-					 lc->dp_bottom_prev = dp_prev[l-1];
-					 lc->dq_bottom_prev = dq_prev[l-1];
+					 lc->dp_bottom_prev = contexts[l-1]->t_dp[_prim_id].back();
+					 lc->dq_bottom_prev = contexts[l-1]->t_dq[_prim_id].back();
 				 }
 				 if (l < layer_num-1){
-					 lc->dp_top_prev = dp_prev[l+1];
-					 lc->dq_top_prev = dq_prev[l+1];
+					 lc->dp_top_prev = contexts[l+1]->t_dp[_prim_id].back();
+					 lc->dq_top_prev = contexts[l+1]->t_dq[_prim_id].back();
 				 }
+				 lc->tick = ticks(l, t);
+			 }
 
-				 ll->t_forward(t, _prim_id);
+			 for (int l = 0; l < layer_num; l++){
+				 layers[l]->t_forward(t, _prim_id);
 			 }
 			 VectorXf dq0 = l0_context->t_dq[_prim_id].back();
-			 vectorXf1DContainer Xt;
 			 for (int o = 0; o < o_dim; o++){
 
 				 VectorXf Xto = Wdo[o]*dq0 + Bo[o];
-				 ut->softmax<VectorXf>(&Xto);
-				 Xt.push_back(Xto);
+				 VectorXf logXto;
+				 ut->softmax<VectorXf>(&Xto, &logXto);
+				 X.col(t).segment(o_offset[o], o_num[o]) = Xto;
+				 logX.col(t).segment(o_offset[o], o_num[o]) = logXto;
 			 }
-			 _X.push_back(Xt);
 		 }
 
 	}
 
-	 void NetworkPvrnn::t_backward(int _prim_id, vectorXf2DContainer& _X, vectorXf3DContainer& _Y, float& _rec, float& _reg, float& _loss){
+	 template <class Layer>
+
+	 void NetworkPvrnnOf<Layer>::t_backward(int _prim_id, const SequenceViewXf& _X, TensorXf& _Y, float _ent, float& _rec, float& _reg, float& _loss){
+		 backward<TensorXf>(_prim_id, _X, _Y, _ent, _rec, _reg, _loss);
+	 }
+
+	 template <class Layer>
+
+	 void NetworkPvrnnOf<Layer>::t_backward(int _prim_id, const SequenceViewXf& _X, sparseXf3DContainer& _Y, float _ent, float& _rec, float& _reg, float& _loss){
+		 backward<sparseXf3DContainer>(_prim_id, _X, _Y, _ent, _rec, _reg, _loss);
+	 }
+
+	 template <class Layer>
+
+	 float NetworkPvrnnOf<Layer>::outputLoss(const Ref<const VectorXf>& _X, const Ref<const VectorXf>& _logX, const Ref<const VectorXf>& _Y, VectorXf* _g){
+
+		 // the Y*log(Y) terms are constant, the reference entropy is added once by the caller
+		 if (_g != nullptr)
+			 *_g = rec_coef*(_X-_Y);
+		 return -_Y.dot(_logX);
+	 }
+
+	 template <class Layer>
+
+	 float NetworkPvrnnOf<Layer>::outputLoss(const Ref<const VectorXf>& _X, const Ref<const VectorXf>& _logX, const SparseVectorXf& _Y, VectorXf* _g){
+
+		 // the units out of the band have zero reference, hence they do not add to the error
+		 int n = _Y.values.size();
+		 if (_g != nullptr){
+			 *_g = _X;
+			 _g->segment(_Y.first, n) -= _Y.values;
+			 *_g *= rec_coef;
+		 }
+		 return -_Y.values.dot(_logX.segment(_Y.first, n));
+	 }
+
+	 template <class Layer> template <typename T>
+	 void NetworkPvrnnOf<Layer>::backward(int _prim_id, const SequenceViewXf& _X, T& _Y, float _ent, float& _rec, float& _reg, float& _loss){
+
+		 if ((int)t_logX.size() <= _prim_id || t_logX[_prim_id].cols() != (int)_X.size()){
+			 stringstream stream;
+			 stream << "The output of primitive " << _prim_id << " does not match its last forward computation";
+			 throw Exception(stream.str());
+		 }
+		 const MatrixXf& logX = t_logX[_prim_id];
+		 _rec += _ent;
 
 		 float1DContainer klDiv_l;
 		 for (int l = 0; l < layer_num; l++){
@@ -262,7 +414,7 @@ namespace oist {
 		 for (unsigned int s = 0; s < _Y.size(); s++){ // for all the batch samples
 
 
-			 vectorXf2DContainer Ys = _Y[s];
+			 const typename T::value_type& Ys = _Y[s];
 			 vector<VectorXf> gH;
 			 vector<VectorXf> gH_next;
 			 for (int l = 0; l < layer_num; l++){
@@ -275,44 +427,52 @@ namespace oist {
 
 			 for (int t = prim_len; t > 0; t--, t_prev--){
 
-				 vectorXf1DContainer X_t = _X[t_prev];
-				 vectorXf1DContainer Y_st = Ys[t_prev];
+				 StepViewXf X_t = _X[t_prev];
+				 const typename T::value_type::value_type& Y_st = Ys[t_prev];
 				 VectorXf g_dqloss =  VectorXf::Zero(l0_d_num);
 				 RowVectorXf L0_dq = l0_context->t_dq[_prim_id][t];
 
 				 for (int o = 0; o < o_dim; o++){
 
-					 ArrayXf Xpto = X_t[o];
-					 ArrayXf Ypsto = Y_st[o];
-					 ArrayXf yx = (Ypsto/Xpto) + NON_ZERO;
-					 VectorXf recErr_t = Ypsto*(yx.log());
-					 VectorXf gxloss_to = rec_coef*(Xpto-Ypsto);
+					 VectorXf gxloss_to;
+					 float recErr_t = outputLoss(X_t[o], logX.col(t_prev).segment(o_offset[o], o_num[o]), Y_st[o], &gxloss_to);
 
 					 g_dqloss += Wdo_transpose[o]*gxloss_to ;
 
-					 g_Wdo[o] += gxloss_to*L0_dq;
-					 g_Bo[o] += gxloss_to;
+					 if (enroll_id < 0 && !o_frozen){
+						 g_Wdo[o] += gxloss_to*L0_dq;
+						 g_Bo[o] += gxloss_to;
+					 }
 
-					 _rec += recErr_t.sum();
+					 _rec += recErr_t;
 
 				}
 
 				for (int l = 0; l < layer_num; l++){
-					ILayer* ll = layers[l];
-					ContextPvrnn* lc = static_cast<ContextPvrnn*>(ll->getContext());
+					Layer* ll = layers[l];
+					ContextPvrnn* lc = contexts[l];
 
 
+					// the states at time t+1 of the layers holding them do not depend on the neighbours
 					if (l > 0 ){
-						lc->g_hq_bottom_next = gH_next[l-1];
-						lc->dq_bottom_prev = static_cast<ContextPvrnn*>(layers[l-1]->getContext())->t_dq[_prim_id][t_prev];
+						if (ticks(l-1, t))
+							lc->g_hq_bottom_next = gH_next[l-1];
+						else
+							ut->zero<VectorXf>(&lc->g_hq_bottom_next);
+						lc->dq_bottom_prev = contexts[l-1]->t_dq[_prim_id][t_prev];
 					}
 					else{
 						lc->g_dqloss = g_dqloss;
 					}
 					if (l < layer_num-1){
-						lc->g_hq_top_next = gH_next[l+1];
-						lc->dq_top_prev = static_cast<ContextPvrnn*>(layers[l+1]->getContext())->t_dq[_prim_id][t_prev];
+						if (ticks(l+1, t))
+							lc->g_hq_top_next = gH_next[l+1];
+						else
+							ut->zero<VectorXf>(&lc->g_hq_top_next);
+						lc->dq_top_prev = contexts[l+1]->t_dq[_prim_id][t_prev];
 					}
+					lc->tick = ticks(l, t_prev);
+					lc->tick_next = ticks(l, t);
 
 					ll->t_backward(t, _prim_id);
 
@@ -334,56 +494,187 @@ namespace oist {
 	 }
 
 
-	 void NetworkPvrnn::t_optAdam(int _e, float _a, float _b1, float _b2){
+	 template <class Layer>
+
+
+	 void NetworkPvrnnOf<Layer>::fuseOutput(int _o){
+
+		 Wo_fused.middleRows(o_offset[_o], o_num[_o]) = Wdo[_o];
+		 Bo_fused.segment(o_offset[_o], o_num[_o]) = Bo[_o];
+	 }
+
+	 template <class Layer>
+
+	 void NetworkPvrnnOf<Layer>::reducedOutput(const float* _d0){
+
+		 o_act = Bo_fused;
+		 Wo_reduced.gemv(_d0, o_act.data());
+	 }
+
+	 template <class Layer>
+
+	 void NetworkPvrnnOf<Layer>::decodeOutput(const ArrayXf& _d0, float* _out){
+
+		 if (e_precision != PRECISION_FP32)
+			 reducedOutput(_d0.data());
+		 else{
+			 o_act.noalias() = Wo_fused*_d0.matrix();
+			 o_act += Bo_fused;
+		 }
+		 o_act = o_act.array().exp();
+
+		 // the softmax normalization is applied to the decoded value instead of each unit
+		 for (int o = 0; o < o_dim; o++, _out++){
+			 int n = o_num[o];
+			 int k = o_offset[o];
+			 *_out = o_act.segment(k, n).dot(o_grid.segment(k, n))/o_act.segment(k, n).sum();
+		 }
+	 }
+
+	 template <class Layer>
 
-		 for (int o = 0; o < o_dim; o++){
+	 void NetworkPvrnnOf<Layer>::t_optimize(int _e, float _a, float _b1, float _b2){
+
+		 // the output heads are frozen while enrolling a primitive or by the freeze property
+		 for (int o = 0; o < o_dim && enroll_id < 0 && !o_frozen; o++){
 
 			 // updating parameters
-			 ut->adam<MatrixXf>(&Wdo[o], &g_Wdo[o], &m_Wdo[o], &v_Wdo[o], _e, _a, _b1, _b2);
-			 ut->adam<VectorXf>(&Bo[o], &g_Bo[o], &m_Bo[o], &v_Bo[o], _e, _a, _b1, _b2);
+			 optimizer->step<MatrixXf>(&Wdo[o], &g_Wdo[o], &m_Wdo[o], &v_Wdo[o], _e, _a, _b1, _b2);
+			 optimizer->step<VectorXf>(&Bo[o], &g_Bo[o], &m_Bo[o], &v_Bo[o], _e, _a, _b1, _b2);
 
 			 Wdo_transpose[o] = Wdo[o].transpose();
+			 fuseOutput(o);
 
 			 // clearing parameter gradients
 			 ut->zero<MatrixXf>(&g_Wdo[o]);
 			 ut->zero<VectorXf>(&g_Bo[o]);
+			 o_synced.clear();
 		 }
 
 		 // updating the layer parameters
 		 for (int l = 0; l < layer_num; l++){
-		 	layers[l]->t_optAdam(_e, _a, _b1, _b2);
+		 	layers[l]->t_optimize(_e, _a, _b1, _b2);
 		 }
 
 	 }
 
 
-	 float NetworkPvrnn::getRecError(vectorXf2DContainer& _X, vectorXf3DContainer&  _Y){
+	 template <class Layer>
+
+
+	 void NetworkPvrnnOf<Layer>::t_enroll(int _prim_id){
+
+		 enroll_id = _prim_id;
+		 for (int l = 0; l < layer_num; l++){
+		 	layers[l]->t_enroll(_prim_id);
+		 }
+	 }
+
+	 template <class Layer>
+
+	 void NetworkPvrnnOf<Layer>::t_freeze(const int1DContainer& _groups, bool _output){
 
-		 float rec = 0.0;
+		 if ((int)_groups.size() != layer_num){
+			 stringstream stream;
+			 stream << "The frozen groups of " << _groups.size() << " layers do not match the network of " << layer_num << " layers";
+			 throw oist::Exception(stream.str());
+		 }
+		 o_frozen = _output;
+		 for (int l = 0; l < layer_num; l++){
+		 	layers[l]->t_freeze(_groups[l]);
+		 }
+	 }
+
+	template <class Layer>
+
+	void NetworkPvrnnOf<Layer>::t_prune(float _sparsity, bool _global){
+
+		// a global pruning shares the threshold of the weights of all the layers
+		float threshold = -1.0;
+		if (_global){
+			vector<MatrixXf*> weights;
+			for (int l = 0; l < layer_num; l++){
+				layers[l]->getPrunable(weights);
+			}
+			threshold = Pruning::threshold(weights, _sparsity);
+		}
+		for (int l = 0; l < layer_num; l++){
+			layers[l]->t_prune(_sparsity, threshold);
+		}
+		setPrecision(e_precision);
+	}
+
+	 template <class Layer>
+
+	 void NetworkPvrnnOf<Layer>::t_gradients(vector<Map<VectorXf> >& _output){
+
+		 for (int o = 0; o < o_dim && enroll_id < 0 && !o_frozen; o++){
+			 _output.push_back(Map<VectorXf>(g_Wdo[o].data(), g_Wdo[o].size()));
+			 _output.push_back(Map<VectorXf>(g_Bo[o].data(), g_Bo[o].size()));
+		 }
+		 for (int l = 0; l < layer_num; l++){
+		 	layers[l]->t_gradients(_output);
+		 }
+	 }
+
+	 template <class Layer>
+
+	 void NetworkPvrnnOf<Layer>::t_variables(int _prim_id, vector<Map<VectorXf> >& _output){
+
+		 for (int l = 0; l < layer_num; l++){
+		 	layers[l]->t_variables(_prim_id, _output);
+		 }
+	 }
+
+	 template <class Layer>
+
+	 void NetworkPvrnnOf<Layer>::t_own(const bool1DContainer& _owned){
+
+		 for (int l = 0; l < layer_num; l++){
+		 	layers[l]->t_own(_owned);
+		 }
+	 }
+
+	 template <class Layer>
+
+	 float NetworkPvrnnOf<Layer>::getRecError(const SequenceViewXf& _X, TensorXf&  _Y, float _ent){
+		 return recError<TensorXf>(_X, _Y, _ent);
+	 }
+
+	 template <class Layer>
+
+	 float NetworkPvrnnOf<Layer>::getRecError(const SequenceViewXf& _X, sparseXf3DContainer&  _Y, float _ent){
+		 return recError<sparseXf3DContainer>(_X, _Y, _ent);
+	 }
+
+	 template <class Layer> template <typename T>
+	 float NetworkPvrnnOf<Layer>::recError(const SequenceViewXf& _X, T&  _Y, float _ent){
+
+		 // the generated outputs have no stored logarithms
+		 MatrixXf logX = (_X.matrix().array() + NON_ZERO).log().matrix();
+
+		 float rec = _ent;
 
 		 for (unsigned int s = 0; s < _Y.size(); s++){
 
-			 vectorXf2DContainer Ys = _Y[s];
+			 const typename T::value_type& Ys = _Y[s];
 
 			 for (unsigned int t = 0; t < Ys.size(); t++){
 
-				 vectorXf1DContainer Yst = Ys[t];
-				 vectorXf1DContainer Xt = _X[t];
+				 const typename T::value_type::value_type& Yst = Ys[t];
+				 StepViewXf Xt = _X[t];
 
 				 for (int o = 0; o < o_dim; o++){
-
-					 ArrayXf Xpto = Xt[o];
-					 ArrayXf Ypsto = Yst[o];
-					 ArrayXf yx = (Ypsto/Xpto) + NON_ZERO;
-					 VectorXf recErr_t = Ypsto*(yx.log());
-					 rec += recErr_t.sum();
+					 rec += outputLoss(Xt[o], logX.col(t).segment(o_offset[o], o_num[o]), Yst[o], nullptr);
 				 }
 			 }
 		 }
 		 return rec;
 	 }
 
-	void NetworkPvrnn::print(){
+	template <class Layer>
+
+	void NetworkPvrnnOf<Layer>::print(){
 
 		cout << "Output layer:" << endl;
 
@@ -422,7 +713,9 @@ namespace oist {
 		}
 	}
 
-	void NetworkPvrnn::load(string _path){
+	template <class Layer>
+
+	void NetworkPvrnnOf<Layer>::load(string _path){
 
 		std::string delimiter = ut->getDelimiter();
 
@@ -467,6 +760,9 @@ namespace oist {
 						ut->loadEigen<VectorXf>(buff_bFile[k], buff_b[k], delimiter);
 					}
 
+					Wdo_transpose[o] = Wdo[o].transpose();
+					fuseOutput(o);
+
 					//closing files
 					wFile.close();		 m_wFile.close();		 v_wFile.close();
 					bFile.close();		 m_bFile.close();		 v_bFile.close();
@@ -483,6 +779,8 @@ namespace oist {
 			for (int l = 0; l < layer_num; l++){
 				layers[l]->load(_path);
 			}
+			setPrecision(e_precision);
+			o_synced = _path;
 			cout << "Model loaded!" << endl;
 		}
 		catch(Exception& _e){
@@ -491,11 +789,15 @@ namespace oist {
 	}
 
 
-	void NetworkPvrnn::save(string _path){
+	template <class Layer>
+
+
+	void NetworkPvrnnOf<Layer>::save(string _path){
 
 		std::string delimiter = ut->getDelimiter();
 
-		for (int o = 0; o < o_dim; o++){
+		// the files of the output layer are kept while unchanged since the last save (e.g. frozen)
+		for (int o = 0; o < o_dim && _path != o_synced; o++){
 
 			// saving the output layer parameters
 			MatrixXf* w_p = &Wdo[o];
@@ -557,6 +859,8 @@ namespace oist {
 				throw oist::Exception(strm.str());
 			}
 		}
+		o_synced = _path;
+
 		try{
 			// saving layer's data
 			for (int l = 0; l < layer_num; l++){
@@ -570,10 +874,203 @@ namespace oist {
 		}
 	}
 
+	template <class Layer>
+
+	bool NetworkPvrnnOf<Layer>::ticks(int _l, int _t){
+
+		return _t % clock[_l] == 0;
+	}
+
+	template <class Layer>
+
+	void NetworkPvrnnOf<Layer>::setConfig(Checkpoint* _ckpt){
+
+		float1DContainer fDNum(d_num.begin(), d_num.end());
+		float1DContainer fZNum(z_num.begin(), z_num.end());
+		float1DContainer fTau(tau.begin(), tau.end());
+		float1DContainer fONum(o_num.begin(), o_num.end());
+
+		_ckpt->setMeta("d", fDNum);
+		_ckpt->setMeta("z", fZNum);
+		_ckpt->setMeta("t", fTau);
+		_ckpt->setMeta("w", w);
+		_ckpt->setMeta("o", fONum);
+		_ckpt->setMeta("prim_num", prim_num);
+		_ckpt->setMeta("prim_len", prim_len);
+		if (!rank.empty()){
+			float1DContainer fRank(rank.begin(), rank.end());
+			_ckpt->setMeta("rank", fRank);
+		}
+		if (*max_element(clock.begin(), clock.end()) > 1){
+			float1DContainer fClock(clock.begin(), clock.end());
+			_ckpt->setMeta("clock", fClock);
+		}
+	}
+
+	template <class Layer>
+
+	void NetworkPvrnnOf<Layer>::checkConfig(Checkpoint* _ckpt){
+
+		// verifying the network configuration
+		float1DContainer fDNum, fZNum, fONum;
+		if (!_ckpt->getMeta("d", fDNum) || !_ckpt->getMeta("z", fZNum) || !_ckpt->getMeta("o", fONum))
+			throw oist::Exception("The checkpoint does not contain the network configuration");
+
+		bool match = ((int)fDNum.size() == layer_num) && ((int)fZNum.size() == layer_num) && ((int)fONum.size() == o_dim);
+		for (int l = 0; match && l < layer_num; l++)
+			match = (int(fDNum[l]) == d_num[l]) && (int(fZNum[l]) == z_num[l]);
+		for (int o = 0; match && o < o_dim; o++)
+			match = (int(fONum[o]) == o_num[o]);
+		float1DContainer fRank;
+		if (!rank.empty() && _ckpt->getMeta("rank", fRank)){
+			match = match && (fRank.size() == rank.size());
+			for (unsigned int l = 0; match && l < rank.size(); l++)
+				match = (int(fRank[l]) == rank[l]);
+		}
+		// the update periods change the dynamics learned by the model, the checkpoints without them update every step
+		float1DContainer fClock(layer_num, 1.0);
+		_ckpt->getMeta("clock", fClock);
+		match = match && ((int)fClock.size() == layer_num);
+		for (int l = 0; match && l < layer_num; l++)
+			match = (int(fClock[l]) == clock[l]);
+		if (!match)
+			throw oist::Exception("The checkpoint network configuration ('d', 'z', 'rank', 'clock', or the output encoding) differs from the model properties");
+	}
+
+	template <class Layer>
+
+	void NetworkPvrnnOf<Layer>::exportInference(Checkpoint* _ckpt, const int1DContainer& _prim_ids){
+
+		setConfig(_ckpt);
+
+		for (int o = 0; o < o_dim; o++){
+
+			// saving the output layer parameters
+			stringstream strm; strm << "o" << o;
+			string prefix = strm.str();
+
+			_ckpt->add<MatrixXf>(prefix + "_w_p", &Wdo[o]);
+			_ckpt->add<VectorXf>(prefix + "_b_p", &Bo[o]);
+		}
+
+		for (int l = 0; l < layer_num; l++){
+			layers[l]->exportInference(_ckpt, _prim_ids);
+		}
+	}
+
+	template <class Layer>
+
+	void NetworkPvrnnOf<Layer>::loadInference(Checkpoint* _ckpt, const int1DContainer& _prim_ids){
+
+		checkConfig(_ckpt);
+
+		for (int o = 0; o < o_dim; o++){
+
+			// loading the output layer parameters
+			stringstream strm; strm << "o" << o;
+			string prefix = strm.str();
+
+			_ckpt->get<MatrixXf>(prefix + "_w_p", &Wdo[o]);
+			_ckpt->get<VectorXf>(prefix + "_b_p", &Bo[o]);
+			Wdo_transpose[o] = Wdo[o].transpose();
+			fuseOutput(o);
+		}
+
+		for (int l = 0; l < layer_num; l++){
+			layers[l]->loadInference(_ckpt, _prim_ids);
+		}
+		setPrecision(e_precision);
+
+		// the training memory is released once every block is loaded
+		for (int o = 0; o < o_dim; o++){
+			g_Wdo[o].resize(0,0);
+			m_Wdo[o].resize(0,0);
+			v_Wdo[o].resize(0,0);
+			g_Bo[o].resize(0);
+			m_Bo[o].resize(0);
+			v_Bo[o].resize(0);
+		}
+		for (int l = 0; l < layer_num; l++){
+			layers[l]->releaseTraining(_prim_ids);
+		}
+	}
+
+	template <class Layer>
+
+	void NetworkPvrnnOf<Layer>::addPrimitives(int _n){
+
+		for (int l = 0; l < layer_num; l++){
+			layers[l]->addPrimitives(_n);
+		}
+		prim_num += _n;
+	}
+
+	template <class Layer>
+
+	void NetworkPvrnnOf<Layer>::load(Checkpoint* _ckpt){
+
+		checkConfig(_ckpt);
+
+		for (int o = 0; o < o_dim; o++){
+
+			// loading the output layer parameters
+			stringstream strm; strm << "o" << o;
+			string prefix = strm.str();
+
+			_ckpt->get<MatrixXf>(prefix + "_w_p", &Wdo[o]);
+			_ckpt->get<MatrixXf>(prefix + "_w_m", &m_Wdo[o]);
+			_ckpt->get<MatrixXf>(prefix + "_w_v", &v_Wdo[o]);
+			_ckpt->get<VectorXf>(prefix + "_b_p", &Bo[o]);
+			_ckpt->get<VectorXf>(prefix + "_b_m", &m_Bo[o]);
+			_ckpt->get<VectorXf>(prefix + "_b_v", &v_Bo[o]);
+
+			Wdo_transpose[o] = Wdo[o].transpose();
+			fuseOutput(o);
+		}
+
+		// load layers data
+		for (int l = 0; l < layer_num; l++){
+			layers[l]->load(_ckpt);
+		}
+		setPrecision(e_precision);
+		o_synced.clear();
+		cout << "Model loaded!" << endl;
+	}
+
+	template <class Layer>
+
+	void NetworkPvrnnOf<Layer>::save(Checkpoint* _ckpt){
+
+		setConfig(_ckpt);
+
+		for (int o = 0; o < o_dim; o++){
+
+			// saving the output layer parameters
+			stringstream strm; strm << "o" << o;
+			string prefix = strm.str();
+
+			_ckpt->add<MatrixXf>(prefix + "_w_p", &Wdo[o]);
+			_ckpt->add<MatrixXf>(prefix + "_w_m", &m_Wdo[o]);
+			_ckpt->add<MatrixXf>(prefix + "_w_v", &v_Wdo[o]);
+			_ckpt->add<VectorXf>(prefix + "_b_p", &Bo[o]);
+			_ckpt->add<VectorXf>(prefix + "_b_m", &m_Bo[o]);
+			_ckpt->add<VectorXf>(prefix + "_b_v", &v_Bo[o]);
+		}
+
+		// saving layer's data
+		for (int l = 0; l < layer_num; l++){
+			layers[l]->save(_ckpt);
+		}
+	}
+
 	 	 // ------------------------- Experiment model methods -------------------------
 
-	void NetworkPvrnn::e_enable(int _seqId, int _winSize, float* _params, int _exp_num_times, bool _storeStates, bool _storeER){
+	template <class Layer>
 
+	void NetworkPvrnnOf<Layer>::e_enable(int _seqId, int _winSize, float* _params, int _exp_num_times, bool _storeStates, bool _storeER, Precision _precision){
+
+		// an unsupported precision leaves the experiment mode unchanged
+		setPrecision(_precision);
 		e_prim_id = _seqId;
 		e_window_size = _winSize;
 		e_store_gen = _storeStates;
@@ -587,8 +1084,44 @@ namespace oist {
 		}
 	}
 
+	template <class Layer>
+
+	void NetworkPvrnnOf<Layer>::setPrecision(Precision _precision){
+
+		// the layers are set first, since they may reject the precision
+		for (int l = 0 ; l < layer_num; l++){
+			layers[l]->setPrecision(_precision);
+		}
+
+		e_precision = _precision;
+		if (e_precision != PRECISION_FP32)
+			Wo_reduced.set(Wo_fused, e_precision);
+		else
+			Wo_reduced.clear();
+	}
+
+	template <class Layer>
+
+	Precision NetworkPvrnnOf<Layer>::getPrecision(){
+		return e_precision;
+	}
+
+	template <class Layer>
+
+	size_t NetworkPvrnnOf<Layer>::getGenerationBytes(){
+
+		size_t bytes = e_precision != PRECISION_FP32 ? Wo_reduced.bytes() : Wo_fused.size()*sizeof(float);
+		for (int l = 0 ; l < layer_num; l++){
+			bytes += layers[l]->getGenerationBytes();
+		}
+		return bytes;
+	}
 
-	bool NetworkPvrnn::e_initForward(){
+
+	template <class Layer>
+
+
+	bool NetworkPvrnnOf<Layer>::e_initForward(){
 
 		int erTime = e_cur_time - e_window_size;
 
@@ -601,87 +1134,94 @@ namespace oist {
 	}
 
 
-	void NetworkPvrnn::e_generate(float* _tgt_pos){
+	template <class Layer>
 
-		arrayXf1DContainer dp_prev;
 
-		for (int l = 0; l < layer_num; l++)
-		{
-			dp_prev.push_back(static_cast<ContextPvrnn*>(layers[l]->getContext())->dp_gen);
-		}
+	void NetworkPvrnnOf<Layer>::e_generate(float* _tgt_pos){
 
+		// the inputs from the bottom and top layers are their previous states, set before updating any layer
 		for (int l = 0; l < layer_num; l++){
-			ILayer* ll = layers[l];
-			ContextPvrnn* lc = static_cast<ContextPvrnn*>(ll->getContext());
+			ContextPvrnn* lc = contexts[l];
 
 			 if (l > 0 ){
-				 lc->dp_bottom_prev = dp_prev[l-1];
+				 lc->dp_bottom_prev = contexts[l-1]->dp_gen;
 			 }
 			 if (l < layer_num-1){
-				 lc->dp_top_prev = dp_prev[l+1];
+				 lc->dp_top_prev = contexts[l+1]->dp_gen;
 			 }
-
-			 ll->e_generate();
+			 lc->tick = ticks(l, e_cur_time);
 		}
-		VectorXf dp0 = l0_context->dp_gen;
-		for (int o = 0; o < o_dim; o++, _tgt_pos++){
 
-			 ArrayXf Xto = Wdo[o]*dp0 + Bo[o];
-			 ut->softmax<ArrayXf>(&Xto);
-
-			 *_tgt_pos = dataset->decodeSoftmax(Xto, o);
-		 }
+		for (int l = 0; l < layer_num; l++){
+			 layers[l]->e_generate();
+		}
+		decodeOutput(l0_context->dp_gen, _tgt_pos);
 		e_cur_time++;
 
 	}
 
-	void NetworkPvrnn::e_forward(vectorXf2DContainer& _X){
+	template <class Layer>
+
+	void NetworkPvrnnOf<Layer>::e_forward(vectorXf2DContainer& _X){
 
 		 for (int l = 0 ; l < layer_num; l++){
 			 layers[l]->e_initForward();
 		 }
+		 e_logX.clear();
+
+		 // the window holds the last steps before the current time
+		 int t_start = e_cur_time - e_window_size;
 
 		 for (int t = 0; t < e_window_size; t++){
 			 vectorXf1DContainer Xt;
-			 arrayXf1DContainer dp_prev;
-			 arrayXf1DContainer dq_prev;
-
+			 vectorXf1DContainer logXt;
+			 // the inputs from the bottom and top layers are their previous states, set before updating any layer
 			 for (int l = 0; l < layer_num; l++){
-				 ILayer* ll = layers[l];
-				 ContextPvrnn* lc = static_cast<ContextPvrnn*>(ll->getContext());
-				 dp_prev.push_back(lc->e_dp.back());
-				 dq_prev.push_back(lc->e_dq.back());
-			 }
-
-			 for (int l = 0; l < layer_num; l++){
-				 ILayer* ll = layers[l];
-				 ContextPvrnn* lc = static_cast<ContextPvrnn*>(ll->getContext());
+				 ContextPvrnn* lc = contexts[l];
 
 				 if (l > 0 ){
-					 lc->dp_bottom_prev = dp_prev[l-1];
-					 lc->dq_bottom_prev = dq_prev[l-1];;
+					 lc->dp_bottom_prev = contexts[l-1]->e_dp.back();
+					 lc->dq_bottom_prev = contexts[l-1]->e_dq.back();
 				 }
 				 if (l < layer_num-1){
-					 lc->dp_top_prev = dp_prev[l+1];
-					 lc->dq_top_prev = dq_prev[l+1];
+					 lc->dp_top_prev = contexts[l+1]->e_dp.back();
+					 lc->dq_top_prev = contexts[l+1]->e_dq.back();
 				 }
+				 lc->tick = ticks(l, t_start + t);
+			 }
 
-				 ll->e_forward();
+			 for (int l = 0; l < layer_num; l++){
+				 layers[l]->e_forward();
 			 }
 
 			 VectorXf dq0 = l0_context->e_dq.back();
+			 if (e_precision != PRECISION_FP32)
+				 reducedOutput(dq0.data());
 
 			 for (int o = 0; o < o_dim; o++){
 
-				 VectorXf Xto = Wdo[o]*dq0 + Bo[o];
-				 ut->softmax<VectorXf>(&Xto);
+				 VectorXf Xto;
+				 if (e_precision != PRECISION_FP32)
+					 Xto = o_act.segment(o_offset[o], o_num[o]);
+				 else
+					 Xto = Wdo[o]*dq0 + Bo[o];
+				 VectorXf logXto;
+				 ut->softmax<VectorXf>(&Xto, &logXto);
 				 Xt.push_back(Xto);
+				 logXt.push_back(logXto);
 			 }
 			 _X.push_back(Xt);
+			 e_logX.push_back(logXt);
 		 }
 	}
 
-	 void NetworkPvrnn::e_backward(vectorXf2DContainer& _X, vectorXf2DContainer& _Y, float& _rec, float& _reg, float& _loss){
+	 template <class Layer>
+
+	 void NetworkPvrnnOf<Layer>::e_backward(vectorXf2DContainer& _X, vectorXf2DContainer& _Y, float _ent, float& _rec, float& _reg, float& _loss){
+
+		 if (e_logX.size() != _X.size())
+			 throw Exception("The output does not match the last forward computation");
+		 _rec += _ent;
 
 		 float1DContainer kld_l;
 		 vector<float1DContainer::reverse_iterator> kld_bw_i;
@@ -691,44 +1231,51 @@ namespace oist {
 		 for (int l = 0; l < layer_num; l++){
 			 gH.push_back(VectorXf::Zero(d_num[l]));
 			 gH_next.push_back(VectorXf::Zero(d_num[l]));
-			 ILayer* ll = layers[l];
-			 ContextPvrnn* lc = static_cast<ContextPvrnn*>(ll->getContext());
+			 Layer* ll = layers[l];
+			 ContextPvrnn* lc = contexts[l];
 			 ll->e_initBackward();
 			 kld_bw_i.push_back(lc->e_kld.rbegin());
 			 kld_l.push_back(0.0);
 		 }
 
 		 int t_prev = e_window_size-1;
+		 int t_start = e_cur_time - e_window_size;
 
 		 for (int t = e_window_size; t > 0; t--, t_prev--){
 
-			 vectorXf1DContainer X_t = _X[t_prev];
-			 vectorXf1DContainer Y_t = _Y[t_prev];
+			 vectorXf1DContainer& X_t = _X[t_prev];
+			 vectorXf1DContainer& logX_t = e_logX[t_prev];
+			 vectorXf1DContainer& Y_t = _Y[t_prev];
 			 VectorXf g_dqloss =  VectorXf::Zero(l0_d_num);
 
 			 for (int o = 0; o < o_dim; o++){
 
-				 ArrayXf Xpto = X_t[o];
-				 ArrayXf Ypsto = Y_t[o];
-				 ArrayXf yx = (Ypsto/Xpto) + NON_ZERO;
-				 VectorXf rec_t = Ypsto*(yx.log());
-				 VectorXf gxloss_to = rec_coef*(Xpto-Ypsto);
+				 VectorXf gxloss_to;
+				 _rec += outputLoss(X_t[o], logX_t[o], Y_t[o], &gxloss_to);
 				 g_dqloss += Wdo_transpose[o]*gxloss_to ;
-				 _rec += rec_t.sum();
 			}
 
 			for (int l = 0; l < layer_num; l++){
-				ILayer* ll = layers[l];
-				ContextPvrnn* lc = static_cast<ContextPvrnn*>(ll->getContext());
+				Layer* ll = layers[l];
+				ContextPvrnn* lc = contexts[l];
 
+				// the states at time t+1 of the layers holding them do not depend on the neighbours
 				if (l > 0 ){
-					lc->g_hq_bottom_next = gH_next[l-1];
+					if (ticks(l-1, t_start + t))
+						lc->g_hq_bottom_next = gH_next[l-1];
+					else
+						ut->zero<VectorXf>(&lc->g_hq_bottom_next);
 				}else{
 					lc->g_dqloss = g_dqloss;
 				}
 				if (l < layer_num-1){
-					lc->g_hq_top_next = gH_next[l+1];
+					if (ticks(l+1, t_start + t))
+						lc->g_hq_top_next = gH_next[l+1];
+					else
+						ut->zero<VectorXf>(&lc->g_hq_top_next);
 				}
+				lc->tick = ticks(l, t_start + t_prev);
+				lc->tick_next = ticks(l, t_start + t);
 
 				ll->e_backward(t);
 
@@ -748,28 +1295,37 @@ namespace oist {
 	 }
 
 
-	 void NetworkPvrnn::e_copyParam(){
+	 template <class Layer>
+
+
+	 void NetworkPvrnnOf<Layer>::e_copyParam(){
 
 		 for (int l = 0 ; l < layer_num; l++)
 			 layers[l]->e_copyParam();
 	 }
 
-	void NetworkPvrnn::e_overwriteParam(){
+	template <class Layer>
+
+	void NetworkPvrnnOf<Layer>::e_overwriteParam(){
 
 		 for (int l = 0 ; l < layer_num; l++){
 			 layers[l]->e_overwriteParam();
 		 }
 	 }
 
-	void NetworkPvrnn::e_optAdam(int _epoch, float _alpha, float _beta1, float _beta2){
+	template <class Layer>
+
+	void NetworkPvrnnOf<Layer>::e_optimize(int _epoch, float _alpha, float _beta1, float _beta2){
 
 		 for (int l = 0 ; l < layer_num; l++){
-			layers[l]->e_optAdam(_epoch, _alpha, _beta1, _beta2);
+			layers[l]->e_optimize(_epoch, _alpha, _beta1, _beta2);
 		 }
 
 	}
 
-	void NetworkPvrnn::e_getState(float* _f){
+	template <class Layer>
+
+	void NetworkPvrnnOf<Layer>::e_getState(float* _f){
 
 		for (int l = 0; l < layer_num ; l++){
 			_f = layers[l]->e_getState(_f);
@@ -778,30 +1334,21 @@ namespace oist {
 
 	// ------------------------- Analysis mode methods -------------------------
 
-	void NetworkPvrnn::a_feedForwardOutputFromContext(float* _d0, float* _X){
+	template <class Layer>
+
+	void NetworkPvrnnOf<Layer>::a_feedForwardOutputFromContext(float* _d0, float* _X){
 
-			VectorXf d0 = ArrayXf::Zero(l0_d_num);
+			ArrayXf d0 = ArrayXf::Zero(l0_d_num);
 			auto d0_p = d0.data();
 			_d0 += l0_d_num;
 			for (int i = 0 ; i < l0_d_num; i++, d0_p++, _d0++)
 				*d0_p = *_d0;
-			for (int o = 0; o < o_dim; o++, _X++){
-
-				 ArrayXf Xto = Wdo[o]*d0 + Bo[o];
-				 ut->softmax<ArrayXf>(&Xto);
-
-				 *_X = dataset->decodeSoftmax(Xto, o);
-			 }
+			decodeOutput(d0, _X);
 		}
 
-	void NetworkPvrnn::a_predict(int _n, float* _initial_state, string _path){
+	template <class Layer>
 
-		stringstream strm; strm << _path << "/off_X.d";
-		ofstream offL_X_File(strm.str(),std::ofstream::out);
-
-		if (!offL_X_File.is_open()){
-			throw oist::Exception("The output file could not be opened for the Network off-line generation");
-		}
+	void NetworkPvrnnOf<Layer>::a_rollout(int _n, float* _initial_state, float* _X){
 
 		float* p_is = _initial_state;
 
@@ -810,43 +1357,44 @@ namespace oist {
 			p_is+= layers[l]->getStateDim();
 		}
 
-		float2DContainer X;
-
-		for (int t = 0; t < _n; t++){
-			arrayXf1DContainer dp_prev;
-			for (int l = 0; l < layer_num; l++){
-				ContextPvrnn* lc = static_cast<ContextPvrnn*>(layers[l]->getContext());
-				dp_prev.push_back(lc->dp_gen);
-			}
+		for (int t = 0; t < _n; t++, _X += o_dim){
+			// the inputs from the bottom and top layers are their previous states, set before updating any layer
 			for (int l = 0; l < layer_num; l++){
-				ILayer* ll = layers[l];
-				ContextPvrnn* lc = static_cast<ContextPvrnn*>(ll->getContext());
+				ContextPvrnn* lc = contexts[l];
 
 				 if (l > 0 ){
-					 lc->dp_bottom_prev = dp_prev[l-1];
+					 lc->dp_bottom_prev = contexts[l-1]->dp_gen;
 				 }
 				 if (l < layer_num-1){
-					 lc->dp_top_prev = dp_prev[l+1];
+					 lc->dp_top_prev = contexts[l+1]->dp_gen;
 				 }
+				 lc->tick = ticks(l, t);
+			}
+			for (int l = 0; l < layer_num; l++){
 				 layers[l]->a_predict();
 			}
 
-			VectorXf dp0 = l0_context->dp_gen;
+			decodeOutput(l0_context->dp_gen, _X);
+		}
+	}
+
+	template <class Layer>
 
-			float1DContainer X_t;
-			for (int o = 0; o < o_dim; o++){
+	void NetworkPvrnnOf<Layer>::a_predict(int _n, float* _initial_state, string _path){
 
-				 ArrayXf Xto = Wdo[o]*dp0 + Bo[o];
-				 ut->softmax<ArrayXf>(&Xto);
+		stringstream strm; strm << _path << "/off_X.d";
+		ofstream offL_X_File(strm.str(),std::ofstream::out);
 
-				 X_t.push_back(dataset->decodeSoftmax(Xto, o));
-			 }
-			X.push_back(X_t);
+		if (!offL_X_File.is_open()){
+			throw oist::Exception("The output file could not be opened for the Network off-line generation");
 		}
 
+		float1DContainer X(_n*o_dim);
+		a_rollout(_n, _initial_state, X.data());
 
-		for (unsigned int i = 0 ; i < X.size(); i++){
-			ut->saveContainer<float1DContainer>(&offL_X_File, &X[i], string(" "));
+		for (int t = 0 ; t < _n; t++){
+			float1DContainer X_t(X.begin() + t*o_dim, X.begin() + (t+1)*o_dim);
+			ut->saveContainer<float1DContainer>(&offL_X_File, &X_t, string(" "));
 		}
 
 		try{
@@ -861,7 +1409,8 @@ namespace oist {
 		}
 
 	}
-	void NetworkPvrnn::e_save(string _path){
+	template <class Layer>
+	void NetworkPvrnnOf<Layer>::e_save(string _path){
 
 		if (e_store_gen == true){
 
@@ -881,11 +1430,19 @@ namespace oist {
 
 
 
-	NetworkPvrnn::~NetworkPvrnn() {
+	template <class Layer>
+	NetworkPvrnnOf<Layer>::~NetworkPvrnnOf() {
 		 for (int l = 0 ; l < layers.size(); l++){
 			 delete layers[l]; 
 		 }
 		 cout << "Network deallocated" << endl;
 	}
 
+	// the time loops bind the layer calls statically only if the layers are final (__is_final, since std::is_final needs C++14)
+	static_assert(__is_final(LayerPvrnn), "LayerPvrnn should be final, the time loops call it without virtual dispatch");
+	static_assert(__is_final(LayerPvrnnLowRank), "LayerPvrnnLowRank should be final, the time loops call it without virtual dispatch");
+
+	template class NetworkPvrnnOf<LayerPvrnn>;
+	template class NetworkPvrnnOf<LayerPvrnnLowRank>;
+
 } /* namespace oist */
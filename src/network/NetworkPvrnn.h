@@ -54,16 +54,20 @@
 #include "INetwork.h"
 
 #include "../dataset/Dataset.h"
+#include "../optimizer/IOptimizer.h"
 #include "../layer/ILayer.h"
 #include "../layer/LayerPvrnn.h"
+#include "../layer/LayerPvrnnLowRank.h"
 #include "../context/ContextPvrnn.h"
 
 namespace oist {
 
 /**
- * This class implements a network type PV-RNN
+ * This class implements a network type PV-RNN, whose layers are of the given type
+ * (LayerPvrnn, or LayerPvrnnLowRank for the factorized recurrent weights)
  * */
-class NetworkPvrnn : public INetwork {
+template <class Layer>
+class NetworkPvrnnOf : public INetwork {
 
 	Dataset* dataset;
 
@@ -71,12 +75,17 @@ class NetworkPvrnn : public INetwork {
 	int1DContainer z_num;
 	int1DContainer o_num;
 	int1DContainer tau;
+	int1DContainer rank; // rank of the factorized weights of each layer (low-rank layers only)
+	int1DContainer clock; // update period of each layer in time steps, the states are held in between (1 updates at every step)
 	float1DContainer w;
 
-	vector<ILayer*> layers;
-	ILayer* l0;
+	// the layers are kept with their concrete (final) type, hence the calls of the time loops are not virtual
+	vector<Layer*> layers;
+	vector<ContextPvrnn*> contexts;
+	Layer* l0;
 	ContextPvrnn* l0_context;
 	Utils* ut;
+	IOptimizer* optimizer;		// weights and bias
 
 	vector<MatrixXf> Wdo;
 	vector<MatrixXf> g_Wdo;
@@ -89,7 +98,19 @@ class NetworkPvrnn : public INetwork {
 	vector<VectorXf> m_Bo;
 	vector<VectorXf> v_Bo;
 
+	// fused output head, a copy of the heads above stacked in single block used for decoding
+	MatrixXf Wo_fused;
+	VectorXf Bo_fused;
+	VectorXf o_grid;			// stacked decoding grid in the joint space
+	int1DContainer o_offset;	// first row of each head in the block
+	VectorXf o_act;				// pre-allocated output activations
+	ReducedMatrix Wo_reduced;	// fused output head in reduced precision, set by setPrecision
+	Precision e_precision;		// storage precision of the weights in experiment mode
+
 	int prim_num;
+	int enroll_id; // primitive being enrolled, the weights are frozen (-1 if disabled)
+	bool o_frozen; // flag indicating that the output layer is frozen
+	string o_synced; // path of the text files holding the current output layer (empty if outdated)
 	int prim_len;
 	int layer_num;
 	int state_dim;
@@ -98,6 +119,9 @@ class NetworkPvrnn : public INetwork {
 	float rec_coef;
 	float reg_coef;
 
+	// logarithm of the outputs of the last forward computation of each primitive (units x time steps)
+	vector<MatrixXf> t_logX;
+
 	// Experiment mode
 
 	int e_window_size;
@@ -107,52 +131,143 @@ class NetworkPvrnn : public INetwork {
 	bool e_store_gen;
 	bool e_store_inference;
 
+	// logarithm of the outputs of the last forward computation
+	vectorXf2DContainer e_logX;
+
+	/**
+	 * Creates a layer of the network
+	 * @param l Layer index
+	 * @param d_num_bottom Number of d units of the bottom layer (0 if none)
+	 * @param d_num_top Number of d units of the top layer (0 if none)
+	 * @param z_sum Sum of z units for all layers in the network
+	 * @param optimizer Optimizer of the weights and bias
+	 * @param aOptimizer Optimizer of the A variables
+	 * */
+	Layer* newLayer(int l, int d_num_bottom, int d_num_top, int z_sum, IOptimizer* optimizer, IOptimizer* aOptimizer);
+
+	/**
+	 * Checks whether a layer updates its states at a time step, see the 'clock' property
+	 * @param l Layer index
+	 * @param t Time step, counted from the first step of the sequence
+	 * @return True if the layer updates, false if it holds its states of the previous step
+	 * */
+	bool ticks(int l, int t);
+
+	/**
+	 * Stores the network configuration in the checkpoint meta entries
+	 * @param ckpt Destination checkpoint
+	 * */
+	void setConfig(Checkpoint* ckpt);
+
+	/**
+	 * Verifies that the checkpoint configuration matches the network
+	 * @param ckpt Source checkpoint
+	 * */
+	void checkConfig(Checkpoint* ckpt);
+
+	/**
+	 * Copies an output head into the fused output block, called whenever the head is modified
+	 * @param o Output head index
+	 * */
+	void fuseOutput(int o);
+
+	/**
+	 * Computes the output of all the heads with a single matrix product and decodes it to the joint space
+	 * @param d0 Latent state of the lowest layer
+	 * @param out Output array with the decoded value of each joint
+	 * */
+	void decodeOutput(const ArrayXf& d0, float* out);
+
+	/**
+	 * Computes the activations of all the heads (before the softmax) in o_act, with the weights in reduced precision
+	 * @param d0 Latent state of the lowest layer
+	 * */
+	void reducedOutput(const float* d0);
+
+	/**
+	 * Computes the cross-entropy part of the reconstruction error of an output and its gradient
+	 * @param X Network output
+	 * @param logX Logarithm of the network output
+	 * @param Y Reference data (dense or truncated)
+	 * @param g Output gradient with respect to the network output, ignored if null
+	 * @return Reconstruction error without the Y*log(Y) terms
+	 * */
+	float outputLoss(const Ref<const VectorXf>& X, const Ref<const VectorXf>& logX, const Ref<const VectorXf>& Y, VectorXf* g);
+	float outputLoss(const Ref<const VectorXf>& X, const Ref<const VectorXf>& logX, const SparseVectorXf& Y, VectorXf* g);
+
+	template <typename T> void backward(int pID, const SequenceViewXf& X, T& Y, float ent, float& rec, float& reg, float& loss);
+	template <typename T> float recError(const SequenceViewXf& X, T& Y, float ent);
+
 public:
 
 
 	/**
 	 * Constructor
-	 * @param paramMap Input map with layer information containers (number of d and z units, time constants, and the meta-parameters W)
+	 * @param paramMap Input map with layer information containers (number of d and z units, time constants, the meta-parameters W, the rank of the low-rank layers, and the update periods)
 	 * @param dataset Pointer to a data-set object
+	 * @param optimizer Optimizer of the weights and bias, shared by the network and its layers
+	 * @param aOptimizer Optimizer of the A variables
 	 * */
-	NetworkPvrnn(map<string,float1DContainer>& paramMap, Dataset* dataset);
-	~NetworkPvrnn();
+	NetworkPvrnnOf(map<string,float1DContainer>& paramMap, Dataset* dataset, IOptimizer* optimizer, IOptimizer* aOptimizer);
+	~NetworkPvrnnOf();
 
 	int getNLayers();
 	int getStateDim();
+	int getOutputDim();
+	const int1DContainer& getOutputUnits();
 
 	void load(string);
 	void save(string);
+	void load(Checkpoint*);
+	void save(Checkpoint*);
+	void exportInference(Checkpoint*, const int1DContainer&);
+	void loadInference(Checkpoint*, const int1DContainer&);
+	void addPrimitives(int);
 	void print();
 
 	// ------------------------- training mode methods -------------------------
 
-	void t_generate(int, int, vectorXf2DContainer&);
-	void t_forward(int, int, vectorXf2DContainer&);
-	void t_backward(int, vectorXf2DContainer&, vectorXf3DContainer&, float&, float&, float&);
-	void t_optAdam(int, float, float, float);
-	float getRecError(vectorXf2DContainer&, vectorXf3DContainer&);
+	void t_generate(int, int, TensorXf&);
+	void t_forward(int, int, TensorXf&);
+	void t_backward(int, const SequenceViewXf&, TensorXf&, float, float&, float&, float&);
+	void t_backward(int, const SequenceViewXf&, sparseXf3DContainer&, float, float&, float&, float&);
+	void t_optimize(int, float, float, float);
+	void t_enroll(int);
+	void t_freeze(const int1DContainer&, bool);
+	void t_prune(float, bool);
+	void t_gradients(vector<Map<VectorXf> >&);
+	void t_variables(int, vector<Map<VectorXf> >&);
+	void t_own(const bool1DContainer&);
+	float getRecError(const SequenceViewXf&, TensorXf&, float);
+	float getRecError(const SequenceViewXf&, sparseXf3DContainer&, float);
 
 	// ------------------------- Analysis mode methods -------------------------
 
 	//void a_predict(int, float*, float*, string);
 	void a_predict(int, float*, string);
 	void a_feedForwardOutputFromContext(float*, float*);
+	void a_rollout(int, float*, float*);
 
 	// ------------------------- Experiment mode methods -------------------------
 
-	void e_enable(int, int, float*, int, bool, bool);
+	void e_enable(int, int, float*, int, bool, bool, Precision);
+	void setPrecision(Precision);
+	Precision getPrecision();
+	size_t getGenerationBytes();
 	void e_generate(float*);
 	bool e_initForward();
 	void e_forward(vectorXf2DContainer&);
-	void e_backward(vectorXf2DContainer&, vectorXf2DContainer&, float&, float&, float&);
+	void e_backward(vectorXf2DContainer&, vectorXf2DContainer&, float, float&, float&, float&);
 	void e_copyParam();
 	void e_overwriteParam();
-	void e_optAdam(int, float, float, float);
+	void e_optimize(int, float, float, float);
 	void e_getState(float*);
 	void e_save(string);
 
 };
 
+typedef NetworkPvrnnOf<LayerPvrnn> NetworkPvrnn;
+typedef NetworkPvrnnOf<LayerPvrnnLowRank> NetworkPvrnnLowRank;
+
 } /* namespace oist */
 #endif /* SRC_PVRNN_NETWORK_H_ */
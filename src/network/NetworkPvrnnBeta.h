@@ -54,6 +54,7 @@
 #include "INetwork.h"
 
 #include "../dataset/Dataset.h"
+#include "../optimizer/IOptimizer.h"
 #include "../layer/ILayer.h"
 #include "../layer/LayerPvrnnBeta.h"
 #include "../context/ContextPvrnnBeta.h"
@@ -74,10 +75,13 @@ class NetworkPvrnnBeta : public INetwork {
 	float1DContainer w1;
 	float1DContainer w;
 
-	vector<ILayer*> layers;
-	ILayer* l0;
+	// the layers are kept with their concrete (final) type, hence the calls of the time loops are not virtual
+	vector<LayerPvrnnBeta*> layers;
+	vector<ContextPvrnnBeta*> contexts;
+	LayerPvrnnBeta* l0;
 	ContextPvrnnBeta* l0_context;
 	Utils* ut;
+	IOptimizer* optimizer;		// weights and bias
 
 	vector<MatrixXf> Wdo;
 	vector<MatrixXf> g_Wdo;
@@ -90,7 +94,20 @@ class NetworkPvrnnBeta : public INetwork {
 	vector<VectorXf> m_Bo;
 	vector<VectorXf> v_Bo;
 
+	// fused output head, a copy of the heads above stacked in single block used for decoding
+	MatrixXf Wo_fused;
+	VectorXf Bo_fused;
+	VectorXf o_grid;			// stacked decoding grid in the joint space
+	int1DContainer o_offset;	// first row of each head in the block
+	VectorXf o_act;				// pre-allocated output activations
+	ReducedMatrix Wo_reduced;	// fused output head in reduced precision, set by setPrecision
+	Precision e_precision;		// storage precision of the weights in experiment mode
+	float sparse_density;		// maximum density of the sparse inference copies of the pruned weights
+
 	int prim_num;
+	int enroll_id; // primitive being enrolled, the weights are frozen (-1 if disabled)
+	bool o_frozen; // flag indicating that the output layer is frozen
+	string o_synced; // path of the text files holding the current output layer (empty if outdated)
 	int prim_len;
 	int layer_num;
 	int state_dim;
@@ -99,6 +116,9 @@ class NetworkPvrnnBeta : public INetwork {
 	float rec_coef;
 	float reg_coef;
 
+	// logarithm of the outputs of the last forward computation of each primitive (units x time steps)
+	vector<MatrixXf> t_logX;
+
 	// Experiment mode
 
 	int e_window_size;
@@ -108,6 +128,54 @@ class NetworkPvrnnBeta : public INetwork {
 	bool e_store_gen;
 	bool e_store_inference;
 
+	// logarithm of the outputs of the last forward computation
+	vectorXf2DContainer e_logX;
+
+	/**
+	 * Stores the network configuration in the checkpoint meta entries
+	 * @param ckpt Destination checkpoint
+	 * */
+	void setConfig(Checkpoint* ckpt);
+
+	/**
+	 * Verifies that the checkpoint configuration matches the network
+	 * @param ckpt Source checkpoint
+	 * */
+	void checkConfig(Checkpoint* ckpt);
+
+	/**
+	 * Copies an output head into the fused output block, called whenever the head is modified
+	 * @param o Output head index
+	 * */
+	void fuseOutput(int o);
+
+	/**
+	 * Computes the output of all the heads with a single matrix product and decodes it to the joint space
+	 * @param d0 Latent state of the lowest layer
+	 * @param out Output array with the decoded value of each joint
+	 * */
+	void decodeOutput(const ArrayXf& d0, float* out);
+
+	/**
+	 * Computes the activations of all the heads (before the softmax) in o_act, with the weights in reduced precision
+	 * @param d0 Latent state of the lowest layer
+	 * */
+	void reducedOutput(const float* d0);
+
+	/**
+	 * Computes the cross-entropy part of the reconstruction error of an output and its gradient
+	 * @param X Network output
+	 * @param logX Logarithm of the network output
+	 * @param Y Reference data (dense or truncated)
+	 * @param g Output gradient with respect to the network output, ignored if null
+	 * @return Reconstruction error without the Y*log(Y) terms
+	 * */
+	float outputLoss(const Ref<const VectorXf>& X, const Ref<const VectorXf>& logX, const Ref<const VectorXf>& Y, VectorXf* g);
+	float outputLoss(const Ref<const VectorXf>& X, const Ref<const VectorXf>& logX, const SparseVectorXf& Y, VectorXf* g);
+
+	template <typename T> void backward(int pID, const SequenceViewXf& X, T& Y, float ent, float& rec, float& reg, float& loss);
+	template <typename T> float recError(const SequenceViewXf& X, T& Y, float ent);
+
 public:
 
 
@@ -115,41 +183,62 @@ public:
 	 * Constructor
 	 * @param paramMap Input map with layer information containers (number of d and z units, time constants, and the meta-parameters W)
 	 * @param dataset Pointer to a data-set object
+	 * @param optimizer Optimizer of the weights and bias, shared by the network and its layers
+	 * @param aOptimizer Optimizer of the A variables
 	 * */
-	NetworkPvrnnBeta(map<string,float1DContainer>& paramMap, Dataset* dataset);
+	NetworkPvrnnBeta(map<string,float1DContainer>& paramMap, Dataset* dataset, IOptimizer* optimizer, IOptimizer* aOptimizer);
 	~NetworkPvrnnBeta();
 
 	int getNLayers();
 	int getStateDim();
+	int getOutputDim();
+	const int1DContainer& getOutputUnits();
 
 	void load(string);
 	void save(string);
+	void load(Checkpoint*);
+	void save(Checkpoint*);
+	void exportInference(Checkpoint*, const int1DContainer&);
+	void loadInference(Checkpoint*, const int1DContainer&);
+	void addPrimitives(int);
 	void print();
 
 	// ------------------------- training mode methods -------------------------
 
-	void t_generate(int, int, vectorXf2DContainer&);
-	void t_forward(int, int, vectorXf2DContainer&);
-	void t_backward(int, vectorXf2DContainer&, vectorXf3DContainer&, float&, float&, float&);
-	void t_optAdam(int, float, float, float);
-	float getRecError(vectorXf2DContainer&, vectorXf3DContainer&);
+	void t_generate(int, int, TensorXf&);
+	void t_forward(int, int, TensorXf&);
+	void t_backward(int, const SequenceViewXf&, TensorXf&, float, float&, float&, float&);
+	void t_backward(int, const SequenceViewXf&, sparseXf3DContainer&, float, float&, float&, float&);
+	void t_optimize(int, float, float, float);
+	void t_enroll(int);
+	void t_freeze(const int1DContainer&, bool);
+	void t_prune(float, bool);
+	void t_gradients(vector<Map<VectorXf> >&);
+	void t_variables(int, vector<Map<VectorXf> >&);
+	void t_own(const bool1DContainer&);
+	float getRecError(const SequenceViewXf&, TensorXf&, float);
+	float getRecError(const SequenceViewXf&, sparseXf3DContainer&, float);
 
 	// ------------------------- Analysis mode methods -------------------------
 
 	//void a_predict(int, float*, float*, string);
 	void a_predict(int, float*, string);
 	void a_feedForwardOutputFromContext(float*, float*);
+	void a_rollout(int, float*, float*);
 
 	// ------------------------- Experiment mode methods -------------------------
 
-	void e_enable(int, int, float*, int, bool, bool);
+	void e_enable(int, int, float*, int, bool, bool, Precision);
+	void setPrecision(Precision);
+	Precision getPrecision();
+	size_t getGenerationBytes();
 	void e_generate(float*);
 	bool e_initForward();
 	void e_forward(vectorXf2DContainer&);
-	void e_backward(vectorXf2DContainer&, vectorXf2DContainer&, float&, float&, float&);
+	void e_backward(vectorXf2DContainer&, vectorXf2DContainer&, float, float&, float&, float&);
 	void e_copyParam();
 	void e_overwriteParam();
-	void e_optAdam(int, float, float, float);
+	void e_optimize(int, float, float, float);
 	void e_getState(float*);
 	void e_save(string);
 
@@ -0,0 +1,163 @@
+/*<!--
+
+ BSD 3-Clause License
+
+  Copyright (c) 2020 Okinawa Institute of Science and Technology (OIST).
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above
+     copyright notice, this list of conditions and the following
+     disclaimer in the documentation and/or other materials provided
+     with the distribution.
+   * Neither the name of Willow Garage, Inc. nor the names of its
+     contributors may be used to endorse or promote products derived
+     from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+ Author: Hendry F. Chame <hendryfchame@gmail.com>
+
+ Publication:
+
+   Chame, H. F., Ahmadi, A., & Tani, J. (2020).
+   A hybrid human-neurorobotics approach to primary intersubjectivity via
+   active inference. Frontiers in psychology, 11.
+
+   Okinawa Institute of Science and Technology Graduate University (OIST)
+   Cognitive Neurorobotics Research Unit (CNRU)
+   1919-1, Tancha, Onna, Kunigami District, Okinawa 904-0495, Japan
+
+-->*/
+
+#ifndef SRC_OPTIMIZER_IOPTIMIZER_H_
+#define SRC_OPTIMIZER_IOPTIMIZER_H_
+
+#include "../includes.h"
+
+namespace oist {
+
+/**
+ * Abstract class (Interface) for optimizer implementations.
+ * An optimizer is stateless: the state of each parameter (e.g. the moments of Adam) is owned by the layer,
+ * which sizes it with @ref allocate, so the same optimizer can be shared by several networks.
+ * A parameter of size rows x cols is stored in column-major order (vectors have a single column)
+ * */
+class IOptimizer {
+
+	/**
+	 * Resizes and clears a state buffer
+	 * @param s State buffer
+	 * @param size Number of values
+	 * @param rows Number of rows of the parameter
+	 * @param cols Number of columns of the parameter
+	 * */
+	template <typename T> static void reshape(T* s, int size, int rows, int cols){
+		if (size == rows*cols)
+			s->setZero(rows, cols);
+		else
+			s->setZero(size, 1);
+	}
+
+public:
+
+	virtual ~IOptimizer(){}
+
+	/**
+	 * Gets the name of the optimizer, as given in the properties file
+	 * */
+	virtual string getName() = 0;
+
+	/**
+	 * Gets the number of first moment values kept for a parameter
+	 * @param rows Number of rows of the parameter
+	 * @param cols Number of columns of the parameter
+	 * */
+	virtual int getFirstSize(int rows, int cols) = 0;
+
+	/**
+	 * Gets the number of second moment values kept for a parameter
+	 * @param rows Number of rows of the parameter
+	 * @param cols Number of columns of the parameter
+	 * */
+	virtual int getSecondSize(int rows, int cols) = 0;
+
+	/**
+	 * Updates a parameter from its gradient
+	 * @param p Parameter values
+	 * @param g Gradient values
+	 * @param m First moment state
+	 * @param v Second moment state
+	 * @param rows Number of rows of the parameter
+	 * @param cols Number of columns of the parameter
+	 * @param epoch Optimization step from 1
+	 * @param alpha Learning rate \f$\alpha\f$
+	 * @param beta1 Decay rate of the first moment \f$\beta_1\f$
+	 * @param beta2 Decay rate of the second moment \f$\beta_2\f$
+	 * */
+	virtual void update(float* p, const float* g, float* m, float* v, int rows, int cols, int epoch, float alpha, float beta1, float beta2) = 0;
+
+	/**
+	 * Sizes and clears the state of a parameter
+	 * @param p Parameter
+	 * @param m First moment state
+	 * @param v Second moment state
+	 * */
+	template <typename T> void allocate(T* p, T* m, T* v){
+		int rows = int(p->rows());
+		int cols = int(p->cols());
+		reshape(m, getFirstSize(rows, cols), rows, cols);
+		reshape(v, getSecondSize(rows, cols), rows, cols);
+	}
+
+	/**
+	 * Sizes the gradient and the optimizer state of a parameter. The models loaded for inference only
+	 * have no optimizer, and their gradients and states are kept empty
+	 * @param optimizer Optimizer, or null
+	 * @param p Parameter
+	 * @param g Gradient
+	 * @param m First moment state
+	 * @param v Second moment state
+	 * */
+	template <typename T> static void allocate(IOptimizer* optimizer, T* p, T* g, T* m, T* v){
+		if (optimizer == nullptr)
+			return;
+		*g = T::Zero(p->rows(), p->cols());
+		optimizer->allocate<T>(p, m, v);
+	}
+
+	/**
+	 * Updates a parameter from its gradient
+	 * @param p Parameter
+	 * @param g Gradient
+	 * @param m First moment state
+	 * @param v Second moment state
+	 * @param epoch Optimization step from 1
+	 * @param alpha Learning rate \f$\alpha\f$
+	 * @param beta1 Decay rate of the first moment \f$\beta_1\f$
+	 * @param beta2 Decay rate of the second moment \f$\beta_2\f$
+	 * */
+	template <typename T> void step(T* p, T* g, T* m, T* v, int epoch, float alpha, float beta1, float beta2){
+		update(p->data(), g->data(), m->data(), v->data(), int(p->rows()), int(p->cols()), epoch, alpha, beta1, beta2);
+	}
+};
+
+} /* namespace oist */
+
+#endif /* SRC_OPTIMIZER_IOPTIMIZER_H_ */
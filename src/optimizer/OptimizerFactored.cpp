@@ -0,0 +1,110 @@
+/*<!--
+
+ BSD 3-Clause License
+
+  Copyright (c) 2020 Okinawa Institute of Science and Technology (OIST).
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above
+     copyright notice, this list of conditions and the following
+     disclaimer in the documentation and/or other materials provided
+     with the distribution.
+   * Neither the name of Willow Garage, Inc. nor the names of its
+     contributors may be used to endorse or promote products derived
+     from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+ Author: Hendry F. Chame <hendryfchame@gmail.com>
+
+ Publication:
+
+   Chame, H. F., Ahmadi, A., & Tani, J. (2020).
+   A hybrid human-neurorobotics approach to primary intersubjectivity via
+   active inference. Frontiers in psychology, 11.
+
+   Okinawa Institute of Science and Technology Graduate University (OIST)
+   Cognitive Neurorobotics Research Unit (CNRU)
+   1919-1, Tancha, Onna, Kunigami District, Okinawa 904-0495, Japan
+
+-->*/
+
+#include "OptimizerFactored.h"
+
+namespace oist {
+
+	string OptimizerFactored::getName(){
+		return "factored";
+	}
+
+	int OptimizerFactored::getFirstSize(int _rows, int _cols){
+		return _rows*_cols;
+	}
+
+	int OptimizerFactored::getSecondSize(int _rows, int _cols){
+		// the row averages followed by the column averages, or a single value for a vector
+		return (_rows > 1 && _cols > 1) ? _rows + _cols : 1;
+	}
+
+	void OptimizerFactored::update(float* _p, const float* _g, float* _m, float* _v, int _rows, int _cols, int _epoch, float _alpha, float _beta1, float _beta2){
+
+		float mCorrection = 1.0 - pow(_beta1, _epoch);
+		float vCorrection = 1.0 - pow(_beta2, _epoch);
+		int size = _rows*_cols;
+
+		if (_rows > 1 && _cols > 1){
+
+			float* r = _v;
+			float* c = _v + _rows;
+			Map<const MatrixXf> g(_g, _rows, _cols);
+
+			// averages of the squared gradients over the columns (r) and the rows (c)
+			Map<VectorXf> rowMeans(r, _rows);
+			Map<VectorXf> colMeans(c, _cols);
+			rowMeans = _beta2*rowMeans + (1.0f-_beta2)*g.array().square().rowwise().mean().matrix();
+			colMeans = _beta2*colMeans + (1.0f-_beta2)*g.array().square().colwise().mean().matrix().transpose();
+			float rMean = rowMeans.mean() + NON_ZERO;
+
+			for (int j = 0; j < _cols; j++){
+				float cj = c[j]/(rMean*vCorrection);
+				for (int i = 0; i < _rows; i++, _p++, _g++, _m++){
+					*_m = _beta1*(*_m) + (1.0-_beta1)*(*_g);
+					float mHat = *_m / mCorrection;
+					float vHat = r[i]*cj;
+					*_p -= _alpha *mHat/(sqrt(vHat)+NON_ZERO);
+				}
+			}
+		}
+		else{
+
+			Map<const VectorXf> g(_g, size);
+			*_v = _beta2*(*_v) + (1.0f-_beta2)*g.squaredNorm()/size;
+			float vHat = *_v / vCorrection;
+			float denominator = sqrt(vHat)+NON_ZERO;
+
+			for (int i = 0 ; i < size; i++, _p++, _g++, _m++){
+				*_m = _beta1*(*_m) + (1.0-_beta1)*(*_g);
+				float mHat = *_m / mCorrection;
+				*_p -= _alpha *mHat/denominator;
+			}
+		}
+	}
+
+} /* namespace oist */
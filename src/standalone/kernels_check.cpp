@@ -0,0 +1,236 @@
+/*<!--
+
+ BSD 3-Clause License
+
+  Copyright (c) 2020 Okinawa Institute of Science and Technology (OIST).
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above
+     copyright notice, this list of conditions and the following
+     disclaimer in the documentation and/or other materials provided
+     with the distribution.
+   * Neither the name of Willow Garage, Inc. nor the names of its
+     contributors may be used to endorse or promote products derived
+     from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+ Author: Hendry F. Chame <hendryfchame@gmail.com>
+
+ Publication:
+
+   Chame, H. F., Ahmadi, A., & Tani, J. (2020).
+   A hybrid human-neurorobotics approach to primary intersubjectivity via
+   active inference. Frontiers in psychology, 11.
+
+   Okinawa Institute of Science and Technology Graduate University (OIST)
+   Cognitive Neurorobotics Research Unit (CNRU)
+   1919-1, Tancha, Onna, Kunigami District, Okinawa 904-0495, Japan
+
+-->*/
+
+
+#include "../utils/Kernels.h"
+#include <iostream>
+#include <vector>
+#include <cmath>
+
+using namespace std;
+using namespace oist;
+
+// checks each kernel of the selected instruction set against a scalar reference in double precision,
+// e.g. with NRL_ISA=generic for the kernels used on the CPUs without AVX2
+
+static int failures = 0;
+static unsigned int state = 12345;
+
+/**
+ * Pseudo-random value in [-1, 1), the same on every platform
+ * */
+static float uniform(){
+	state = state*1664525u + 1013904223u;
+	return float(state >> 8)/float(1 << 23) - 1.0f;
+}
+
+/**
+ * Compares a kernel output with its reference
+ * @param scale Magnitude of the reference terms, for the tolerance of the summations
+ * */
+static void check(const char* _kernel, const vector<float>& _out, const vector<double>& _ref, const vector<double>& _scale){
+	for (unsigned int i = 0; i < _out.size(); i++){
+		if (!(fabs(_out[i] - _ref[i]) <= 1.0e-5*(_scale[i] + 1.0))){
+			cout << "Error: the kernel [" << _kernel << "] computes " << _out[i] << " instead of " << _ref[i] << " at " << i << endl;
+			failures++;
+			return;
+		}
+	}
+}
+
+static float bf16(uint16_t _h){
+	int e = (_h >> 7) & 255, m = _h & 127;
+	float v = (e == 0) ? ldexp(float(m), -133) : ldexp(float(128 + m), e - 134);
+	return (_h & 0x8000) ? -v : v;
+}
+
+static float fp16(uint16_t _h){
+	int e = (_h >> 10) & 31, m = _h & 1023;
+	float v = (e == 0) ? ldexp(float(m), -24) : ldexp(float(1024 + m), e - 25);
+	return (_h & 0x8000) ? -v : v;
+}
+
+int main(int argc, char* argv[]) {
+
+	string isa = selectKernels();
+	if (argc > 1 && isa != argv[1]){
+		cout << "Error: the kernels [" << isa << "] are selected instead of [" << argv[1] << "]" << endl;
+		return 1;
+	}
+
+	// sizes which are not multiples of the vector widths, and over the row blocks of the int8 products
+	const int rows = 301, cols = 7, n = rows*cols;
+	vector<float> W(n), x(cols), y0(rows), out;
+	vector<double> ref, scale;
+	for (int i = 0; i < n; i++)
+		W[i] = uniform();
+	for (int j = 0; j < cols; j++)
+		x[j] = uniform();
+	for (int i = 0; i < rows; i++)
+		y0[i] = uniform();
+
+	// element-wise kernels
+	out.assign(W.begin(), W.end());
+	kernels->tanh(out.data(), n);
+	ref.assign(n, 0.0); scale.assign(n, 0.0);
+	for (int i = 0; i < n; i++)
+		ref[i] = tanh(double(W[i]));
+	check("tanh", out, ref, scale);
+
+	out.assign(W.begin(), W.begin() + rows);
+	float sum = kernels->softmax(out.data(), rows);
+	double refSum = 0.0;
+	for (int i = 0; i < rows; i++)
+		refSum += exp(double(W[i]));
+	ref.assign(rows, 0.0); scale.assign(rows, 0.0);
+	for (int i = 0; i < rows; i++)
+		ref[i] = exp(double(W[i]))/refSum;
+	check("softmax", out, ref, scale);
+	check("softmax", vector<float>(1, sum), vector<double>(1, refSum), vector<double>(1, refSum));
+
+	// matrix-vector products, with the reference of the decoded weights
+	vector<uint16_t> Wbf(n), Wfp(n);
+	vector<int8_t> Wi8(n);
+	vector<float> rowScale(rows);
+	for (int i = 0; i < n; i++){
+		Wbf[i] = uint16_t(state >> 16) & 0xbfff;		// normal and subnormal values below 2
+		uniform();
+		Wfp[i] = uint16_t(state >> 16) & 0xbfff;		// normal and subnormal values below 2
+		uniform();
+		Wi8[i] = int8_t(state >> 24);
+		uniform();
+	}
+	for (int i = 0; i < rows; i++)
+		rowScale[i] = uniform();
+
+	for (int k = 0; k < 4; k++){
+		const char* name[] = {"gemv", "gemvBf16", "gemvFp16", "gemvInt8"};
+		out = y0;
+		if (k == 0)
+			kernels->gemv(W.data(), x.data(), out.data(), rows, cols);
+		else if (k == 1)
+			kernels->gemvBf16(Wbf.data(), x.data(), out.data(), rows, cols);
+		else if (k == 2)
+			kernels->gemvFp16(Wfp.data(), x.data(), out.data(), rows, cols);
+		else
+			kernels->gemvInt8(Wi8.data(), rowScale.data(), x.data(), out.data(), rows, cols);
+		ref.assign(y0.begin(), y0.end());
+		scale.assign(rows, 0.0);
+		for (int j = 0; j < cols; j++){
+			for (int i = 0; i < rows; i++){
+				int e = j*rows + i;
+				double w = (k == 0) ? W[e] : (k == 1) ? bf16(Wbf[e]) : (k == 2) ? fp16(Wfp[e]) : double(rowScale[i])*Wi8[e];
+				ref[i] += w*x[j];
+				scale[i] += fabs(w*x[j]);
+			}
+		}
+		check(name[k], out, ref, scale);
+	}
+
+	// sparse product, with rows from empty to over two vectors of values
+	vector<float> values;
+	vector<int> columns, rowStart(1, 0);
+	for (int i = 0; i < rows; i++){
+		for (int k = 0; k < (i*3) % 20; k++){
+			values.push_back(uniform());
+			columns.push_back((i + 5*k) % cols);
+		}
+		rowStart.push_back(values.size());
+	}
+	out = y0;
+	kernels->spmv(values.data(), columns.data(), rowStart.data(), x.data(), out.data(), rows);
+	ref.assign(y0.begin(), y0.end());
+	scale.assign(rows, 0.0);
+	for (int i = 0; i < rows; i++){
+		for (int k = rowStart[i]; k < rowStart[i + 1]; k++){
+			ref[i] += double(values[k])*x[columns[k]];
+			scale[i] += fabs(double(values[k])*x[columns[k]]);
+		}
+	}
+	check("spmv", out, ref, scale);
+
+	// Adam update of the third epoch
+	vector<float> p(W.begin(), W.end()), m(n), v(n);
+	const float alpha = 0.001f, beta1 = 0.9f, beta2 = 0.999f;
+	for (int i = 0; i < n; i++){
+		m[i] = 0.1f*uniform();
+		v[i] = 0.01f*fabs(uniform());
+	}
+	vector<float> g(W.rbegin(), W.rend()), mOut(m), vOut(v);
+	double c1 = 1.0 - pow(beta1, 3), c2 = 1.0 - pow(beta2, 3);
+	kernels->adam(p.data(), g.data(), mOut.data(), vOut.data(), n, alpha, beta1, beta2, c1, c2);
+	ref.assign(n, 0.0); scale.assign(n, 0.0);
+	for (int i = 0; i < n; i++){
+		double mi = beta1*double(m[i]) + (1.0 - beta1)*g[i];
+		double vi = beta2*double(v[i]) + (1.0 - beta2)*double(g[i])*g[i];
+		ref[i] = W[i] - alpha*(mi/c1)/(sqrt(vi/c2) + 1.0e-20);
+	}
+	check("adam", p, ref, scale);
+
+	// Gaussian encoding over the reference points of a degree of freedom
+	vector<float> refPoints(rows);
+	for (int r = 0; r < rows; r++)
+		refPoints[r] = -1.0f + 2.0f*r/(rows - 1);
+	const float value = 0.3f, sigma2 = 0.01f;
+	out.assign(rows, 0.0f);
+	kernels->gaussian(refPoints.data(), value, sigma2, out.data(), rows);
+	double normalization = 0.0;
+	ref.assign(rows, 0.0); scale.assign(rows, 0.0);
+	for (int r = 0; r < rows; r++){
+		ref[r] = exp(-pow(double(refPoints[r]) - value, 2)/sigma2);
+		normalization += ref[r];
+	}
+	for (int r = 0; r < rows; r++)
+		ref[r] /= normalization;
+	check("gaussian", out, ref, scale);
+
+	if (failures > 0)
+		return 1;
+	cout << "The kernels [" << isa << "] are correct" << endl;
+	return 0;
+}
@@ -191,6 +191,33 @@ void demonstrateExperiment(LibNRL* nrl) {
 	cout << endl << "simulation demonstration end" << endl << endl;
 }
 
+/**
+ * Demonstration of the reduced precision generation
+ * @param nrl Pointer to the NRL singleton instance
+ * */
+void demonstratePrecision(LibNRL* nrl) {
+
+	cout << endl << "precision report begin" << endl << endl;
+
+	nrl->load();
+
+	if (nrl->getNDof() > 0) {
+
+		int steps = 100;
+		float* model_state = new float[nrl->getStateDim()];
+		for (int i = 0 ; i < nrl->getStateDim(); i++)
+			model_state[i] = 0.0;
+
+		nrl->a_precisionReport("precision_report.txt", steps, model_state);
+
+		delete[] model_state;
+	} else {
+		cout << endl << "Hint: the model path may be incorrect, or perhaps it requires to be trained !"	<< endl;
+	}
+
+	cout << endl << "precision report end" << endl << endl;
+}
+
 int main(int argc, char** argv) {
 
 	cout << endl;
@@ -199,7 +226,7 @@ int main(int argc, char** argv) {
 	cout << "-----------------------------" << endl << endl;
 	cout << "This is a demonstration program for stand alone application " << endl << endl;
 	cout << "**** Instructions **** " << endl << endl;
-	cout << "To run: NRL_SA [PATH] [train|sim]" << endl << endl;
+	cout << "To run: NRL_SA [PATH] [worker=RANK/N] [train|sim|quant]" << endl << endl;
 	cout << "Arguments" << endl << endl;
 
 	cout << "PATH:  Full path to the property file distributed in 'src/standalone/data/config/properties.d'" << endl << endl;
@@ -208,6 +235,10 @@ int main(int argc, char** argv) {
 	cout << "       the parameters can be selected by editing the file 'properties.d'" << endl << endl;
 	cout << "sim:   simulates on-line interaction with the robot during 50 time steps" << endl;
 	cout << "       the loop time in milliseconds is shown in the standard output" << endl << endl;
+	cout << "quant: compares the generation with the weights in fp32, bf16, fp16 and int8" << endl;
+	cout << "       the errors are written to 'precision_report.txt'" << endl << endl;
+	cout << "worker=RANK/N: trains as the worker RANK (from 0) of N data-parallel processes," << endl;
+	cout << "       all of them started with the same property file" << endl << endl;
 	cout << "******************** " << endl;
 
 	LibNRL* nrl = LibNRL::getInstance();
@@ -227,12 +258,21 @@ int main(int argc, char** argv) {
 				continue;
 			}
 			ut->tolower(arg_s);
-			if (arg_s == "train")
+			if (arg_s.compare(0, 7, "worker=") == 0){
+				int rank = 0, workers = 1;
+				if (sscanf(arg_s.c_str(), "worker=%d/%d", &rank, &workers) == 2)
+					nrl->t_distribute(rank, workers);
+				else
+					cout << "Please indicate the worker as worker=RANK/N !" << endl;
+			}
+			else if (arg_s == "train")
 				demonstrateTraining(nrl);
 			else if (arg_s == "sim")
 				demonstrateExperiment(nrl);
+			else if (arg_s == "quant")
+				demonstratePrecision(nrl);
 			else
-				cout << "Please indicate a valid argument [train,sim] !" << endl;
+				cout << "Please indicate a valid argument [train,sim,quant] !" << endl;
 		}
 
 	}
@@ -0,0 +1,273 @@
+/*<!--
+
+ BSD 3-Clause License
+
+  Copyright (c) 2020 Okinawa Institute of Science and Technology (OIST).
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above
+     copyright notice, this list of conditions and the following
+     disclaimer in the documentation and/or other materials provided
+     with the distribution.
+   * Neither the name of Willow Garage, Inc. nor the names of its
+     contributors may be used to endorse or promote products derived
+     from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+ Author: Hendry F. Chame <hendryfchame@gmail.com>
+
+ Publication:
+
+   Chame, H. F., Ahmadi, A., & Tani, J. (2020).
+   A hybrid human-neurorobotics approach to primary intersubjectivity via
+   active inference. Frontiers in psychology, 11.
+
+   Okinawa Institute of Science and Technology Graduate University (OIST)
+   Cognitive Neurorobotics Research Unit (CNRU)
+   1919-1, Tancha, Onna, Kunigami District, Okinawa 904-0495, Japan
+
+-->*/
+
+#include "AllReduce.h"
+#include <thread>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+
+namespace oist {
+
+// maximum time waiting for the other workers, e.g. if one of them terminated
+static const double timeoutSeconds = 600.0;
+
+// value of the published headers, changed with the layout of the segment
+static const unsigned int headerMagic = 0x4e524c31;
+
+static size_t align(size_t bytes){
+	return (bytes + 63) & ~size_t(63);
+}
+
+template <typename F>
+void AllReduce::wait(F _condition, const char* _what){
+
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for (int i = 0; !_condition(); i++){
+		// spinning briefly, then yielding the core to the other workers
+		if (i < 1000)
+			std::this_thread::yield();
+		else
+			std::this_thread::sleep_for(chrono::microseconds(50));
+		if (chrono::duration<double>(chrono::steady_clock::now() - start).count() > timeoutSeconds){
+			stringstream stream;
+			stream << "Timeout of the worker " << rank << " waiting for " << _what << " [" << name << "]";
+			throw Exception(stream.str());
+		}
+	}
+}
+
+AllReduce::AllReduce(const string& _name, int _rank, int _workers, size_t _capacity, size_t _gatherCapacity) {
+
+	static_assert(ATOMIC_INT_LOCK_FREE == 2, "the shared memory barrier requires lock-free atomics");
+
+	name = _name;
+	rank = _rank;
+	workers = _workers;
+	capacity = _capacity;
+	gatherCapacity = _gatherCapacity;
+	round = 0;
+
+	if (workers < 1 || rank < 0 || rank >= workers){
+		stringstream stream;
+		stream << "Invalid worker " << rank << " of " << workers << " workers";
+		throw Exception(stream.str());
+	}
+
+	size_t offsetSlots = align(sizeof(Header));
+	size_t offsetResult = offsetSlots + align(workers*capacity*sizeof(float));
+	size_t offsetGathered = offsetResult + align(capacity*sizeof(float));
+	bytes = offsetGathered + align(2*gatherCapacity*sizeof(float));
+
+	void* data = MAP_FAILED;
+	if (rank == 0){
+		// a segment left by an interrupted training is discarded
+		shm_unlink(name.c_str());
+		int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+		if (fd >= 0 && ftruncate(fd, bytes) != 0){
+			close(fd);
+			fd = -1;
+		}
+		if (fd < 0){
+			stringstream stream;
+			stream << "The shared segment [" << name << "] could not be opened, msg[" << strerror(errno) << "]";
+			throw Exception(stream.str());
+		}
+		data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (data == MAP_FAILED){
+			stringstream stream;
+			stream << "The shared segment [" << name << "] could not be mapped, msg[" << strerror(errno) << "]";
+			throw Exception(stream.str());
+		}
+	}
+	else{
+		wait([this, &data](){ return (data = attach()) != MAP_FAILED; }, "the worker 0");
+	}
+
+	char* base = (char*)data;
+	header = (Header*)base;
+	slots = (float*)(base + offsetSlots);
+	result = (float*)(base + offsetResult);
+	gathered = (float*)(base + offsetGathered);
+
+	try{
+		if (rank == 0){
+			new (&header->arrived) std::atomic<int>(0);
+			new (&header->generation) std::atomic<int>(0);
+			new (&header->joined) std::atomic<int>(1);
+			header->owner = getpid();
+			header->workers = workers;
+			header->capacity = capacity;
+			header->gatherCapacity = gatherCapacity;
+			new (&header->magic) std::atomic<unsigned int>(0);
+			header->magic.store(headerMagic, std::memory_order_release);
+		}
+		else{
+			if (header->workers != workers || header->capacity != capacity || header->gatherCapacity != gatherCapacity){
+				stringstream stream;
+				stream << "The worker " << rank << " does not match the configuration of the worker 0 [" << name << "]";
+				throw Exception(stream.str());
+			}
+			header->joined.fetch_add(1, std::memory_order_acq_rel);
+		}
+		wait([this](){ return header->joined.load(std::memory_order_acquire) == workers; }, "all the workers");
+	}catch(Exception& _e){
+		munmap(header, bytes);
+		throw;
+	}
+
+	// the name is not needed anymore, the segment is released when the last worker detaches
+	if (rank == 0)
+		shm_unlink(name.c_str());
+}
+
+void* AllReduce::attach(){
+
+	int fd = shm_open(name.c_str(), O_RDWR, 0600);
+	if (fd < 0)
+		return MAP_FAILED;
+
+	// the segment is mapped once the worker 0 has set its size
+	void* data = MAP_FAILED;
+	struct stat st;
+	if (fstat(fd, &st) == 0 && (size_t)st.st_size >= bytes)
+		data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return MAP_FAILED;
+
+	// the header is read once published, and a segment whose worker 0 terminated is skipped until the new worker 0 replaces it
+	Header* h = (Header*)data;
+	if (h->magic.load(std::memory_order_acquire) != headerMagic || (kill(h->owner, 0) != 0 && errno == ESRCH)){
+		munmap(data, bytes);
+		return MAP_FAILED;
+	}
+	return data;
+}
+
+int AllReduce::getRank(){
+	return rank;
+}
+
+int AllReduce::getWorkers(){
+	return workers;
+}
+
+void AllReduce::barrier(){
+
+	int generation = header->generation.load(std::memory_order_acquire);
+	if (header->arrived.fetch_add(1, std::memory_order_acq_rel) == workers - 1){
+		header->arrived.store(0, std::memory_order_relaxed);
+		header->generation.fetch_add(1, std::memory_order_acq_rel);
+		return;
+	}
+	wait([this, generation](){ return header->generation.load(std::memory_order_acquire) != generation; }, "the barrier");
+}
+
+void AllReduce::reduce(vector<Map<VectorXf> >& _sum, vector<Map<VectorXf> >& _gather, const int1DContainer& _owner){
+
+	size_t n = 0;
+	for (unsigned int i = 0; i < _sum.size(); i++)
+		n += _sum[i].size();
+	size_t nGather = 0;
+	for (unsigned int i = 0; i < _gather.size(); i++)
+		nGather += _gather[i].size();
+	if (n > capacity || nGather > gatherCapacity || _owner.size() != _gather.size())
+		throw Exception("The reduced buffers exceed the capacity of the shared segment");
+
+	// contributions of this worker
+	float* slot = slots + rank*capacity;
+	for (unsigned int i = 0, pos = 0; i < _sum.size(); pos += _sum[i].size(), i++)
+		Map<VectorXf>(slot + pos, _sum[i].size()) = _sum[i];
+
+	float* gather = gathered + (round % 2)*gatherCapacity;
+	for (unsigned int i = 0, pos = 0; i < _gather.size(); pos += _gather[i].size(), i++){
+		if (_owner[i] == rank)
+			Map<VectorXf>(gather + pos, _gather[i].size()) = _gather[i];
+	}
+	barrier();
+
+	// each worker sums its chunk of all the slots
+	size_t chunk = (n + workers - 1)/workers;
+	size_t begin = std::min(n, rank*chunk);
+	size_t len = std::min(n, begin + chunk) - begin;
+	if (len > 0){
+		Map<VectorXf> res(result + begin, len);
+		res = Map<VectorXf>(slots + begin, len);
+		for (int k = 1; k < workers; k++)
+			res += Map<VectorXf>(slots + k*capacity + begin, len);
+	}
+	barrier();
+
+	for (unsigned int i = 0, pos = 0; i < _sum.size(); pos += _sum[i].size(), i++)
+		_sum[i] = Map<VectorXf>(result + pos, _sum[i].size());
+	for (unsigned int i = 0, pos = 0; i < _gather.size(); pos += _gather[i].size(), i++){
+		if (_owner[i] != rank)
+			_gather[i] = Map<VectorXf>(gather + pos, _gather[i].size());
+	}
+
+	// the next exchange writes the other gathering buffer, which nobody reads anymore
+	round++;
+}
+
+float AllReduce::sum(float _value){
+
+	vector<Map<VectorXf> > sum(1, Map<VectorXf>(&_value, 1));
+	vector<Map<VectorXf> > gather;
+	reduce(sum, gather, int1DContainer());
+	return _value;
+}
+
+AllReduce::~AllReduce() {
+	munmap(header, bytes);
+}
+
+} /* namespace oist */
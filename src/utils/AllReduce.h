@@ -0,0 +1,161 @@
+/*<!--
+
+ BSD 3-Clause License
+
+  Copyright (c) 2020 Okinawa Institute of Science and Technology (OIST).
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above
+     copyright notice, this list of conditions and the following
+     disclaimer in the documentation and/or other materials provided
+     with the distribution.
+   * Neither the name of Willow Garage, Inc. nor the names of its
+     contributors may be used to endorse or promote products derived
+     from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+ Author: Hendry F. Chame <hendryfchame@gmail.com>
+
+ Publication:
+
+   Chame, H. F., Ahmadi, A., & Tani, J. (2020).
+   A hybrid human-neurorobotics approach to primary intersubjectivity via
+   active inference. Frontiers in psychology, 11.
+
+   Okinawa Institute of Science and Technology Graduate University (OIST)
+   Cognitive Neurorobotics Research Unit (CNRU)
+   1919-1, Tancha, Onna, Kunigami District, Okinawa 904-0495, Japan
+
+-->*/
+
+#ifndef SRC_UTILS_ALLREDUCE_H_
+#define SRC_UTILS_ALLREDUCE_H_
+
+#include "../includes.h"
+#include <atomic>
+
+namespace oist {
+
+/**
+ * This class sums buffers across the worker processes of a data-parallel training on a single host,
+ * through a POSIX shared memory segment. Each worker writes its contribution in its own slot, and
+ * the sum is split in one chunk per worker (reduce-scatter), so that each worker only reads its chunk
+ * of all the slots, followed by the copy of the whole result. The contributions are always added in the
+ * worker order, hence all the workers obtain exactly the same sum.
+ * Besides the sum, buffers owned by a single worker (e.g. the A variables of its primitives) are
+ * gathered by all the workers in the same exchange.
+ * The segment is created by the worker 0 and unlinked once all the workers are attached, so it does not
+ * outlive the training processes. The other workers only join a segment whose header has been published
+ * by a running worker 0, so a segment left by an interrupted training is never joined
+ * */
+class AllReduce {
+
+	/**
+	 * Header of the shared segment
+	 * */
+	struct Header {
+		std::atomic<unsigned int> magic;	// set by the worker 0 once the header is initialized
+		int owner;						// process id of the worker 0
+		std::atomic<int> joined;		// number of attached workers
+		std::atomic<int> arrived;		// number of workers waiting at the barrier
+		std::atomic<int> generation;	// number of completed barriers
+		int workers;
+		size_t capacity;
+		size_t gatherCapacity;
+	};
+
+	string name;
+	int rank;
+	int workers;
+	size_t capacity;			// maximum number of summed values
+	size_t gatherCapacity;		// maximum number of gathered values
+	size_t bytes;
+	Header* header;
+	float* slots;				// contributions [worker][capacity]
+	float* result;				// sum [capacity]
+	float* gathered;			// gathered values [2][gatherCapacity], double buffered between exchanges
+	int round;
+
+	/**
+	 * Maps the segment created by the worker 0, if its header is published and the worker 0 is running
+	 * @return Mapped segment, or MAP_FAILED if it is not available yet
+	 * */
+	void* attach();
+
+	/**
+	 * Waits until all the workers reach the barrier
+	 * */
+	void barrier();
+
+	/**
+	 * Waits until a condition is true
+	 * @param condition Condition
+	 * @param what Description of the waited event for the timeout error
+	 * */
+	template <typename F> void wait(F condition, const char* what);
+
+public:
+
+	/**
+	 * Constructor, creates (worker 0) or attaches (other workers) the shared segment, and waits for all the workers
+	 * @param name Name of the shared segment, common to all the workers of a training and unique across the trainings
+	 * @param rank Worker index from 0
+	 * @param workers Number of workers
+	 * @param capacity Maximum number of summed values
+	 * @param gatherCapacity Maximum number of gathered values
+	 * */
+	AllReduce(const string& name, int rank, int workers, size_t capacity, size_t gatherCapacity);
+
+	/**
+	 * Gets the worker index
+	 * */
+	int getRank();
+
+	/**
+	 * Gets the number of workers
+	 * */
+	int getWorkers();
+
+	/**
+	 * Sums buffers across the workers and gathers the owned buffers. All the workers should call it with
+	 * buffers of the same sizes
+	 * @param sum Buffers replaced by their sum across the workers
+	 * @param gather Buffers replaced by the ones of their owner
+	 * @param owner Worker owning each gathered buffer
+	 * */
+	void reduce(vector<Map<VectorXf> >& sum, vector<Map<VectorXf> >& gather, const int1DContainer& owner);
+
+	/**
+	 * Sums a value across the workers
+	 * @param value Value of the worker
+	 * @return Sum
+	 * */
+	float sum(float value);
+
+	/**
+	 * Destructor, detaches the shared segment
+	 * */
+	virtual ~AllReduce();
+};
+
+} /* namespace oist */
+
+#endif /* SRC_UTILS_ALLREDUCE_H_ */
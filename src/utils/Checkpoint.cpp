@@ -0,0 +1,389 @@
+/*<!--
+
+ BSD 3-Clause License
+
+  Copyright (c) 2020 Okinawa Institute of Science and Technology (OIST).
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above
+     copyright notice, this list of conditions and the following
+     disclaimer in the documentation and/or other materials provided
+     with the distribution.
+   * Neither the name of Willow Garage, Inc. nor the names of its
+     contributors may be used to endorse or promote products derived
+     from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+ Author: Hendry F. Chame <hendryfchame@gmail.com>
+
+ Publication:
+
+   Chame, H. F., Ahmadi, A., & Tani, J. (2020).
+   A hybrid human-neurorobotics approach to primary intersubjectivity via
+   active inference. Frontiers in psychology, 11.
+
+   Okinawa Institute of Science and Technology Graduate University (OIST)
+   Cognitive Neurorobotics Research Unit (CNRU)
+   1919-1, Tancha, Onna, Kunigami District, Okinawa 904-0495, Japan
+
+-->*/
+
+
+#include "Checkpoint.h"
+
+#if !defined(_WIN32) || defined(__CYGWIN__)
+#define NRL_MMAP_AVAILABLE
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace oist {
+
+const char Checkpoint::magic[8] = {'N','R','L','C','K','P','T','\0'};
+const unsigned int Checkpoint::version = 1;
+const unsigned int Checkpoint::alignment = 64;
+
+Checkpoint::Checkpoint(){
+	data = nullptr;
+	dataSize = 0;
+	mapping = nullptr;
+	mappingSize = 0;
+}
+
+void Checkpoint::clear(){
+	unmap();
+	meta.clear();
+	blocks.clear();
+	index.clear();
+	buffer.clear();
+	data = nullptr;
+	dataSize = 0;
+}
+
+void Checkpoint::setMeta(const string& _key, const float1DContainer& _value){
+	meta[_key] = _value;
+}
+
+void Checkpoint::setMeta(const string& _key, float _value){
+	meta[_key] = float1DContainer(1, _value);
+}
+
+bool Checkpoint::getMeta(const string& _key, float1DContainer& _value){
+	std::map<string, float1DContainer>::iterator it = meta.find(_key);
+	if (it == meta.end())
+		return false;
+	_value = it->second;
+	return true;
+}
+
+bool Checkpoint::has(const string& _name){
+	return index.find(_name) != index.end();
+}
+
+size_t Checkpoint::reserve(const string& _name, int _rows, int _cols){
+
+	if (mapping != nullptr)
+		throw Exception("A memory-mapped checkpoint is read-only");
+	if (has(_name)){
+		stringstream stream;
+		stream << "The checkpoint block [" << _name << "] is duplicated";
+		throw Exception(stream.str());
+	}
+
+	// each block starts at an aligned position of the data section
+	size_t step = alignment/sizeof(float);
+	size_t offset = ((buffer.size() + step - 1)/step)*step;
+
+	Block b;
+	b.name = _name;
+	b.rows = _rows;
+	b.cols = _cols;
+	b.offset = offset;
+
+	index[_name] = blocks.size();
+	blocks.push_back(b);
+
+	buffer.resize(offset + ((size_t)_rows)*_cols, 0.0f);
+	data = buffer.data();
+	dataSize = buffer.size();
+	return offset;
+}
+
+const Checkpoint::Block& Checkpoint::find(const string& _name, int _rows, int _cols){
+
+	std::map<string, int>::iterator it = index.find(_name);
+	if (it == index.end()){
+		stringstream stream;
+		stream << "The checkpoint block [" << _name << "] is not available";
+		throw Exception(stream.str());
+	}
+	const Block& b = blocks[it->second];
+	if (b.rows != _rows || b.cols != _cols){
+		stringstream stream;
+		stream << "The checkpoint block [" << _name << "] has size [" << b.rows << "," << b.cols
+			   << "], expected [" << _rows << "," << _cols << "]. Hint: check the model properties";
+		throw Exception(stream.str());
+	}
+	return b;
+}
+
+void Checkpoint::add(const string& _name, vectorXf1DContainer* _v){
+
+	int rows = _v->size() > 0 ? _v->front().size() : 0;
+	size_t offset = reserve(_name, rows, _v->size());
+	float* d = buffer.data() + offset;
+	for (vectorXf1DContainer::iterator it = _v->begin(); it != _v->end(); it++, d+= rows){
+		if (it->size() != rows)
+			throw Exception("The vectors of a checkpoint block should have the same dimension");
+		if (rows > 0)
+			memcpy(d, it->data(), rows*sizeof(float));
+	}
+}
+
+void Checkpoint::get(const string& _name, vectorXf1DContainer* _v){
+
+	int rows = _v->size() > 0 ? _v->front().size() : 0;
+	const Block& b = find(_name, rows, _v->size());
+	const float* d = data + b.offset;
+	for (vectorXf1DContainer::iterator it = _v->begin(); it != _v->end() && rows > 0; it++, d+= rows){
+		memcpy(it->data(), d, rows*sizeof(float));
+	}
+}
+
+Map<const MatrixXf> Checkpoint::view(const string& _name){
+
+	std::map<string, int>::iterator it = index.find(_name);
+	if (it == index.end()){
+		stringstream stream;
+		stream << "The checkpoint block [" << _name << "] is not available";
+		throw Exception(stream.str());
+	}
+	const Block& b = blocks[it->second];
+	return Map<const MatrixXf>(data + b.offset, b.rows, b.cols);
+}
+
+void Checkpoint::write(const string& _path){
+
+	// the file is written under a temporary name and renamed,
+	// so that an interrupted save does not corrupt the previous checkpoint
+	string tmpPath = _path + ".tmp";
+	ofstream file(tmpPath, std::ofstream::out | std::ofstream::binary);
+	if (!file.is_open()){
+		stringstream stream;
+		stream << "Fail to open/create the checkpoint file [" << tmpPath << "]";
+		throw Exception(stream.str());
+	}
+
+	unsigned int nMeta = meta.size();
+	unsigned int nBlocks = blocks.size();
+
+	stringstream header;
+	for (std::map<string, float1DContainer>::iterator it = meta.begin(); it != meta.end(); it++){
+		unsigned int len = it->first.size();
+		unsigned int n = it->second.size();
+		header.write((const char*)&len, sizeof(len));
+		header.write(it->first.data(), len);
+		header.write((const char*)&n, sizeof(n));
+		if (n > 0)
+			header.write((const char*)it->second.data(), n*sizeof(float));
+	}
+	for (vector<Block>::iterator it = blocks.begin(); it != blocks.end(); it++){
+		unsigned int len = it->name.size();
+		unsigned long long offset = it->offset;
+		header.write((const char*)&len, sizeof(len));
+		header.write(it->name.data(), len);
+		header.write((const char*)&it->rows, sizeof(it->rows));
+		header.write((const char*)&it->cols, sizeof(it->cols));
+		header.write((const char*)&offset, sizeof(offset));
+	}
+	string headerStr = header.str();
+
+	// fixed part: magic, version, number of meta entries and blocks, data section offset and size
+	unsigned long long fixedSize = sizeof(magic) + 3*sizeof(unsigned int) + 2*sizeof(unsigned long long);
+	unsigned long long dataOffset = ((fixedSize + headerStr.size() + alignment - 1)/alignment)*alignment;
+	unsigned long long nFloats = dataSize;
+
+	file.write(magic, sizeof(magic));
+	file.write((const char*)&version, sizeof(version));
+	file.write((const char*)&nMeta, sizeof(nMeta));
+	file.write((const char*)&nBlocks, sizeof(nBlocks));
+	file.write((const char*)&dataOffset, sizeof(dataOffset));
+	file.write((const char*)&nFloats, sizeof(nFloats));
+	file.write(headerStr.data(), headerStr.size());
+
+	string padding(dataOffset - fixedSize - headerStr.size(), '\0');
+	file.write(padding.data(), padding.size());
+	if (nFloats > 0)
+		file.write((const char*)data, nFloats*sizeof(float));
+
+	file.close();
+	if (file.fail()){
+		stringstream stream;
+		stream << "IO Error while writing the checkpoint file [" << tmpPath << "]";
+		throw Exception(stream.str());
+	}
+	if (rename(tmpPath.c_str(), _path.c_str()) != 0){
+		stringstream stream;
+		stream << "The checkpoint file [" << tmpPath << "] could not be renamed to [" << _path << "]";
+		throw Exception(stream.str());
+	}
+}
+
+void Checkpoint::read(const string& _path, bool _useMmap){
+
+	clear();
+
+	ifstream file(_path, std::ifstream::in | std::ifstream::binary);
+	if (!file.is_open()){
+		stringstream stream;
+		stream << "The checkpoint file [" << _path << "] could not be opened";
+		throw Exception(stream.str());
+	}
+
+	char fMagic[sizeof(magic)];
+	unsigned int fVersion = 0, nMeta = 0, nBlocks = 0;
+	unsigned long long dataOffset = 0, nFloats = 0;
+
+	file.read(fMagic, sizeof(fMagic));
+	file.read((char*)&fVersion, sizeof(fVersion));
+	file.read((char*)&nMeta, sizeof(nMeta));
+	file.read((char*)&nBlocks, sizeof(nBlocks));
+	file.read((char*)&dataOffset, sizeof(dataOffset));
+	file.read((char*)&nFloats, sizeof(nFloats));
+
+	if (!file.good() || memcmp(fMagic, magic, sizeof(magic)) != 0){
+		stringstream stream;
+		stream << "The file [" << _path << "] is not a NRL checkpoint";
+		throw Exception(stream.str());
+	}
+	if (fVersion != version){
+		stringstream stream;
+		stream << "The checkpoint [" << _path << "] version " << fVersion << " is not supported (expected " << version << ")";
+		throw Exception(stream.str());
+	}
+
+	for (unsigned int i = 0; i < nMeta; i++){
+		unsigned int len = 0, n = 0;
+		file.read((char*)&len, sizeof(len));
+		string key(len, '\0');
+		file.read(&key[0], len);
+		file.read((char*)&n, sizeof(n));
+		float1DContainer value(n);
+		if (n > 0)
+			file.read((char*)value.data(), n*sizeof(float));
+		meta[key] = value;
+	}
+	for (unsigned int i = 0; i < nBlocks; i++){
+		unsigned int len = 0;
+		unsigned long long offset = 0;
+		Block b;
+		file.read((char*)&len, sizeof(len));
+		b.name = string(len, '\0');
+		file.read(&b.name[0], len);
+		file.read((char*)&b.rows, sizeof(b.rows));
+		file.read((char*)&b.cols, sizeof(b.cols));
+		file.read((char*)&offset, sizeof(offset));
+		b.offset = offset;
+		if (b.offset + ((size_t)b.rows)*b.cols > nFloats){
+			stringstream stream;
+			stream << "The checkpoint block [" << b.name << "] exceeds the data section of [" << _path << "]";
+			throw Exception(stream.str());
+		}
+		index[b.name] = blocks.size();
+		blocks.push_back(b);
+	}
+	if (!file.good()){
+		stringstream stream;
+		stream << "IO Error while reading the header of the checkpoint [" << _path << "]";
+		throw Exception(stream.str());
+	}
+	dataSize = nFloats;
+
+	// a truncated file would be mapped beyond its end, whose pages fault when they are read
+	size_t size = dataOffset + nFloats*sizeof(float);
+
+#ifdef NRL_MMAP_AVAILABLE
+	if (_useMmap && nFloats > 0){
+		file.close();
+		int fd = open(_path.c_str(), O_RDONLY);
+		if (fd >= 0){
+			struct stat st;
+			bool sized = (fstat(fd, &st) == 0);
+			if (sized && (size_t)st.st_size < size){
+				close(fd);
+				stringstream stream;
+				stream << "The checkpoint [" << _path << "] is truncated, " << size << " bytes are expected";
+				throw Exception(stream.str());
+			}
+			// without the file size, the data section is read (and checked) below instead of being mapped
+			void* m = (sized ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED);
+			close(fd);
+			if (m != MAP_FAILED){
+				mapping = m;
+				mappingSize = size;
+				data = (const float*)((const char*)m + dataOffset);
+				return;
+			}
+		}
+		file.open(_path, std::ifstream::in | std::ifstream::binary);
+	}
+#endif
+
+	file.seekg(0, std::ios::end);
+	if (!file.good() || (size_t)file.tellg() < size){
+		stringstream stream;
+		stream << "The checkpoint [" << _path << "] is truncated, " << size << " bytes are expected";
+		throw Exception(stream.str());
+	}
+
+	buffer.resize(nFloats);
+	file.seekg(dataOffset);
+	if (nFloats > 0)
+		file.read((char*)buffer.data(), nFloats*sizeof(float));
+	if (!file.good()){
+		stringstream stream;
+		stream << "IO Error while reading the data of the checkpoint [" << _path << "]";
+		throw Exception(stream.str());
+	}
+	data = buffer.data();
+}
+
+bool Checkpoint::exists(const string& _path){
+	ifstream file(_path);
+	return file.good();
+}
+
+void Checkpoint::unmap(){
+#ifdef NRL_MMAP_AVAILABLE
+	if (mapping != nullptr)
+		munmap(mapping, mappingSize);
+#endif
+	mapping = nullptr;
+	mappingSize = 0;
+}
+
+Checkpoint::~Checkpoint(){
+	unmap();
+}
+
+} /* namespace oist */
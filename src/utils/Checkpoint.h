@@ -0,0 +1,221 @@
+/*<!--
+
+ BSD 3-Clause License
+
+  Copyright (c) 2020 Okinawa Institute of Science and Technology (OIST).
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above
+     copyright notice, this list of conditions and the following
+     disclaimer in the documentation and/or other materials provided
+     with the distribution.
+   * Neither the name of Willow Garage, Inc. nor the names of its
+     contributors may be used to endorse or promote products derived
+     from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+ Author: Hendry F. Chame <hendryfchame@gmail.com>
+
+ Publication:
+
+   Chame, H. F., Ahmadi, A., & Tani, J. (2020).
+   A hybrid human-neurorobotics approach to primary intersubjectivity via
+   active inference. Frontiers in psychology, 11.
+
+   Okinawa Institute of Science and Technology Graduate University (OIST)
+   Cognitive Neurorobotics Research Unit (CNRU)
+   1919-1, Tancha, Onna, Kunigami District, Okinawa 904-0495, Japan
+
+-->*/
+
+
+#ifndef SRC_UTILS_CHECKPOINT_H_
+#define SRC_UTILS_CHECKPOINT_H_
+
+#include "../includes.h"
+
+namespace oist {
+
+/**
+ * This class implements a single-file binary model checkpoint.
+ * The file is composed of a header (magic number, version, meta entries and the block table),
+ * followed by the raw float blocks, each one aligned to @ref alignment bytes.
+ * Meta entries store small descriptive vectors (e.g. layer configuration, epoch, loss),
+ * while blocks store the model parameters in Eigen (column-major) order.
+ * When reading, the file can be memory-mapped so that parameters are copied (or viewed, see @ref view)
+ * directly from the page cache without any parsing.
+ * */
+class Checkpoint {
+
+	/**
+	 * Block table entry
+	 * */
+	struct Block {
+		string name;
+		int rows;
+		int cols;
+		size_t offset; // position (in floats) of the block in the data section
+	};
+
+	std::map<string, float1DContainer> meta;
+	vector<Block> blocks;
+	std::map<string, int> index;
+
+	float1DContainer buffer;	// owned data section (writing mode or non-mapped reading)
+	const float* data;			// data section in use (either the buffer or the mapped file)
+	size_t dataSize;			// number of floats in the data section
+
+	void* mapping;
+	size_t mappingSize;
+
+	size_t reserve(const string& name, int rows, int cols);
+	const Block& find(const string& name, int rows, int cols);
+	void unmap();
+
+public:
+
+	static const char magic[8];
+	static const unsigned int version;
+	static const unsigned int alignment;
+
+	/**
+	 * Constructor
+	 * */
+	Checkpoint();
+
+	/**
+	 * The checkpoints cannot be copied, since they own the mapped region of the file (see @ref read)
+	 * */
+	Checkpoint(const Checkpoint&) = delete;
+	Checkpoint& operator=(const Checkpoint&) = delete;
+
+	/**
+	 * Removes the meta entries and the blocks. The allocated memory is kept,
+	 * so that the same object can be refilled at low cost
+	 * */
+	void clear();
+
+	/**
+	 * Sets a meta entry
+	 * @param key Entry name
+	 * @param value Entry value
+	 * */
+	void setMeta(const string& key, const float1DContainer& value);
+
+	/**
+	 * Sets a scalar meta entry
+	 * @param key Entry name
+	 * @param value Entry value
+	 * */
+	void setMeta(const string& key, float value);
+
+	/**
+	 * Gets a meta entry
+	 * @param key Entry name
+	 * @param value Output container
+	 * @return true if the entry is available
+	 * */
+	bool getMeta(const string& key, float1DContainer& value);
+
+	/**
+	 * Checks whether a block is available
+	 * @param name Block name
+	 * */
+	bool has(const string& name);
+
+	/**
+	 * Copies Eigen data into a new block
+	 * @param name Block name
+	 * @param input Eigen data pointer
+	 * */
+	template <typename T> void add(const string& name, T* input);
+
+	/**
+	 * Copies a container of vectors with the same dimension into a new block (one column per vector)
+	 * @param name Block name
+	 * @param input Container pointer
+	 * */
+	void add(const string& name, vectorXf1DContainer* input);
+
+	/**
+	 * Copies a block into Eigen data. The dimensions must match
+	 * @param name Block name
+	 * @param output Eigen data pointer
+	 * */
+	template <typename T> void get(const string& name, T* output);
+
+	/**
+	 * Copies a block into a container of vectors (one column per vector). The dimensions must match
+	 * @param name Block name
+	 * @param output Container pointer
+	 * */
+	void get(const string& name, vectorXf1DContainer* output);
+
+	/**
+	 * Gets a read-only view of a block without copying. The view is valid while the checkpoint is
+	 * neither cleared, refilled nor destroyed
+	 * @param name Block name
+	 * @return Eigen map over the block data
+	 * */
+	Map<const MatrixXf> view(const string& name);
+
+	/**
+	 * Writes the checkpoint to file
+	 * @param path File full path
+	 * */
+	void write(const string& path);
+
+	/**
+	 * Reads a checkpoint from file
+	 * @param path File full path
+	 * @param useMmap If true the file is memory-mapped instead of copied to memory
+	 * */
+	void read(const string& path, bool useMmap);
+
+	/**
+	 * Checks if a file exists
+	 * @param path File full path
+	 * */
+	static bool exists(const string& path);
+
+	/**
+	 * Destructor
+	 * */
+	~Checkpoint();
+};
+
+	template <typename T>
+	void Checkpoint::add(const string& _name, T* _e){
+		size_t offset = reserve(_name, _e->rows(), _e->cols());
+		if (_e->size() > 0)
+			memcpy(&buffer[offset], _e->data(), _e->size()*sizeof(float));
+	}
+
+	template <typename T>
+	void Checkpoint::get(const string& _name, T* _e){
+		const Block& b = find(_name, _e->rows(), _e->cols());
+		if (_e->size() > 0)
+			memcpy(_e->data(), data + b.offset, _e->size()*sizeof(float));
+	}
+
+} /* namespace oist */
+
+#endif /* SRC_UTILS_CHECKPOINT_H_ */
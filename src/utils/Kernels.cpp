@@ -0,0 +1,109 @@
+/*<!--
+
+ BSD 3-Clause License
+
+  Copyright (c) 2020 Okinawa Institute of Science and Technology (OIST).
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above
+     copyright notice, this list of conditions and the following
+     disclaimer in the documentation and/or other materials provided
+     with the distribution.
+   * Neither the name of Willow Garage, Inc. nor the names of its
+     contributors may be used to endorse or promote products derived
+     from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+ Author: Hendry F. Chame <hendryfchame@gmail.com>
+
+ Publication:
+
+   Chame, H. F., Ahmadi, A., & Tani, J. (2020).
+   A hybrid human-neurorobotics approach to primary intersubjectivity via
+   active inference. Frontiers in psychology, 11.
+
+   Okinawa Institute of Science and Technology Graduate University (OIST)
+   Cognitive Neurorobotics Research Unit (CNRU)
+   1919-1, Tancha, Onna, Kunigami District, Okinawa 904-0495, Japan
+
+-->*/
+
+#include "Kernels.h"
+#include <iostream>
+#include <cstdlib>
+
+namespace oist {
+
+	const KernelTable* kernels = &kernelsGeneric;
+
+	/**
+	 * Checks if the CPU (and the operating system) supports the instruction set of a kernel table
+	 * */
+	static bool isSupported(const KernelTable* _table){
+
+		if (_table == &kernelsGeneric)
+			return true;
+		if (_table == nullptr)
+			return false;
+#ifdef NRL_KERNELS_X86
+		__builtin_cpu_init();
+		bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c");
+		if (_table == kernelsAvx2)
+			return avx2;
+		if (_table == kernelsAvx512)
+			return avx2 && __builtin_cpu_supports("avx512f");
+#endif
+		return false;
+	}
+
+	std::string selectKernels(){
+
+		// from the best instruction set
+		const KernelTable* tables[] = {kernelsAvx512, kernelsAvx2, &kernelsGeneric};
+
+		const KernelTable* best = &kernelsGeneric;
+		for (const KernelTable* t : tables){
+			if (isSupported(t)){
+				best = t;
+				break;
+			}
+		}
+		kernels = best;
+
+		const char* isa = getenv("NRL_ISA");
+		if (isa == nullptr || *isa == '\0')
+			return kernels->isa;
+
+		std::string name(isa);
+		for (const KernelTable* t : tables){
+			if (t != nullptr && name == t->isa){
+				if (isSupported(t))
+					kernels = t;
+				else
+					std::cout << "Warning: the instruction set [" << name << "] of 'NRL_ISA' is not supported, [" << best->isa << "] is used" << std::endl;
+				return kernels->isa;
+			}
+		}
+		std::cout << "Warning: unknown instruction set [" << name << "] of 'NRL_ISA', [" << best->isa << "] is used" << std::endl;
+		return kernels->isa;
+	}
+
+} /* namespace oist */
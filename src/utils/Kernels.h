@@ -0,0 +1,144 @@
+/*<!--
+
+ BSD 3-Clause License
+
+  Copyright (c) 2020 Okinawa Institute of Science and Technology (OIST).
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above
+     copyright notice, this list of conditions and the following
+     disclaimer in the documentation and/or other materials provided
+     with the distribution.
+   * Neither the name of Willow Garage, Inc. nor the names of its
+     contributors may be used to endorse or promote products derived
+     from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+ Author: Hendry F. Chame <hendryfchame@gmail.com>
+
+ Publication:
+
+   Chame, H. F., Ahmadi, A., & Tani, J. (2020).
+   A hybrid human-neurorobotics approach to primary intersubjectivity via
+   active inference. Frontiers in psychology, 11.
+
+   Okinawa Institute of Science and Technology Graduate University (OIST)
+   Cognitive Neurorobotics Research Unit (CNRU)
+   1919-1, Tancha, Onna, Kunigami District, Okinawa 904-0495, Japan
+
+-->*/
+
+#ifndef SRC_UTILS_KERNELS_H_
+#define SRC_UTILS_KERNELS_H_
+
+#include <string>
+#include <cstdint>
+
+namespace oist {
+
+/**
+ * Table of the heavy element-wise and matrix-vector kernels, compiled once per instruction set.
+ * The buffers are plain float arrays, matrices are column-major
+ * */
+struct KernelTable {
+
+	const char* isa;			// name of the instruction set, as given in NRL_ISA
+
+	/**
+	 * Computes the hyperbolic tangent in place
+	 * */
+	void (*tanh)(float* io, int n);
+
+	/**
+	 * Computes the exponential in place and normalizes it
+	 * @return Sum of the exponentials before normalization
+	 * */
+	float (*softmax)(float* io, int n);
+
+	/**
+	 * Accumulates a matrix-vector product, y += W*x
+	 * @param W Matrix of rows x cols values
+	 * */
+	void (*gemv)(const float* W, const float* x, float* y, int rows, int cols);
+
+	/**
+	 * Accumulates a matrix-vector product with the matrix in brain floating point, y += W*x
+	 * */
+	void (*gemvBf16)(const uint16_t* W, const float* x, float* y, int rows, int cols);
+
+	/**
+	 * Accumulates a matrix-vector product with the matrix in IEEE half precision, y += W*x
+	 * */
+	void (*gemvFp16)(const uint16_t* W, const float* x, float* y, int rows, int cols);
+
+	/**
+	 * Accumulates a matrix-vector product with the matrix in 8 bits integers, y += diag(scale)*W*x
+	 * @param scale Scale of each row
+	 * */
+	void (*gemvInt8)(const int8_t* W, const float* scale, const float* x, float* y, int rows, int cols);
+
+	/**
+	 * Accumulates a product with a matrix in compressed sparse row format, y += W*x
+	 * @param values Non-zero values row by row
+	 * @param columns Column of each value
+	 * @param rowStart Position of the first value of each row, rows + 1 positions
+	 * */
+	void (*spmv)(const float* values, const int* columns, const int* rowStart, const float* x, float* y, int rows);
+
+	/**
+	 * Adam update of a parameter
+	 * @param c1 Bias correction of the first moment, 1 - beta1^epoch
+	 * @param c2 Bias correction of the second moment, 1 - beta2^epoch
+	 * */
+	void (*adam)(float* p, const float* g, float* m, float* v, int n, float alpha, float beta1, float beta2, double c1, double c2);
+
+	/**
+	 * Gaussian (softmax) encoding of a normalized value over the reference points of a degree of freedom
+	 * @param ref Reference points
+	 * @param v Normalized value
+	 * @param sigma2 Squared sigma of the encoding
+	 * @param out Encoding, normalized to sum one
+	 * */
+	void (*gaussian)(const float* ref, float v, float sigma2, float* out, int n);
+};
+
+/**
+ * Kernel tables of each instruction set, the x86 ones are null when the compiler does not target x86
+ * */
+extern const KernelTable kernelsGeneric;
+extern const KernelTable* const kernelsAvx2;
+extern const KernelTable* const kernelsAvx512;
+
+/**
+ * Kernels in use, the generic ones until @ref selectKernels is called
+ * */
+extern const KernelTable* kernels;
+
+/**
+ * Selects the kernels of the best instruction set supported by the CPU (AVX-512, AVX2 with FMA and F16C or generic),
+ * unless the environment variable NRL_ISA names another one ('generic', 'avx2' or 'avx512')
+ * @return Name of the selected instruction set
+ * */
+std::string selectKernels();
+
+} /* namespace oist */
+
+#endif /* SRC_UTILS_KERNELS_H_ */
@@ -0,0 +1,230 @@
+/*<!--
+
+ BSD 3-Clause License
+
+  Copyright (c) 2020 Okinawa Institute of Science and Technology (OIST).
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above
+     copyright notice, this list of conditions and the following
+     disclaimer in the documentation and/or other materials provided
+     with the distribution.
+   * Neither the name of Willow Garage, Inc. nor the names of its
+     contributors may be used to endorse or promote products derived
+     from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+ Author: Hendry F. Chame <hendryfchame@gmail.com>
+
+ Publication:
+
+   Chame, H. F., Ahmadi, A., & Tani, J. (2020).
+   A hybrid human-neurorobotics approach to primary intersubjectivity via
+   active inference. Frontiers in psychology, 11.
+
+   Okinawa Institute of Science and Technology Graduate University (OIST)
+   Cognitive Neurorobotics Research Unit (CNRU)
+   1919-1, Tancha, Onna, Kunigami District, Okinawa 904-0495, Japan
+
+-->*/
+
+#ifndef SRC_UTILS_KERNELSIMPL_H_
+#define SRC_UTILS_KERNELSIMPL_H_
+
+// NOTE: this file is included by one translation unit per instruction set, which is compiled with the
+// flags of that instruction set. The functions have internal linkage, hence the variants are not merged
+// by the linker. They only call the C library and the (always inlined) intrinsics, and never the inline
+// functions of the C++ standard library (std::min, std::exp, ...), whose out-of-line copies are shared by
+// all the units and could be taken from an AVX-512 unit by the generic kernels
+
+#include <math.h>
+#include <string.h>
+#if defined(__F16C__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#include "Kernels.h"
+
+namespace oist {
+namespace {
+
+	// NON_ZERO of includes.h, which is not included here to keep Eigen out of the variants
+	const float nonZero = 1.0e-20f;
+
+	inline int minimum(int _a, int _b){
+		return _a < _b ? _a : _b;
+	}
+
+	void tanhKernel(float* _io, int _n){
+		for (int i = 0; i < _n; i++)
+			_io[i] = tanhf(_io[i]);
+	}
+
+	float softmaxKernel(float* _io, int _n){
+		float accum = 0.0;
+		for (int i = 0; i < _n; i++){
+			_io[i] = expf(_io[i]);
+			accum += _io[i];
+		}
+		for (int i = 0; i < _n; i++)
+			_io[i] /= accum;
+		return accum;
+	}
+
+	void gemvKernel(const float* _W, const float* _x, float* _y, int _rows, int _cols){
+		for (int j = 0; j < _cols; j++){
+			const float* w = _W + j*_rows;
+			float xj = _x[j];
+			for (int i = 0; i < _rows; i++)
+				_y[i] += w[i]*xj;
+		}
+	}
+
+	// the half precision values are widened to single precision in the loops, which are vectorized
+	inline float bf16ToFloat(uint16_t _h){
+		uint32_t b = uint32_t(_h) << 16;
+		float f;
+		memcpy(&f, &b, sizeof(f));
+		return f;
+	}
+
+	inline float fp16ToFloat(uint16_t _h){
+		// the exponent and mantissa are moved to the single precision positions and the bias is fixed by
+		// a product with 2^112, which also scales the subnormal values exactly
+		uint32_t b = uint32_t(_h & 0x7fffu) << 13;
+		bool special = (b & 0x0f800000u) == 0x0f800000u;
+		float f;
+		memcpy(&f, &b, sizeof(f));
+		f *= 5.192296858534828e+33f;
+		memcpy(&b, &f, sizeof(b));
+		if (special)
+			b |= 0x7f800000u;
+		b |= uint32_t(_h & 0x8000u) << 16;
+		memcpy(&f, &b, sizeof(f));
+		return f;
+	}
+
+	void gemvBf16Kernel(const uint16_t* _W, const float* _x, float* _y, int _rows, int _cols){
+		for (int j = 0; j < _cols; j++){
+			const uint16_t* w = _W + j*_rows;
+			float xj = _x[j];
+			for (int i = 0; i < _rows; i++)
+				_y[i] += bf16ToFloat(w[i])*xj;
+		}
+	}
+
+	void gemvFp16Kernel(const uint16_t* _W, const float* _x, float* _y, int _rows, int _cols){
+		for (int j = 0; j < _cols; j++){
+			const uint16_t* w = _W + j*_rows;
+			float xj = _x[j];
+			int i = 0;
+#ifdef __F16C__
+			// the conversion instruction of the x86 variants, 8 values at a time
+			__m256 x8 = _mm256_set1_ps(xj);
+			for (; i + 8 <= _rows; i += 8){
+				__m256 w8 = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(w + i)));
+				_mm256_storeu_ps(_y + i, _mm256_add_ps(_mm256_loadu_ps(_y + i), _mm256_mul_ps(w8, x8)));
+			}
+#endif
+			for (; i < _rows; i++)
+				_y[i] += fp16ToFloat(w[i])*xj;
+		}
+	}
+
+	void gemvInt8Kernel(const int8_t* _W, const float* _scale, const float* _x, float* _y, int _rows, int _cols){
+		// blocks of rows are accumulated unscaled, and the scale of each row is applied once per block
+		const int block = 256;
+		float acc[block];
+		for (int i0 = 0; i0 < _rows; i0 += block){
+			int nb = minimum(block, _rows - i0);
+			for (int i = 0; i < nb; i++)
+				acc[i] = 0.0;
+			for (int j = 0; j < _cols; j++){
+				const int8_t* w = _W + size_t(j)*_rows + i0;
+				float xj = _x[j];
+				for (int i = 0; i < nb; i++)
+					acc[i] += float(w[i])*xj;
+			}
+			for (int i = 0; i < nb; i++)
+				_y[i0 + i] += _scale[i0 + i]*acc[i];
+		}
+	}
+
+	void spmvKernel(const float* _values, const int* _columns, const int* _rowStart, const float* _x, float* _y, int _rows){
+		for (int i = 0; i < _rows; i++){
+			int k = _rowStart[i];
+			int end = _rowStart[i + 1];
+			float acc = 0.0;
+#if defined(__AVX2__) && defined(__FMA__)
+			// the inputs of 8 values at a time are gathered, and the lanes are summed at the end of the row
+			__m256 acc8 = _mm256_setzero_ps();
+			for (; k + 8 <= end; k += 8){
+				__m256 x8 = _mm256_i32gather_ps(_x, _mm256_loadu_si256((const __m256i*)(_columns + k)), 4);
+				acc8 = _mm256_fmadd_ps(_mm256_loadu_ps(_values + k), x8, acc8);
+			}
+			float lanes[8];
+			_mm256_storeu_ps(lanes, acc8);
+			for (int j = 0; j < 8; j++)
+				acc += lanes[j];
+#endif
+			for (; k < end; k++)
+				acc += _values[k]*_x[_columns[k]];
+			_y[i] += acc;
+		}
+	}
+
+	void adamKernel(float* _p, const float* _g, float* _m, float* _v, int _n, float _alpha, float _beta1, float _beta2, double _c1, double _c2){
+		for (int i = 0; i < _n; i++){
+			_m[i] = _beta1*_m[i] + (1.0-_beta1)*_g[i];
+			_v[i] = _beta2*_v[i] + (1.0-_beta2)*(_g[i]*_g[i]);
+			float mHat = _m[i]/_c1;
+			float vHat = _v[i]/_c2;
+			_p[i] -= _alpha*mHat/(sqrt(double(vHat))+nonZero);
+		}
+	}
+
+	void gaussianKernel(const float* _ref, float _v, float _sigma2, float* _out, int _n){
+		float normalization = 0.0;
+		for (int r = 0; r < _n; r++){
+			double dr = _ref[r] - _v;
+			_out[r] = exp(-(dr*dr)/_sigma2);
+			normalization += _out[r];
+		}
+		for (int r = 0; r < _n; r++)
+			_out[r] /= normalization;
+	}
+
+	const KernelTable kernelTable = {
+		KERNEL_ISA,
+		&tanhKernel,
+		&softmaxKernel,
+		&gemvKernel,
+		&gemvBf16Kernel,
+		&gemvFp16Kernel,
+		&gemvInt8Kernel,
+		&spmvKernel,
+		&adamKernel,
+		&gaussianKernel
+	};
+
+} /* namespace */
+} /* namespace oist */
+
+#endif /* SRC_UTILS_KERNELSIMPL_H_ */
@@ -0,0 +1,161 @@
+/*<!--
+
+ BSD 3-Clause License
+
+  Copyright (c) 2020 Okinawa Institute of Science and Technology (OIST).
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above
+     copyright notice, this list of conditions and the following
+     disclaimer in the documentation and/or other materials provided
+     with the distribution.
+   * Neither the name of Willow Garage, Inc. nor the names of its
+     contributors may be used to endorse or promote products derived
+     from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+ Author: Hendry F. Chame <hendryfchame@gmail.com>
+
+ Publication:
+
+   Chame, H. F., Ahmadi, A., & Tani, J. (2020).
+   A hybrid human-neurorobotics approach to primary intersubjectivity via
+   active inference. Frontiers in psychology, 11.
+
+   Okinawa Institute of Science and Technology Graduate University (OIST)
+   Cognitive Neurorobotics Research Unit (CNRU)
+   1919-1, Tancha, Onna, Kunigami District, Okinawa 904-0495, Japan
+
+-->*/
+
+#include "Precision.h"
+#include "Kernels.h"
+
+namespace oist {
+
+	bool toPrecision(const string& _name, Precision& _precision){
+		if (_name == "fp32")
+			_precision = PRECISION_FP32;
+		else if (_name == "bf16")
+			_precision = PRECISION_BF16;
+		else if (_name == "fp16")
+			_precision = PRECISION_FP16;
+		else if (_name == "int8")
+			_precision = PRECISION_INT8;
+		else
+			return false;
+		return true;
+	}
+
+	string precisionName(Precision _precision){
+		switch (_precision){
+		case PRECISION_BF16: return "bf16";
+		case PRECISION_FP16: return "fp16";
+		case PRECISION_INT8: return "int8";
+		default: return "fp32";
+		}
+	}
+
+	uint16_t toBf16(float _f){
+		uint32_t b;
+		memcpy(&b, &_f, sizeof(b));
+		// a NaN is kept quiet, the truncation could turn it into an infinity
+		if ((b & 0x7fffffffu) > 0x7f800000u)
+			return uint16_t((b >> 16) | 0x40u);
+		b += 0x7fffu + ((b >> 16) & 1u);
+		return uint16_t(b >> 16);
+	}
+
+	uint16_t toFp16(float _f){
+		uint32_t b;
+		memcpy(&b, &_f, sizeof(b));
+		uint16_t sign = uint16_t((b >> 16) & 0x8000u);
+		uint32_t a = b & 0x7fffffffu;
+
+		// infinity and NaN
+		if (a >= 0x7f800000u)
+			return sign | 0x7c00u | (a > 0x7f800000u ? 0x200u : 0u);
+		// overflow, from 65520 the value is rounded to infinity
+		if (a >= 0x477ff000u)
+			return sign | 0x7c00u;
+		// subnormal, in units of 2^-24
+		if (a < 0x38800000u){
+			float v;
+			memcpy(&v, &a, sizeof(v));
+			return sign | uint16_t(nearbyintf(v*16777216.0f));
+		}
+		// normal, the exponent bias goes from 127 to 15
+		a += 0xfffu + ((a >> 13) & 1u);
+		return sign | uint16_t((a - 0x38000000u) >> 13);
+	}
+
+	void ReducedMatrix::set(const MatrixXf& _m, Precision _precision){
+		clear();
+		precision = _precision;
+		rows = int(_m.rows());
+		cols = int(_m.cols());
+		const float* f = _m.data();
+
+		if (precision == PRECISION_INT8){
+			// symmetric quantization per row, the rows are the output channels of the products
+			scale = _m.cwiseAbs().rowwise().maxCoeff()/127.0f;
+			VectorXf inv = (scale.array() > 0.0f).select(scale.cwiseInverse(), 0.0f);
+			qdata.resize(_m.size());
+			for (int j = 0; j < cols; j++)
+				for (int i = 0; i < rows; i++, f++)
+					qdata[j*rows + i] = int8_t(std::max(-127.0f, std::min(127.0f, nearbyintf(*f*inv(i)))));
+			return;
+		}
+
+		data.resize(_m.size());
+		for (size_t i = 0; i < data.size(); i++)
+			data[i] = precision == PRECISION_FP16 ? toFp16(f[i]) : toBf16(f[i]);
+	}
+
+	void ReducedMatrix::clear(){
+		data = vector<uint16_t>();
+		qdata = vector<int8_t>();
+		scale.resize(0);
+		rows = 0;
+		cols = 0;
+	}
+
+	void ReducedMatrix::gemv(const float* _x, float* _y) const{
+		switch (precision){
+		case PRECISION_BF16:
+			kernels->gemvBf16(data.data(), _x, _y, rows, cols);
+			break;
+		case PRECISION_FP16:
+			kernels->gemvFp16(data.data(), _x, _y, rows, cols);
+			break;
+		case PRECISION_INT8:
+			kernels->gemvInt8(qdata.data(), scale.data(), _x, _y, rows, cols);
+			break;
+		default:
+			throw Exception("the matrix has no reduced precision copy");
+		}
+	}
+
+	size_t ReducedMatrix::bytes() const{
+		return data.size()*sizeof(uint16_t) + qdata.size()*sizeof(int8_t) + scale.size()*sizeof(float);
+	}
+
+} /* namespace oist */
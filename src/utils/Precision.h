@@ -0,0 +1,129 @@
+/*<!--
+
+ BSD 3-Clause License
+
+  Copyright (c) 2020 Okinawa Institute of Science and Technology (OIST).
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above
+     copyright notice, this list of conditions and the following
+     disclaimer in the documentation and/or other materials provided
+     with the distribution.
+   * Neither the name of Willow Garage, Inc. nor the names of its
+     contributors may be used to endorse or promote products derived
+     from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+ Author: Hendry F. Chame <hendryfchame@gmail.com>
+
+ Publication:
+
+   Chame, H. F., Ahmadi, A., & Tani, J. (2020).
+   A hybrid human-neurorobotics approach to primary intersubjectivity via
+   active inference. Frontiers in psychology, 11.
+
+   Okinawa Institute of Science and Technology Graduate University (OIST)
+   Cognitive Neurorobotics Research Unit (CNRU)
+   1919-1, Tancha, Onna, Kunigami District, Okinawa 904-0495, Japan
+
+-->*/
+
+#ifndef SRC_UTILS_PRECISION_H_
+#define SRC_UTILS_PRECISION_H_
+
+#include "../includes.h"
+#include <cstdint>
+
+namespace oist {
+
+/**
+ * Storage precision of the inference copies of the weights, the products are accumulated in single precision
+ * */
+enum Precision {
+	PRECISION_FP32 = 0,	// single precision, the weights are used directly
+	PRECISION_BF16,		// brain floating point, the 16 high bits of the single precision (8 bits exponent)
+	PRECISION_FP16,		// IEEE 754 half precision (5 bits exponent, values up to 65504)
+	PRECISION_INT8		// 8 bits integers with a scale per row (output channel), symmetric around zero
+};
+
+/**
+ * Gets a precision from its name ('fp32', 'bf16', 'fp16' or 'int8')
+ * @param name Name
+ * @param precision Output precision
+ * @return False if the name is unknown
+ * */
+bool toPrecision(const string& name, Precision& precision);
+
+/**
+ * Gets the name of a precision
+ * */
+string precisionName(Precision precision);
+
+/**
+ * Converts a single precision value to brain floating point, rounding to the nearest even
+ * */
+uint16_t toBf16(float f);
+
+/**
+ * Converts a single precision value to IEEE half precision, rounding to the nearest even
+ * */
+uint16_t toFp16(float f);
+
+/**
+ * Copy of a matrix in reduced precision (column-major), used for inference only
+ * */
+struct ReducedMatrix {
+
+	Precision precision = PRECISION_FP32;
+	vector<uint16_t> data;		// bf16 or fp16 values
+	vector<int8_t> qdata;		// int8 values
+	VectorXf scale;				// int8 scale of each row, the largest magnitude of the row maps to 127
+	int rows = 0;
+	int cols = 0;
+
+	/**
+	 * Sets the copy of a matrix, the int8 values are rounded to the nearest integer (post-training quantization)
+	 * @param m Matrix
+	 * @param precision PRECISION_BF16, PRECISION_FP16 or PRECISION_INT8
+	 * */
+	void set(const MatrixXf& m, Precision precision);
+
+	/**
+	 * Releases the copy
+	 * */
+	void clear();
+
+	/**
+	 * Accumulates the product with a vector, y += M*x, with the kernels of the selected instruction set
+	 * @param x Vector of cols values
+	 * @param y Vector of rows values
+	 * */
+	void gemv(const float* x, float* y) const;
+
+	/**
+	 * Gets the number of bytes of the copy
+	 * */
+	size_t bytes() const;
+};
+
+} /* namespace oist */
+
+#endif /* SRC_UTILS_PRECISION_H_ */
@@ -0,0 +1,152 @@
+/*<!--
+
+ BSD 3-Clause License
+
+  Copyright (c) 2020 Okinawa Institute of Science and Technology (OIST).
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above
+     copyright notice, this list of conditions and the following
+     disclaimer in the documentation and/or other materials provided
+     with the distribution.
+   * Neither the name of Willow Garage, Inc. nor the names of its
+     contributors may be used to endorse or promote products derived
+     from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+ Author: Hendry F. Chame <hendryfchame@gmail.com>
+
+ Publication:
+
+   Chame, H. F., Ahmadi, A., & Tani, J. (2020).
+   A hybrid human-neurorobotics approach to primary intersubjectivity via
+   active inference. Frontiers in psychology, 11.
+
+   Okinawa Institute of Science and Technology Graduate University (OIST)
+   Cognitive Neurorobotics Research Unit (CNRU)
+   1919-1, Tancha, Onna, Kunigami District, Okinawa 904-0495, Japan
+
+-->*/
+
+
+#include "Pruning.h"
+#include "Kernels.h"
+#include <limits>
+
+namespace oist {
+
+	float Pruning::threshold(const vector<MatrixXf*>& _weights, float _sparsity){
+
+		vector<float> magnitudes;
+		for (MatrixXf* w : _weights){
+			const float* p = w->data();
+			for (Index i = 0; i < w->size(); i++)
+				magnitudes.push_back(std::abs(p[i]));
+		}
+
+		// the k-th smallest magnitude, the k smaller entries are pruned
+		size_t k = size_t(_sparsity*magnitudes.size());
+		if (k == 0)
+			return 0.0;
+		if (k >= magnitudes.size())
+			return std::numeric_limits<float>::infinity();
+		std::nth_element(magnitudes.begin(), magnitudes.begin() + k, magnitudes.end());
+		return magnitudes[k];
+	}
+
+	void Pruning::prune(const vector<MatrixXf*>& _weights, float _sparsity, float _threshold){
+
+		clear();
+		for (MatrixXf* w : _weights){
+			float threshold = _threshold >= 0.0 ? _threshold : Pruning::threshold(vector<MatrixXf*>(1, w), _sparsity);
+			weights.push_back(w);
+			masks.push_back(w->array().abs() >= threshold);
+		}
+		apply();
+	}
+
+	void Pruning::apply(){
+		for (size_t i = 0; i < weights.size(); i++)
+			*weights[i] = masks[i].select(*weights[i], 0.0f);
+	}
+
+	void Pruning::clear(){
+		weights.clear();
+		masks.clear();
+	}
+
+	bool Pruning::empty() const{
+		return weights.empty();
+	}
+
+	void PrunedMatrix::set(const MatrixXf& _m, float _maxDensity){
+		clear();
+		rows = int(_m.rows());
+		cols = int(_m.cols());
+
+		if (density(_m) > _maxDensity){
+			values.assign(_m.data(), _m.data() + _m.size());
+			return;
+		}
+
+		rowStart.reserve(rows + 1);
+		for (int i = 0; i < rows; i++){
+			rowStart.push_back(int(values.size()));
+			for (int j = 0; j < cols; j++){
+				if (_m(i, j) != 0.0){
+					values.push_back(_m(i, j));
+					columns.push_back(j);
+				}
+			}
+		}
+		rowStart.push_back(int(values.size()));
+	}
+
+	void PrunedMatrix::clear(){
+		values = vector<float>();
+		columns = vector<int>();
+		rowStart = vector<int>();
+		rows = 0;
+		cols = 0;
+	}
+
+	bool PrunedMatrix::sparse() const{
+		return !rowStart.empty();
+	}
+
+	void PrunedMatrix::gemv(const float* _x, float* _y) const{
+		if (sparse())
+			kernels->spmv(values.data(), columns.data(), rowStart.data(), _x, _y, rows);
+		else
+			kernels->gemv(values.data(), _x, _y, rows, cols);
+	}
+
+	size_t PrunedMatrix::bytes() const{
+		return values.size()*sizeof(float) + columns.size()*sizeof(int) + rowStart.size()*sizeof(int);
+	}
+
+	float density(const MatrixXf& _m){
+		if (_m.size() == 0)
+			return 0.0;
+		return float((_m.array() != 0.0f).count())/float(_m.size());
+	}
+
+} /* namespace oist */
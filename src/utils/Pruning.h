@@ -0,0 +1,150 @@
+/*<!--
+
+ BSD 3-Clause License
+
+  Copyright (c) 2020 Okinawa Institute of Science and Technology (OIST).
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above
+     copyright notice, this list of conditions and the following
+     disclaimer in the documentation and/or other materials provided
+     with the distribution.
+   * Neither the name of Willow Garage, Inc. nor the names of its
+     contributors may be used to endorse or promote products derived
+     from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+ Author: Hendry F. Chame <hendryfchame@gmail.com>
+
+ Publication:
+
+   Chame, H. F., Ahmadi, A., & Tani, J. (2020).
+   A hybrid human-neurorobotics approach to primary intersubjectivity via
+   active inference. Frontiers in psychology, 11.
+
+   Okinawa Institute of Science and Technology Graduate University (OIST)
+   Cognitive Neurorobotics Research Unit (CNRU)
+   1919-1, Tancha, Onna, Kunigami District, Okinawa 904-0495, Japan
+
+-->*/
+
+
+#ifndef SRC_UTILS_PRUNING_H_
+#define SRC_UTILS_PRUNING_H_
+
+#include "../includes.h"
+
+namespace oist {
+
+/**
+ * Magnitude pruning of weight matrices. The pruned entries are kept in a mask, so that they stay zero after
+ * the following updates of the matrices (e.g. a short fine-tuning). The masks are only held in memory, the
+ * pruned matrices are saved as the dense ones
+ * */
+class Pruning {
+
+	vector<MatrixXf*> weights;
+	vector<Array<bool, Dynamic, Dynamic> > masks;	// flags of the kept entries
+
+public:
+
+	/**
+	 * Gets the magnitude threshold pruning a fraction of the smallest entries of a group of matrices
+	 * @param weights Matrices
+	 * @param sparsity Fraction of pruned entries, in [0, 1)
+	 * @return Threshold, the entries of smaller magnitude are pruned
+	 * */
+	static float threshold(const vector<MatrixXf*>& weights, float sparsity);
+
+	/**
+	 * Prunes matrices by magnitude and keeps their masks, replacing the former ones
+	 * @param weights Matrices, which should outlive the pruning
+	 * @param sparsity Fraction of pruned entries of each matrix, used when the threshold is negative
+	 * @param threshold Magnitude threshold shared by the matrices (e.g. global pruning), or negative
+	 * */
+	void prune(const vector<MatrixXf*>& weights, float sparsity, float threshold);
+
+	/**
+	 * Sets the pruned entries to zero again, nothing when no matrix is pruned
+	 * */
+	void apply();
+
+	/**
+	 * Releases the masks, the pruned entries can be updated again
+	 * */
+	void clear();
+
+	/**
+	 * Flag indicating that no matrix is pruned
+	 * */
+	bool empty() const;
+};
+
+/**
+ * Inference copy of a pruned matrix, in compressed sparse row format when its density is at most a threshold,
+ * dense otherwise (the format with the faster product)
+ * */
+struct PrunedMatrix {
+
+	vector<float> values;		// non-zero values row by row, or all the values column-major when dense
+	vector<int> columns;		// column of each non-zero value
+	vector<int> rowStart;		// position of the first value of each row, and the number of values at the end
+	int rows = 0;
+	int cols = 0;
+
+	/**
+	 * Sets the copy of a matrix
+	 * @param m Matrix
+	 * @param maxDensity Maximum fraction of non-zero entries of the sparse format
+	 * */
+	void set(const MatrixXf& m, float maxDensity);
+
+	/**
+	 * Releases the copy
+	 * */
+	void clear();
+
+	/**
+	 * Flag indicating that the copy is in the sparse format
+	 * */
+	bool sparse() const;
+
+	/**
+	 * Accumulates the product with a vector, y += M*x, with the kernels of the selected instruction set
+	 * @param x Vector of cols values
+	 * @param y Vector of rows values
+	 * */
+	void gemv(const float* x, float* y) const;
+
+	/**
+	 * Gets the number of bytes of the copy
+	 * */
+	size_t bytes() const;
+};
+
+/**
+ * Gets the fraction of non-zero entries of a matrix
+ * */
+float density(const MatrixXf& m);
+
+} /* namespace oist */
+
+#endif /* SRC_UTILS_PRUNING_H_ */
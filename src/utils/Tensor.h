@@ -0,0 +1,240 @@
+/*<!--
+
+ BSD 3-Clause License
+
+  Copyright (c) 2020 Okinawa Institute of Science and Technology (OIST).
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions
+  are met:
+
+   * Redistributions of source code must retain the above copyright
+     notice, this list of conditions and the following disclaimer.
+   * Redistributions in binary form must reproduce the above
+     copyright notice, this list of conditions and the following
+     disclaimer in the documentation and/or other materials provided
+     with the distribution.
+   * Neither the name of Willow Garage, Inc. nor the names of its
+     contributors may be used to endorse or promote products derived
+     from this software without specific prior written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+  FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+  COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+  BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+  LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+  CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+  LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+  ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+  POSSIBILITY OF SUCH DAMAGE.
+
+ Author: Hendry F. Chame <hendryfchame@gmail.com>
+
+ Publication:
+
+   Chame, H. F., Ahmadi, A., & Tani, J. (2020).
+   A hybrid human-neurorobotics approach to primary intersubjectivity via
+   active inference. Frontiers in psychology, 11.
+
+   Okinawa Institute of Science and Technology Graduate University (OIST)
+   Cognitive Neurorobotics Research Unit (CNRU)
+   1919-1, Tancha, Onna, Kunigami District, Okinawa 904-0495, Japan
+
+-->*/
+
+#ifndef SRC_UTILS_TENSOR_H_
+#define SRC_UTILS_TENSOR_H_
+
+#include "../includes.h"
+
+namespace oist {
+
+/**
+ * Non-owning view of a time step of an encoded sequence. The vectors of the degrees of freedom
+ * are consecutive segments of the column of the time step
+ * */
+class StepViewXf {
+
+	const float* col;
+	const int* units;
+	const int* first;
+	int nDof;
+
+public:
+
+	typedef Map<const VectorXf> value_type;
+
+	StepViewXf(const float* _col, const int* _units, const int* _first, int _nDof) :
+		col(_col), units(_units), first(_first), nDof(_nDof) {}
+
+	/**
+	 * Gets the number of degrees of freedom
+	 * */
+	size_t size() const { return nDof; }
+
+	/**
+	 * Gets the vector of a degree of freedom
+	 * @param j Degree of freedom
+	 * */
+	Map<const VectorXf> operator[](int j) const { return Map<const VectorXf>(col + first[j], units[j]); }
+};
+
+/**
+ * Non-owning view of an encoded sequence, stored as a column-major matrix with a column per time step
+ * */
+class SequenceViewXf {
+
+	const float* data;
+	int rows;
+	int cols;
+	const int* units;
+	const int* first;
+	int nDof;
+
+public:
+
+	typedef StepViewXf value_type;
+
+	SequenceViewXf(const float* _data, int _rows, int _cols, const int* _units, const int* _first, int _nDof) :
+		data(_data), rows(_rows), cols(_cols), units(_units), first(_first), nDof(_nDof) {}
+
+	/**
+	 * Gets the number of time steps
+	 * */
+	size_t size() const { return cols; }
+
+	/**
+	 * Gets a time step
+	 * @param t Time step
+	 * */
+	StepViewXf operator[](int t) const { return StepViewXf(data + (size_t)t*rows, units, first, nDof); }
+
+	/**
+	 * Gets the whole sequence (units x time steps)
+	 * */
+	Map<const MatrixXf> matrix() const { return Map<const MatrixXf>(data, rows, cols); }
+};
+
+/**
+ * Contiguous container of the encoded samples of a primitive [sample][time][dof]. The samples are
+ * stored consecutively in a single buffer, each one as a column-major matrix with a column of units
+ * per time step, where the units of each degree of freedom are a segment of the column.
+ * The samples can have different lengths. The indexing operators return non-owning views, hence
+ * the data moves between the data-set, the training loop and the network without copies
+ * */
+class TensorXf {
+
+	int1DContainer units;		// number of units per degree of freedom
+	int1DContainer first;		// first row of each degree of freedom
+	int rows;					// number of units of all the degrees of freedom
+	float1DContainer buffer;	// values [sample][time][unit]
+	vector<size_t> offset;		// position of the first value of each sample in the buffer
+	int1DContainer steps;		// number of time steps per sample
+
+public:
+
+	typedef SequenceViewXf value_type;
+
+	TensorXf() : rows(0) {}
+
+	/**
+	 * Constructor
+	 * @param _units Number of encoding units per degree of freedom
+	 * */
+	explicit TensorXf(const int1DContainer& _units) : units(_units), rows(0) {
+		for (unsigned int j = 0; j < units.size(); j++){
+			first.push_back(rows);
+			rows += units[j];
+		}
+	}
+
+	/**
+	 * Reserves memory for a number of time steps of all the samples, avoiding reallocations while appending
+	 * @param nSteps Total number of time steps
+	 * */
+	void reserve(size_t nSteps) { buffer.reserve(nSteps*rows); }
+
+	/**
+	 * Appends a sample
+	 * @param nSteps Number of time steps of the sample
+	 * @return Writable matrix of the sample (units x time steps), valid until the next append
+	 * */
+	Map<MatrixXf> append(int nSteps) {
+		offset.push_back(buffer.size());
+		steps.push_back(nSteps);
+		buffer.resize(buffer.size() + (size_t)nSteps*rows, 0.0f);
+		return Map<MatrixXf>(buffer.data() + offset.back(), rows, nSteps);
+	}
+
+	/**
+	 * Moves the samples of another tensor to the end of this one
+	 * @param other Tensor with the same encoding units, it is left empty
+	 * */
+	void append(TensorXf& other) {
+		if (offset.empty() && units.empty()){
+			std::swap(*this, other);
+			return;
+		}
+		if (other.units != units)
+			throw Exception("The encoding units of the appended samples do not match");
+		for (unsigned int s = 0; s < other.offset.size(); s++){
+			offset.push_back(buffer.size() + other.offset[s]);
+			steps.push_back(other.steps[s]);
+		}
+		buffer.insert(buffer.end(), other.buffer.begin(), other.buffer.end());
+		other = TensorXf(units);
+	}
+
+	/**
+	 * Removes the samples, the allocated memory is kept so that the tensor can be refilled at low cost
+	 * */
+	void clear() {
+		buffer.clear();
+		offset.clear();
+		steps.clear();
+	}
+
+	/**
+	 * Gets the number of samples
+	 * */
+	size_t size() const { return offset.size(); }
+
+	/**
+	 * Gets the number of units of all the degrees of freedom
+	 * */
+	int getRows() const { return rows; }
+
+	/**
+	 * Gets the number of units per degree of freedom
+	 * */
+	const int1DContainer& getUnits() const { return units; }
+
+	/**
+	 * Gets all the values [sample][time][unit]
+	 * */
+	const float1DContainer& values() const { return buffer; }
+
+	/**
+	 * Gets a sample
+	 * @param s Sample
+	 * */
+	SequenceViewXf operator[](int s) const {
+		return SequenceViewXf(buffer.data() + offset[s], rows, steps[s], units.data(), first.data(), units.size());
+	}
+
+	/**
+	 * Gets a writable sample (units x time steps)
+	 * @param s Sample
+	 * */
+	Map<MatrixXf> sample(int s) { return Map<MatrixXf>(buffer.data() + offset[s], rows, steps[s]); }
+};
+
+typedef vector<TensorXf> tensorXf1DContainer;
+
+} /* namespace oist */
+
+#endif /* SRC_UTILS_TENSOR_H_ */
@@ -51,8 +51,8 @@
 
 namespace oist {
 
-std::default_random_engine Utils::generator = std::default_random_engine();
-std::normal_distribution<float> Utils::distribution = std::normal_distribution<float>(0.0,1.0);
+thread_local std::default_random_engine Utils::generator = std::default_random_engine();
+thread_local std::normal_distribution<float> Utils::distribution = std::normal_distribution<float>(0.0,1.0);
 
 Utils* Utils::myInstance = nullptr;
 
@@ -62,6 +62,23 @@ Utils::Utils() : delimiter(","){
 
 }
 
+void Utils::seed(unsigned int _seed){
+	generator.seed(_seed);
+	distribution.reset();
+}
+
+string Utils::getRandomState(){
+	// the distribution is saved too, since it may hold the second value of a pair of draws
+	stringstream state;
+	state << generator << " " << distribution;
+	return state.str();
+}
+
+void Utils::setRandomState(const string& _state){
+	stringstream state(_state);
+	state >> generator >> distribution;
+}
+
 Utils* Utils::getInstance(){
 
 	if (myInstance == nullptr){
@@ -157,6 +174,29 @@ void Utils::getProperties(map<string,float1DContainer>& _mapFloat1D, map<string,
 			_mapString["robot"] = line;
 			continue;
 		}
+		else if (key == "session"){
+			trim(line);
+			_mapString["session"] = line;
+			continue;
+		}
+		else if (key == "checkpoint"){
+			trim(line);
+			tolower(line);
+			_mapString["checkpoint"] = line;
+			continue;
+		}
+		else if (key == "optimizer" || key == "aoptimizer"){
+			trim(line);
+			tolower(line);
+			_mapString[key] = line;
+			continue;
+		}
+		else if (key == "freeze"){
+			line.erase(std::remove_if(line.begin(), line.end(), ::isspace), line.end());
+			tolower(line);
+			_mapString["freeze"] = line;
+			continue;
+		}
 		else if (key == "shuffle"){
 			trim(line);
 			_mapBool["shuffle"] = (line == "true");
@@ -172,6 +212,16 @@ void Utils::getProperties(map<string,float1DContainer>& _mapFloat1D, map<string,
 			_mapBool["greedy"] = (line == "true");
 			continue;
 		}
+		else if (key == "datacache"){
+			trim(line);
+			_mapBool["datacache"] = (line == "true");
+			continue;
+		}
+		else if (key == "asyncvalidation"){
+			trim(line);
+			_mapBool["asyncvalidation"] = (line == "true");
+			continue;
+		}
 
 		float1DContainer value;
 
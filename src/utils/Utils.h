@@ -51,6 +51,7 @@
 #define SRC_UTILS_UTILS_H_
 
 #include "../includes.h"
+#include "Kernels.h"
 
 namespace oist {
 
@@ -65,8 +66,9 @@ class Utils {
 	const string delimiter;
 	Utils();
 	~Utils();
-	static std::default_random_engine generator;
-	static std::normal_distribution<float> distribution;
+	// each thread draws its own sequence, e.g. the validation thread does not alter the training one
+	static thread_local std::default_random_engine generator;
+	static thread_local std::normal_distribution<float> distribution;
 
 public:
 
@@ -146,17 +148,42 @@ public:
 	template <typename T> void power(T* io, float exp);
 
 	/**
-	 * Computes the softmax function
+	 * Computes the softmax function, with the kernels of the selected instruction set
 	 * @param io Input/Output data type
 	 * */
 	template <typename T> void softmax(T* io);
 
+	/**
+	 * Computes the softmax function together with its logarithm, which is obtained
+	 * from the input activations without evaluating a logarithm per element
+	 * @param io Input/Output data type
+	 * @param logOut Output logarithm of the softmax
+	 * */
+	template <typename T> void softmax(T* io, T* logOut);
+
 	/**
 	 * Computes Gaussian noise in N(1,0)
 	 * @param io Input/Output data type
 	 * */
 	template <typename T> void randN(T* io);
 
+	/**
+	 * Seeds the random generator of the calling thread
+	 * @param seed Seed
+	 * */
+	void seed(unsigned int seed);
+
+	/**
+	 * Gets the state of the random generator of the calling thread, e.g. to restore it after a reseeded run
+	 * */
+	string getRandomState();
+
+	/**
+	 * Restores the state of the random generator of the calling thread
+	 * @param state State obtained with @ref getRandomState
+	 * */
+	void setRandomState(const string& state);
+
 	/**
 	 * Shuffles a container
 	 * @param io Input/Output data type
@@ -170,24 +197,11 @@ public:
 	template <typename T> void zero(T* io);
 
 	/**
-	 * Computes the hyperbolic tangent
+	 * Computes the hyperbolic tangent, with the kernels of the selected instruction set
 	 * @param io Input/Output data type
 	 * */
 	template <typename T> void tanH(T* io);
 
-	/**
-	 * Computes ADAM optimization
-	 * @param p Input/Ouput parameter
-	 * @param g Input gradient
-	 * @param m Input m
-	 * @param v Input v
-	 * @param epoch Epoch number
-	 * @param alpha Adam optimization hyper parameter \f$\alpha\f$
-	 * @param beta1 Adam optimization hyper parameter \f$\beta_1\f$
-	 * @param beta2 Adam optimization hyper parameter \f$\beta_2\f$
-	 * */
-	template <typename T> void adam(T* p, T* g, T* m, T* v, int epoch, float alpha, float beta1, float beta2);
-
 	/**
 	 * Copy values from two Eigen objects
 	 * @param input Input data
@@ -266,13 +280,14 @@ public:
 
 	template <typename T>
 	inline void Utils::softmax(T* _v){
-		auto d = _v->data();
-		float accum = 0.0;
-		for (int i = 0; i < _v->size(); i++, d++){
-			*d = exp(*d);
-			accum += *d;
-		}
-		*_v /= accum;
+		kernels->softmax(_v->data(), int(_v->size()));
+	}
+
+	template <typename T>
+	inline void Utils::softmax(T* _v, T* _log){
+		*_log = *_v;
+		float accum = kernels->softmax(_v->data(), int(_v->size()));
+		_log->array() -= log(accum);
 	}
 
 	template <typename T>
@@ -297,26 +312,9 @@ public:
 
 	template <typename T>
 	inline void Utils::tanH(T* _v){
-		auto d = _v->data();
-		for (int i = 0; i < _v->size(); i++, d++)
-			*d = tanh(*d);
+		kernels->tanh(_v->data(), int(_v->size()));
 	}
 
-	template <typename T>
-	inline void Utils::adam(T* _p, T* _g, T* _m, T* _v, int _epoch, float _alpha, float _beta1, float _beta2){
-		auto p = _p->data();
-		auto g = _g->data();
-		auto m = _m->data();
-		auto v = _v->data();
-		for (int i = 0 ; i < _p->size(); i++, p++, g++, m++, v++){
-			*m = _beta1*(*m) + (1.0-_beta1)*(*g);
-			*v = _beta2*(*v) + (1.0-_beta2)*((*g) * (*g));
-			float mHat = *m / (1.0 - pow(_beta1, _epoch));
-			float vHat = *v / (1.0 - pow(_beta2, _epoch));
-			*p -= _alpha *mHat/(pow(vHat, 0.5)+NON_ZERO);
-		}
-	 }
-
 	template <typename T>
 	inline void Utils::copyEigen(T* _from, T* _to){
 		auto f = _from->data();
@@ -327,6 +325,11 @@ public:
 
 	template <typename T>
 	void Utils::saveEigen(ofstream* _f, T* _d, string _delimiter){
+		// an empty line for an empty buffer, e.g. the state of a memory-lean optimizer
+		if (_d->size() == 0){
+			*_f << endl;
+			return;
+		}
 		auto d = _d->data();
 		for (int j = 0; j < _d->size()-1; j++, d++){
 			*_f << *d << _delimiter;
@@ -365,31 +368,27 @@ public:
 		try{
 			string line;
 			getline(*_f, line);
-			size_t pos = 0;
-			std::string::size_type sz;
-			std::string token;
+
+			// single pass over the line: tokens are parsed in place, without
+			// copying or erasing the consumed prefix
 			auto d = _v->data();
-			while ((pos = line.find(_delimiter)) != std::string::npos) {
-				 token = line.substr(0, pos);
-				 try{
-					 *d = std::stof(token,&sz);
-					 d++;
-				 }
-				 catch (const std::invalid_argument& ia) {
-					  std::cerr << "Invalid argument: " << ia.what() << '\n';
-				 }catch (const std::out_of_range& oor) {
-					 *d = 0.0;
-					 d++;
-				 }
-				 line.erase(0, pos + _delimiter.length());
-			 }
-			try{
-				 *d = std::stof(line,&sz);
-			}
-			catch (const std::invalid_argument& ia) {
-				  std::cerr << "Invalid argument: " << ia.what() << '\n';
-			}catch (const std::out_of_range& oor) {
-				 *d = 0.0;
+			auto dEnd = d + _v->size();
+			const char* c = line.c_str();
+			const char* cEnd = c + line.size();
+			while (c <= cEnd && d < dEnd) {
+				const char* next = strstr(c, _delimiter.c_str());
+				if (next == nullptr)
+					next = cEnd;
+				char* parsed = nullptr;
+				errno = 0;
+				float value = strtof(c, &parsed);
+				if (parsed == c){
+					std::cerr << "Invalid argument: stof" << '\n';
+				}else{
+					*d = (errno == ERANGE) ? 0.0f : value;
+					d++;
+				}
+				c = next + _delimiter.length();
 			}
 		}catch(...){
 			throw Exception("A exception occurred in readVecFromFile method");